@@ -0,0 +1,190 @@
+#include "Batch.hpp"
+
+#include <atomic>
+#include <optional>
+#include <thread>
+
+namespace Emulator {
+
+static auto statusName(BatchJob::Status status) -> std::string_view {
+  switch (status) {
+    case BatchJob::Status::OK:      return "ok";
+    case BatchJob::Status::ERROR:   return "error";
+    case BatchJob::Status::TIMEOUT: return "timeout";
+  }
+  return "";
+}
+
+static auto readFile(const std::string& path) -> std::string {
+  std::ifstream file(path, std::ios::binary);
+  if (!file) {
+    throw std::runtime_error(std::format("ERROR! Couldn't open {}\n", path));
+  }
+
+  std::ostringstream content;
+  content << file.rdbuf();
+  return content.str();
+}
+
+auto Batch::load(const std::string& list) -> std::vector<BatchJob> {
+  std::ifstream file(list);
+  if (!file) {
+    throw std::runtime_error(std::format("ERROR! Couldn't open {}\n", list));
+  }
+
+  std::vector<BatchJob> jobs;
+  std::string line;
+  for (u64 number = 1; std::getline(file, line); number++) {
+    std::istringstream fields(line);
+    BatchJob job;
+    if (!(fields >> job.program) || job.program.starts_with('#'))
+      continue;
+
+    fields >> job.input;
+    if (!job.program.contains(".asm") && !ElfFile::isElf(job.program)) {
+      throw std::runtime_error(std::format("ERROR! {}:{}: you must use only .asm files or MIPS executables\n", list, number));
+    }
+    jobs.push_back(std::move(job));
+  }
+
+  return jobs;
+}
+
+auto Batch::finish(Task& task, BatchJob::Status status) -> void {
+  Guest& guest = *task.guest;
+  BatchJob& job = *task.job;
+
+  job.status = status;
+  job.output = std::move(guest.output).str();
+  job.retired = guest.cpu.retired;
+  job.time = std::chrono::steady_clock::now() - guest.start;
+  job.cpuTime = guest.engine.cpuTime;
+  task.guest.reset();
+}
+
+auto Batch::runQuantum(Task& task) -> bool {
+  task.job->quanta++;
+
+  // Programs are only assembled once a worker gets to them
+  if (task.guest == nullptr) {
+    task.guest = std::make_unique<Guest>();
+    Guest& guest = *task.guest;
+    guest.start = std::chrono::steady_clock::now();
+    guest.cpu.io.sink = &guest.output;
+    guest.engine.interpreter = this->interpreter;
+    guest.engine.maxInstructions = this->maxInstructions;
+
+    try {
+      guest.cpu.io.setInput(task.job->input.empty() ? std::string{} : readFile(task.job->input));
+
+      guest.engine.loadFile(task.job->program, this->cache);
+    } catch (const std::exception& e) {
+      guest.cpu.io.flush();
+      guest.output << e.what();
+      this->finish(task, BatchJob::Status::ERROR);
+      return true;
+    }
+  }
+
+  Guest& guest = *task.guest;
+  try {
+    Status status = guest.engine.run(this->quantum);
+    if (status == Status::PAUSED)
+      return false;
+
+    this->finish(task, status == Status::HALTED ? BatchJob::Status::OK : BatchJob::Status::TIMEOUT);
+  } catch (const std::exception& e) {
+    guest.output << e.what();
+    this->finish(task, BatchJob::Status::ERROR);
+  }
+  return true;
+}
+
+auto Batch::run() -> void {
+  auto start = std::chrono::steady_clock::now();
+
+  unsigned count = std::max(this->threads, 1u);
+  std::vector<Queue> queues(count);
+  for (size_t i = 0; i < this->jobs.size(); i++) {
+    queues[i % count].tasks.push_back(Task{&this->jobs[i], nullptr});
+  }
+
+  std::atomic<size_t> pending{this->jobs.size()};
+  std::atomic<u64> steals{0};
+
+  auto worker = [&](unsigned self) {
+    Queue& own = queues[self];
+
+    while (pending.load() != 0) {
+      std::optional<Task> task;
+      {
+        std::scoped_lock guard{own.lock};
+        if (!own.tasks.empty()) {
+          task = std::move(own.tasks.front());
+          own.tasks.pop_front();
+        }
+      }
+
+      for (unsigned i = 1; i < count && !task; i++) {
+        Queue& victim = queues[(self + i) % count];
+        std::scoped_lock guard{victim.lock};
+        if (!victim.tasks.empty()) {
+          task = std::move(victim.tasks.back());
+          victim.tasks.pop_back();
+          steals++;
+        }
+      }
+
+      // Everything left is running on other workers
+      if (!task) {
+        std::this_thread::sleep_for(std::chrono::microseconds(50));
+        continue;
+      }
+
+      if (this->runQuantum(*task)) {
+        pending--;
+      } else {
+        std::scoped_lock guard{own.lock};
+        own.tasks.push_back(std::move(*task));
+      }
+    }
+  };
+
+  {
+    std::vector<std::jthread> workers;
+    for (unsigned i = 0; i < count; i++) {
+      workers.emplace_back(worker, i);
+    }
+  }
+
+  this->wallTime = std::chrono::steady_clock::now() - start;
+  this->steals = steals;
+}
+
+auto Batch::report(std::ostream& out) -> void {
+  u64 retired = 0;
+  std::array<u64, 3> statuses{};
+
+  for (const BatchJob& job : this->jobs) {
+    out << std::format("==> {} <== {}, {} instructions, {:.3f} ms, {:.3f} ms cpu, {} quanta\n", job.program,
+                       statusName(job.status), job.retired,
+                       std::chrono::duration<double, std::milli>(job.time).count(),
+                       std::chrono::duration<double, std::milli>(job.cpuTime).count(), job.quanta);
+    out << job.output;
+    if (!job.output.empty() && !job.output.ends_with('\n'))
+      out << '\n';
+
+    retired += job.retired;
+    statuses[size_t(job.status)]++;
+  }
+  out.flush();
+
+  double seconds = std::chrono::duration<double>(this->wallTime).count();
+  std::cerr << std::format("{} programs: {} ok, {} errors, {} timeouts\n", this->jobs.size(),
+                           statuses[size_t(BatchJob::Status::OK)], statuses[size_t(BatchJob::Status::ERROR)],
+                           statuses[size_t(BatchJob::Status::TIMEOUT)]);
+  std::cerr << std::format("{} instructions in {:.3f} s on {} threads ({:.2f} MIPS), {} steals\n", retired,
+                           seconds, this->threads, seconds > 0 ? retired / seconds / 1e6 : 0.0, this->steals);
+}
+
+} // namespace Emulator
@@ -0,0 +1,85 @@
+#pragma once
+
+#include "Engine.hpp"
+
+#include <chrono>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <sstream>
+
+namespace Emulator {
+
+// A program of a batch and what came out of running it
+struct BatchJob {
+  enum class Status { OK, ERROR, TIMEOUT };
+
+  std::string program;
+  std::string input; // File fed to read syscalls, none when empty
+
+  Status status = Status::OK;
+  std::string output; // Everything the program printed, then the error if it failed
+  u64 retired = 0;
+  u64 quanta = 0;                    // Times it was scheduled
+  std::chrono::nanoseconds time{};    // From its first quantum to its end
+  std::chrono::nanoseconds cpuTime{}; // Spent running it
+};
+
+// Runs many programs at once on a pool of threads. Every program gets its
+// own Tokenizer, CPU and Engine, reads its input from a file and has its
+// output collected in memory, so nothing is shared between workers.
+// Programs run for a quantum of instructions at a time and then go back
+// to the queue of their worker, a worker whose queue is empty steals from
+// the others, so a long program can't hold back the ones behind it
+class Batch {
+public:
+  std::vector<BatchJob> jobs;
+  Interpreter interpreter = Interpreter::DECODED;
+  u64 maxInstructions = std::numeric_limits<u64>::max();
+  u64 quantum = 1'000'000;
+  unsigned threads = 1;
+  bool cache = false;
+
+  // Reads a list with one "program.asm [input]" per line, blank lines and
+  // lines starting with '#' are skipped
+  static auto load(const std::string& list) -> std::vector<BatchJob>;
+
+  // Runs every job
+  auto run() -> void;
+
+  // Prints the output of every job in list order, then a summary to std::cerr
+  auto report(std::ostream& out) -> void;
+
+private:
+  // A job being run, created the first time it is scheduled
+  struct Guest {
+    std::ostringstream output; // Outlives cpu, which flushes into it
+    Tokenizer tokenizer;
+    CPU cpu;
+    Engine engine{tokenizer, cpu};
+    std::chrono::steady_clock::time_point start;
+  };
+
+  struct Task {
+    BatchJob* job;
+    std::unique_ptr<Guest> guest;
+  };
+
+  // Tasks of a worker. The owner takes from the front and puts paused
+  // tasks at the back, thieves take from the back
+  struct Queue {
+    std::mutex lock;
+    std::deque<Task> tasks;
+  };
+
+  std::chrono::nanoseconds wallTime{};
+  u64 steals = 0;
+
+  // Runs task for a quantum, returns true once its job is done
+  auto runQuantum(Task& task) -> bool;
+
+  // Stops the job of task, keeping what it printed
+  auto finish(Task& task, BatchJob::Status status) -> void;
+};
+
+} // namespace Emulator
@@ -0,0 +1,188 @@
+#include "BlockCache.hpp"
+#include "Jit.hpp"
+
+namespace Emulator {
+
+// Instructions that end a block
+static auto isTerminator(Op kind) -> bool {
+  switch (kind) {
+    case Op::BEQ:
+    case Op::BNE:
+    case Op::BLT:
+    case Op::BGE:
+    case Op::J:
+    case Op::JAL:
+    case Op::JR:
+    case Op::JALR:
+    case Op::DBEQ:
+    case Op::DBNE:
+    case Op::DBLT:
+    case Op::DBGE:
+    case Op::DJ:
+    case Op::DJAL:
+    case Op::DJR:
+    case Op::SYSCALL:
+    case Op::UNKNOWN:
+      return true;
+
+    default:
+      return false;
+  }
+}
+
+auto BlockCache::flush(CPU& cpu) -> void {
+  this->blocks.clear();
+  this->entries.assign(cpu.decoded.size(), nullptr);
+  this->generation = cpu.textGeneration;
+
+  // Compiled code refers to the blocks that were just dropped
+  if (this->jit != nullptr) {
+    this->jit->reset();
+  }
+}
+
+auto BlockCache::translate(CPU& cpu, u32 index) -> Block* {
+  Block& block = this->blocks.emplace_back();
+  block.start = cpu.textStart + index * 4;
+  block.hasTakenPc = false;
+  block.writesMemory = false;
+  block.taken = nullptr;
+  block.fallthrough = nullptr;
+  block.executions = 0;
+  block.native = nullptr;
+
+  for (u32 i = index; i < cpu.decoded.size(); i++) {
+    DecodedOp& op = cpu.decoded[i];
+    if (op.handler == nullptr) {
+      u32 address = cpu.textStart + i * 4;
+      op = Decoder::decode(cpu.memory.readWord(address), address, cpu.encoding);
+    }
+
+    block.ops.push_back(op);
+    block.writesMemory |= op.kind == Op::SB || op.kind == Op::SH || op.kind == Op::SW || op.kind == Op::SC;
+
+    if (isTerminator(op.kind)) {
+      block.hasTakenPc = op.kind != Op::JR && op.kind != Op::DJR && op.kind != Op::JALR && op.kind != Op::SYSCALL &&
+                         op.kind != Op::UNKNOWN;
+      block.takenPc = op.target;
+      break;
+    }
+  }
+
+  // A delay slot runs with its branch, the block goes on after it
+  block.fallthroughPc = block.start + static_cast<u32>(block.ops.size()) * 4;
+  if (isDelayed(block.ops.back().kind))
+    block.fallthroughPc += 4;
+  this->stats.translated++;
+  this->entries[index] = &block;
+  return &block;
+}
+
+auto BlockCache::lookup(CPU& cpu) -> Block* {
+  u32 offset = cpu.pc - cpu.textStart;
+  u32 index = offset >> 2;
+  if ((offset & 3) != 0 || index >= this->entries.size())
+    return nullptr;
+
+  this->stats.lookups++;
+  Block* block = this->entries[index];
+  return block != nullptr ? block : this->translate(cpu, index);
+}
+
+auto BlockCache::next(CPU& cpu, Block* block) -> Block* {
+  Block** link;
+  if (cpu.pc == block->fallthroughPc)
+    link = &block->fallthrough;
+  else if (block->hasTakenPc && cpu.pc == block->takenPc)
+    link = &block->taken;
+  else
+    return this->lookup(cpu); // jr or jalr, the destination is only known now
+
+  if (*link != nullptr) {
+    this->stats.chainHits++;
+    return *link;
+  }
+
+  *link = this->lookup(cpu);
+  return *link;
+}
+
+auto BlockCache::run(CPU& cpu, u64 limit) -> void {
+  if (this->generation != cpu.textGeneration || this->entries.size() != cpu.decoded.size())
+    this->flush(cpu);
+
+  if (cpu.retired >= limit)
+    return;
+
+  Block* block = this->lookup(cpu);
+
+  while (true) {
+    if (block == nullptr) {
+      // Outside the text segment, one instruction at a time
+      cpu.fetchInstruction();
+      cpu.retired++;
+      if (cpu.hasHalted() || cpu.retired >= limit)
+        return;
+
+      block = this->lookup(cpu);
+      continue;
+    }
+
+    if (this->jit != nullptr && block->native == nullptr && ++block->executions == Jit::HOT_THRESHOLD) {
+      this->jit->compile(*block);
+      this->stats.compiled += block->native != nullptr;
+    }
+
+    // A block that doesn't fit in what is left of the limit runs as far as it can
+    u64 remaining = limit - cpu.retired;
+    size_t count = std::min<u64>(block->ops.size(), remaining);
+
+    if (block->native != nullptr && count == block->ops.size()) {
+      s64 fuel = static_cast<s64>(std::min<u64>(remaining, std::numeric_limits<s64>::max()));
+      s64 given = fuel;
+      this->stats.nativeRuns++;
+      cpu.pc = block->native(cpu.registers.data(), &cpu, &fuel);
+      cpu.retired += given - fuel;
+      this->jit->rethrowPending();
+    } else if (!block->writesMemory) {
+      for (size_t i = 0; i < count; i++) {
+        block->ops[i].handler(cpu, block->ops[i]);
+        cpu.retired++;
+      }
+    } else {
+      // A store into the text segment leaves the rest of the block stale
+      for (size_t i = 0; i < count; i++) {
+        block->ops[i].handler(cpu, block->ops[i]);
+        cpu.retired++;
+        if (cpu.textGeneration != this->generation)
+          break;
+      }
+    }
+
+    // Only syscalls halt and they always end a block
+    if (cpu.hasHalted() || cpu.retired >= limit)
+      return;
+
+    if (cpu.textGeneration != this->generation) {
+      this->stats.invalidations++;
+      this->flush(cpu);
+      block = this->lookup(cpu);
+      continue;
+    }
+
+    block = this->next(cpu, block);
+  }
+}
+
+auto BlockCache::printStats() -> void {
+  std::cerr << std::format("blocks translated: {}\n", this->stats.translated);
+  std::cerr << std::format("chain hits:        {}\n", this->stats.chainHits);
+  std::cerr << std::format("lookups:           {}\n", this->stats.lookups);
+  std::cerr << std::format("invalidations:     {}\n", this->stats.invalidations);
+  if (this->jit != nullptr) {
+    std::cerr << std::format("blocks compiled:   {}\n", this->stats.compiled);
+    std::cerr << std::format("native runs:       {}\n", this->stats.nativeRuns);
+  }
+}
+
+} // namespace Emulator
@@ -0,0 +1,72 @@
+#pragma once
+
+#include "CPU.hpp"
+
+#include <deque>
+
+namespace Emulator {
+
+class Jit;
+
+// Host code for a block (and whatever it is chained to), returns the pc
+// the guest continues from. fuel is how many instructions it may still
+// retire, it is decreased by those it did
+using NativeBlock = auto (*)(u32* registers, CPU* cpu, s64* fuel) -> u32;
+
+// A straight run of instructions ending at a branch, jump or syscall,
+// translated once from the decoded cache and then executed as a unit
+struct Block {
+  u32 start;
+  u32 fallthroughPc; // pc right after the last instruction
+  u32 takenPc;       // Static destination of the last instruction
+  bool hasTakenPc;
+  bool writesMemory; // Has a store, which may rewrite the text segment
+  Block* taken;      // Chained successors, linked the first time each exit is used
+  Block* fallthrough;
+  std::vector<DecodedOp> ops;
+  u64 executions;
+  NativeBlock native;
+};
+
+class BlockCache {
+public:
+  struct Stats {
+    u64 translated = 0;
+    u64 chainHits = 0;
+    u64 lookups = 0;
+    u64 invalidations = 0;
+    u64 compiled = 0;
+    u64 nativeRuns = 0;
+  };
+
+  Stats stats;
+
+  // Compiles hot blocks to host code when set
+  Jit* jit = nullptr;
+
+  // Runs until the program halts or has retired limit instructions, blocks
+  // are kept between calls as long as the text segment doesn't change
+  auto run(CPU& cpu, u64 limit) -> void;
+
+  // Prints the cache statistics
+  auto printStats() -> void;
+
+private:
+  std::deque<Block> blocks;
+  std::vector<Block*> entries; // Block starting at each text word, if any
+  u64 generation = 0;
+
+  // Finds or translates the block starting at pc, nullptr if pc is outside the text segment
+  auto lookup(CPU& cpu) -> Block*;
+
+  // Builds the block starting at the index-th text word
+  auto translate(CPU& cpu, u32 index) -> Block*;
+
+  // Throws away every block, the text segment changed
+  auto flush(CPU& cpu) -> void;
+
+  // Follows the exit taken by block, linking it to its successor the first time
+  auto next(CPU& cpu, Block* block) -> Block*;
+};
+
+} // namespace Emulator
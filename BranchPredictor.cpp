@@ -0,0 +1,84 @@
+#include "BranchPredictor.hpp"
+#include "Profiler.hpp"
+
+#include <algorithm>
+#include <numeric>
+
+namespace Emulator {
+
+static constexpr size_t HOT_SPOTS = 20;
+
+static auto percent(u64 part, u64 total) -> double {
+  return total == 0 ? 0.0 : 100.0 * double(part) / double(total);
+}
+
+template <typename... Predictors>
+auto BranchPredictors<Predictors...>::report(const Tokenizer& tokenizer, std::ostream& out) -> void {
+  std::array<std::string_view, PREDICTORS> names{Predictors::name...};
+
+  out << std::format("branches: {} conditional, {:.2f}% taken\n", this->branches, percent(this->taken, this->branches));
+  for (size_t i = 0; i < PREDICTORS; i++) {
+    out << std::format("  {:<12} {:>14} misses, {:>6.2f}% mispredicted\n", names[i], this->misses[i],
+                       percent(this->misses[i], this->branches));
+  }
+  out << std::format("returns: {}\n", this->returned);
+  out << std::format("  {:<12} {:>14} misses, {:>6.2f}% mispredicted\n", "return stack", this->returnMisses,
+                     percent(this->returnMisses, this->returned));
+
+  auto labels = Profiler::textLabels(tokenizer, this->textStart, this->textStart + u64(this->counts.size()) * 4);
+
+  // Sorted by the mispredictions of the best predictor, what no predictor gets right comes first
+  auto best = [this](u32 index) {
+    if (this->kinds[index] == Op::JR)
+      return this->missCounts[index][0];
+    return *std::min_element(this->missCounts[index].begin(), this->missCounts[index].end());
+  };
+
+  std::vector<u32> indexes(this->counts.size());
+  std::iota(indexes.begin(), indexes.end(), 0);
+  std::erase_if(indexes, [this](u32 index) { return this->kinds[index] == Op::UNKNOWN; });
+  std::stable_sort(indexes.begin(), indexes.end(), [&](u32 a, u32 b) { return best(a) > best(b); });
+
+  // Branches
+  out << std::format("\n{:>14} {:>7}", "count", "taken%");
+  for (std::string_view name : names) {
+    out << std::format(" {:>8}", name);
+  }
+  out << std::format("  {:<10}  {:<24} {}\n", "pc", "location", "instruction");
+
+  size_t printed = 0;
+  for (u32 index : indexes) {
+    if (this->kinds[index] == Op::JR)
+      continue;
+    if (printed++ == HOT_SPOTS)
+      break;
+
+    u32 pc = this->textStart + index * 4;
+    out << std::format("{:>14} {:>6.2f}%", this->counts[index], percent(this->takenCounts[index], this->counts[index]));
+    for (u64 misses : this->missCounts[index]) {
+      out << std::format(" {:>7.2f}%", percent(misses, this->counts[index]));
+    }
+    out << std::format("  0x{:08x}  {:<24} {}\n", pc, Profiler::locate(labels, pc), Decoder::name(this->kinds[index]));
+  }
+
+  // Returns, the stack only misses once it overflowed or for a return that didn't go to its caller
+  out << std::format("\n{:>14} {:>14} {:>7}  {:<10}  {:<24} {}\n", "count", "misses", "miss%", "pc", "location",
+                     "instruction");
+  printed = 0;
+  for (u32 index : indexes) {
+    if (this->kinds[index] != Op::JR)
+      continue;
+    if (printed++ == HOT_SPOTS)
+      break;
+
+    u32 pc = this->textStart + index * 4;
+    u64 misses = this->missCounts[index][0];
+    out << std::format("{:>14} {:>14} {:>6.2f}%  0x{:08x}  {:<24} {}\n", this->counts[index], misses,
+                       percent(misses, this->counts[index]), pc, Profiler::locate(labels, pc),
+                       Decoder::name(this->kinds[index]));
+  }
+}
+
+template class BranchPredictors<StaticPredictor, BimodalPredictor<>, GsharePredictor<>>;
+
+} // namespace Emulator
@@ -0,0 +1,204 @@
+#pragma once
+
+#include "Core.hpp"
+#include "Tokenizer.hpp"
+
+#include <optional>
+#include <utility>
+
+namespace Emulator {
+
+// A predictor of conditional branches is a policy with
+//   static constexpr std::string_view name;
+//   auto predict(u32 pc, u32 target) const -> bool;  // Whether it's taken
+//   auto update(u32 pc, u32 target, bool taken) -> void;
+// BranchPredictors runs any number of them side by side, each one only
+// costs its own predict() and update()
+
+// Saturating 2 bit counter, taken from 2 up
+inline auto train(u8& counter, bool taken) -> void {
+  if (taken && counter < 3)
+    counter++;
+  else if (!taken && counter > 0)
+    counter--;
+}
+
+// Backward branches (loops) taken, forward ones not taken
+struct StaticPredictor {
+  static constexpr std::string_view name = "static";
+
+  auto predict(u32 pc, u32 target) const -> bool { return target <= pc; }
+  auto update(u32, u32, bool) -> void {}
+};
+
+// A 2 bit counter per pc, 2^BITS of them
+template <u32 BITS = 12>
+struct BimodalPredictor {
+  static constexpr std::string_view name = "bimodal";
+
+  // Start strongly not taken
+  std::array<u8, size_t(1) << BITS> counters{};
+
+  auto predict(u32 pc, u32) const -> bool { return this->counters[slot(pc)] >= 2; }
+  auto update(u32 pc, u32, bool taken) -> void { train(this->counters[slot(pc)], taken); }
+
+  static auto slot(u32 pc) -> size_t { return (pc >> 2) & ((size_t(1) << BITS) - 1); }
+};
+
+// 2 bit counters indexed by the pc xored with the outcome of the last BITS branches
+template <u32 BITS = 12>
+struct GsharePredictor {
+  static constexpr std::string_view name = "gshare";
+
+  std::array<u8, size_t(1) << BITS> counters{};
+  u32 history = 0;
+
+  auto predict(u32 pc, u32) const -> bool { return this->counters[this->slot(pc)] >= 2; }
+
+  auto update(u32 pc, u32, bool taken) -> void {
+    train(this->counters[this->slot(pc)], taken);
+    this->history = ((this->history << 1) | taken) & ((u32(1) << BITS) - 1);
+  }
+
+  auto slot(u32 pc) const -> size_t { return ((pc >> 2) ^ this->history) & ((size_t(1) << BITS) - 1); }
+};
+
+// Return addresses pushed by jal and popped by jr $ra. Once full the oldest
+// entry is overwritten, like a hardware stack of DEPTH entries
+template <u32 DEPTH = 16>
+struct ReturnStack {
+  std::array<u32, DEPTH> addresses{};
+  u32 top = 0;   // Next slot, modulo DEPTH
+  u32 valid = 0; // Entries that can be popped
+
+  auto push(u32 address) -> void {
+    this->addresses[this->top++ % DEPTH] = address;
+    this->valid = std::min(this->valid + 1, DEPTH);
+  }
+
+  // Predicted return address, nothing when the stack is empty
+  auto pop() -> std::optional<u32> {
+    if (this->valid == 0)
+      return std::nullopt;
+    this->valid--;
+    return this->addresses[--this->top % DEPTH];
+  }
+};
+
+// Feeds every conditional branch retired by runCore() to each of
+// Predictors and every jal and jr $ra to a return stack, counting the
+// mispredictions of each per instruction of the text segment
+template <typename... Predictors>
+class BranchPredictors {
+public:
+  static constexpr size_t PREDICTORS = sizeof...(Predictors);
+  static_assert(PREDICTORS > 0, "BranchPredictors needs a predictor");
+
+  // Clears the predictors and counters and sizes them for the text segment of cpu
+  auto reset(const CPU& cpu) -> void {
+    this->predictors = {};
+    this->returns = {};
+    this->branches = this->taken = this->returned = this->returnMisses = 0;
+    this->misses.fill(0);
+
+    this->textStart = cpu.textStart;
+    this->counts.assign(cpu.decoded.size(), 0);
+    this->takenCounts.assign(cpu.decoded.size(), 0);
+    this->missCounts.assign(cpu.decoded.size(), {});
+    this->kinds.assign(cpu.decoded.size(), Op::UNKNOWN);
+  }
+
+  // Asks every predictor about a branch before telling it the outcome
+  auto retire(const Retired& instruction) -> void {
+    const DecodedOp& op = instruction.op;
+    u32 index = instruction.index;
+    bool inside = index != Retired::OUTSIDE;
+
+    switch (op.kind) {
+      case Op::BEQ: case Op::BNE: case Op::BLT: case Op::BGE:
+      case Op::DBEQ: case Op::DBNE: case Op::DBLT: case Op::DBGE: {
+        bool taken = instruction.taken();
+        this->branches++;
+        this->taken += taken;
+
+        std::array<bool, PREDICTORS> wrong;
+        [&]<size_t... I>(std::index_sequence<I...>) {
+          ((wrong[I] = std::get<I>(this->predictors).predict(instruction.pc, op.target) != taken,
+            std::get<I>(this->predictors).update(instruction.pc, op.target, taken)), ...);
+        }(std::index_sequence_for<Predictors...>{});
+
+        for (size_t i = 0; i < PREDICTORS; i++) {
+          this->misses[i] += wrong[i];
+        }
+        if (inside) {
+          this->counts[index]++;
+          this->takenCounts[index] += taken;
+          for (size_t i = 0; i < PREDICTORS; i++) {
+            this->missCounts[index][i] += wrong[i];
+          }
+        }
+        break;
+      }
+
+      case Op::JAL:
+        this->returns.push(instruction.pc + 4);
+        return;
+
+      // Calls with a delay slot come back after it
+      case Op::DJAL:
+      case Op::JALR:
+        this->returns.push(instruction.pc + 8);
+        return;
+
+      case Op::JR: case Op::DJR: {
+        if (op.rs != RA)
+          return;
+
+        bool wrong = this->returns.pop() != instruction.next;
+        this->returned++;
+        this->returnMisses += wrong;
+        if (inside) {
+          this->counts[index]++;
+          this->missCounts[index][0] += wrong;
+        }
+        break;
+      }
+
+      default:
+        return;
+    }
+
+    // The report only tells returns from branches
+    if (inside)
+      this->kinds[index] = op.kind == Op::DJR ? Op::JR : op.kind;
+  }
+
+  // Prints the misprediction rate of every predictor and of the return
+  // stack, then the branches and returns mispredicted the most
+  auto report(const Tokenizer& tokenizer, std::ostream& out) -> void;
+
+private:
+  static constexpr u8 RA = 31;
+
+  std::tuple<Predictors...> predictors;
+  ReturnStack<> returns;
+
+  // Conditional branches and returns retired so far
+  u64 branches = 0;
+  u64 taken = 0;
+  std::array<u64, PREDICTORS> misses{};
+  u64 returned = 0;
+  u64 returnMisses = 0;
+
+  // Per instruction of the text segment, a return only uses the first miss counter
+  std::vector<u64> counts;
+  std::vector<u64> takenCounts;
+  std::vector<std::array<u64, PREDICTORS>> missCounts;
+  std::vector<Op> kinds;
+  u32 textStart = 0;
+};
+
+// What --branches simulates, add a policy here to have it run with the others
+using BranchModel = BranchPredictors<StaticPredictor, BimodalPredictor<>, GsharePredictor<>>;
+
+} // namespace Emulator
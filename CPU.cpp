@@ -1,25 +1,49 @@
 #include "CPU.hpp"
+#include "Harts.hpp"
 
 #include <bitset>
+#include <cstring>
 
 namespace Emulator {
 
-CPU::CPU() {
+CPU::CPU() : CPU(std::make_shared<Memory>()) {}
+
+CPU::CPU(std::shared_ptr<Memory> memory) : sharedMemory{std::move(memory)}, memory{*this->sharedMemory} {
   this->max_size = std::numeric_limits<uint32_t>::max();
-  this->mem = new u8[this->max_size];
   this->pc = 0;
   this->registers.fill(0);
   this->registers[29] = this->max_size;
+  this->hi = 0;
+  this->lo = 0;
+  this->encoding = Encoding::ASSEMBLER;
   this->halt = false;
+  this->retired = 0;
+  this->textStart = 0;
+  this->textEnd = 0;
+  this->textGeneration = 0;
+  this->harts = nullptr;
+  this->hartId = 0;
+  this->linked = false;
+  this->linkAddress = 0;
+  this->linkReservation = 0;
 }
 
 auto CPU::hasHalted() -> bool { 
   return this->halt;
 }
 
+auto CPU::waitsForInput() -> bool {
+  // opcode 0 and funct 0x0C, whatever the code field holds
+  if ((this->memory.readWord(this->pc) & 0xFC00003F) != 0x0C)
+    return false;
+
+  u32 code = this->registers[2];
+  return code == 5 || code == 8 || code == 12; // read_int, read_string, read_char
+}
+
 auto CPU::loadProgram(const std::span<u8> program) -> void {
   if (size(program) > this->max_size - 1) {
-    std::cout << std::format("Program is too large to fit in memory\n");
+    this->io.writeString(std::format("Program is too large to fit in memory\n"));
     return;
   }
 
@@ -28,24 +52,101 @@ auto CPU::loadProgram(const std::span<u8> program) -> void {
 
 auto CPU::readMemory(u64 address) -> u8 {
   if (address > this->max_size) {
-    std::cout << std::format("ERROR! Address {} is bigger than 32 bits addres space\n", address);
+    this->io.writeString(std::format("ERROR! Address {} is bigger than 32 bits addres space\n", address));
     return 0;
   }
 
-  return this->mem[address];
+  return this->memory.read(address);
 }
 
-auto CPU::readMemoryBlock(u64 address, u32 size) -> u8* {
-  u64 end = address + size - 1;
+auto CPU::readMemoryBlock(u64 address, std::span<u8> out) -> void {
+  u64 end = address + out.size() - 1;
   if (end > this->max_size - 1) {
-    std::cout << std::format("ERROR! Address {} is bigger than 32 bits addres space\n", end);
-    return nullptr;
+    throw std::runtime_error(
+      std::format("ERROR! Address {} is bigger than 32 bits addres space\n", end)
+    );
+  }
+
+  this->memory.readBlock(address, out);
+}
+
+auto CPU::readHalf(u64 address) -> u16 {
+  if (address + 1 > this->max_size - 1) {
+    throw std::runtime_error(
+      std::format("ERROR! Address {} is bigger than 32 bits addres space\n", address + 1)
+    );
+  }
+
+  return this->memory.readHalf(address);
+}
+
+auto CPU::readWord(u64 address) -> u32 {
+  if (address + 3 > this->max_size - 1) {
+    throw std::runtime_error(
+      std::format("ERROR! Address {} is bigger than 32 bits addres space\n", address + 3)
+    );
+  }
+
+  return this->memory.readWord(address);
+}
+
+auto CPU::writeHalf(u64 address, u16 value) -> void {
+  if (address + 1 > this->max_size - 1) {
+    throw std::runtime_error(
+      std::format("ERROR! Address {} is bigger than 32 bits addres space\n", address + 1)
+    );
   }
 
-  u8* block = new u8[size];
-  std::memcpy(block, this->mem + address, size);
+  this->memory.write(address, static_cast<u8>(value));
+  this->memory.write(address + 1, static_cast<u8>(value >> 8));
+  this->invalidateDecoded(address, 2);
+}
 
-  return block;
+auto CPU::writeWord(u64 address, u32 value) -> void {
+  if (address + 3 > this->max_size - 1) {
+    throw std::runtime_error(
+      std::format("ERROR! Address {} is bigger than 32 bits addres space\n", address + 3)
+    );
+  }
+
+  this->memory.writeWord(address, value);
+  this->invalidateDecoded(address, 4);
+}
+
+// ll and sc go through host atomics, which need the word aligned
+static auto checkAtomic(u64 address, u32 max_size) -> void {
+  if (address + 3 > max_size - 1) {
+    throw std::runtime_error(
+      std::format("ERROR! Address {} is bigger than 32 bits addres space\n", address + 3)
+    );
+  }
+
+  if (address % 4 != 0) {
+    throw std::runtime_error(std::format("ERROR! Address {} of ll/sc isn't word aligned\n", address));
+  }
+}
+
+auto CPU::loadLinked(u64 address) -> u32 {
+  checkAtomic(address, this->max_size);
+
+  u32 value = this->memory.loadLinked(address, this->linkReservation);
+  this->linked = true;
+  this->linkAddress = address;
+  return value;
+}
+
+auto CPU::storeConditional(u64 address, u32 value) -> u32 {
+  checkAtomic(address, this->max_size);
+
+  bool stored = false;
+  if (this->linked && this->linkAddress == address) {
+    stored = this->memory.storeConditional(address, value, this->linkReservation);
+  }
+  this->linked = false;
+
+  if (stored)
+    this->invalidateDecoded(address, 4);
+  return stored ? 1 : 0;
 }
 
 auto CPU::writeMemory(u64 address, u8 value) -> void {
@@ -54,7 +155,8 @@ auto CPU::writeMemory(u64 address, u8 value) -> void {
       std::format("ERROR! Address {} is bigger than 32 bits addres space\n", address)
     );
   }
-  this->mem[address] = value;
+  this->memory.write(address, value);
+  this->invalidateDecoded(address, 1);
 }
 
 auto CPU::writeMemoryBlock(u64 address, const std::span<u8> value) -> void {
@@ -65,10 +167,8 @@ auto CPU::writeMemoryBlock(u64 address, const std::span<u8> value) -> void {
     );
   }
 
-  for (const auto &content : value) {
-    this->mem[address] = content;
-    address++;
-  }
+  this->memory.writeBlock(address, value);
+  this->invalidateDecoded(address, value.size());
 }
 
 auto CPU::writeRegister(u32 index, s32 value) -> void {
@@ -83,11 +183,51 @@ auto CPU::readRegister(u32 index) -> u32 {
 }
 
 auto CPU::fetchInstruction() -> void {
-  auto value{this->readMemoryBlock(this->pc, 4)};
+  // Single bounds check, then the word is read straight from its page
+  if (this->pc > this->max_size - 4) {
+    throw std::runtime_error(
+      std::format("ERROR! Address {} is bigger than 32 bits addres space\n", this->pc)
+    );
+  }
+
+  this->execute(this->memory.readWord(this->pc));
+}
+
+auto CPU::step() -> void {
+  u32 offset = this->pc - this->textStart;
+  u32 index = offset >> 2;
 
-  u32 instruction{u32((value[0] <<  0)) | u32((value[1] <<  8)) |
-                  u32((value[2] << 16)) | u32((value[3] << 24))};
-  this->execute(instruction);
+  // Anything outside the text segment goes through the regular path
+  if ((offset & 3) != 0 || index >= this->decoded.size()) {
+    this->fetchInstruction();
+    return;
+  }
+
+  DecodedOp& op = this->decoded[index];
+  if (op.handler == nullptr) {
+    op = Decoder::decode(this->memory.readWord(this->pc), this->pc, this->encoding);
+  }
+  op.handler(*this, op);
+}
+
+auto CPU::setTextSegment(u32 start, u32 end) -> void {
+  this->textStart = start;
+  this->textEnd = std::max(start, end);
+  this->decoded.assign((this->textEnd - this->textStart + 3) / 4, DecodedOp{});
+  this->textGeneration++;
+}
+
+auto CPU::invalidateDecoded(u64 address, u64 size) -> void {
+  // Self-modifying code, the stored words have to be decoded again
+  if (address >= this->textEnd || address + size <= this->textStart)
+    return;
+
+  u64 first = (std::max<u64>(address, this->textStart) - this->textStart) >> 2;
+  u64 last = (std::min<u64>(address + size, this->textEnd) - 1 - this->textStart) >> 2;
+  for (u64 i = first; i <= last && i < this->decoded.size(); i++) {
+    this->decoded[i].handler = nullptr;
+  }
+  this->textGeneration++;
 }
 
 auto CPU::decodeImm(u32 instruction) -> Instruction {
@@ -141,7 +281,6 @@ auto CPU::executeImm(Instruction i) -> void {
   u32 rsContent = this->readRegister(i.rs);
   u32 rtContent = this->readRegister(i.rt);
   u32 valueToWrite;
-  u8 valueToStore[4];
   u8 byte;
 
   switch (i.opcode) {
@@ -194,22 +333,12 @@ auto CPU::executeImm(Instruction i) -> void {
       break;
 
     case 0x23: // lw
-      {
-        u32 valueToWrite = 0;
-        u32 address = rsContent + this->immExt(i.imm);
-        if (address >= this->max_size) {
-          throw std::runtime_error{std::format("ERROR! address is to big\n")};
-        }
-        valueToWrite |= static_cast<u8>(this->mem[address + 0]) <<  0; 
-        valueToWrite |= static_cast<u8>(this->mem[address + 1]) <<  8; 
-        valueToWrite |= static_cast<u8>(this->mem[address + 2]) << 16; 
-        valueToWrite |= static_cast<u8>(this->mem[address + 3]) << 24; 
-        this->writeRegister(i.rt, valueToWrite);
-      }
+      valueToWrite = this->readWord(u32(rsContent + this->immExt(i.imm)));
+      this->writeRegister(i.rt, valueToWrite);
       break;
     
     case 0x24: // lbu
-      valueToWrite = this->mem[rsContent + this->zeroExt(i.imm)];
+      valueToWrite = this->memory.read(u32(rsContent + this->zeroExt(i.imm)));
       this->writeRegister(i.rt, valueToWrite);
       break;
     
@@ -219,13 +348,17 @@ auto CPU::executeImm(Instruction i) -> void {
       break;
 
     case 0x2b: // sw
-      for (u8 i = 0; i < 4; i++) {
-        valueToStore[i] = static_cast<u8>((rtContent >> i * 8) & 0xFF);
-      }
-      this->writeMemoryBlock(
-        rsContent + this->immExt(i.imm),
-        std::span<u8>(valueToStore, 4)
-      );
+      this->writeWord(u32(rsContent + this->immExt(i.imm)), rtContent);
+      break;
+
+    case 0x30: // ll
+      valueToWrite = this->loadLinked(u32(rsContent + this->immExt(i.imm)));
+      this->writeRegister(i.rt, valueToWrite);
+      break;
+
+    case 0x38: // sc
+      valueToWrite = this->storeConditional(u32(rsContent + this->immExt(i.imm)), rtContent);
+      this->writeRegister(i.rt, valueToWrite);
       break;
 
   }
@@ -240,29 +373,33 @@ auto CPU::executeSyscall() -> void {
   switch (first_argument) {
     case 1: { // print_int
       second_argument = this->registers[4];
-      std::cout << static_cast<s32>(second_argument);
+      this->io.writeInt(static_cast<s32>(second_argument));
       return;
     }
 
     case 4: { // print_string
       second_argument = this->registers[4];
-      char* str = reinterpret_cast<char*>(this->mem + second_argument);
-      std::cout << str;
+      this->io.writeString(this->readString(second_argument));
       return;
     }
 
     case 5: { // read_int
-      int input_int;
-      std::cin >> input_int;
-      this->registers[2] = static_cast<u32>(input_int);
+      this->registers[2] = static_cast<u32>(this->io.readInt());
       return;
     }
 
     case 8: { // read_string
       second_argument = this->registers[4];
       third_argument = this->registers[5];
-      char* buffer = reinterpret_cast<char*>(this->mem + second_argument);
-      std::cin.getline(buffer, third_argument);
+      if (third_argument == 0)
+        return;
+
+      std::string buffer(third_argument, '\0');
+      this->io.readLine(std::span<char>(buffer.data(), third_argument));
+      this->writeMemoryBlock(
+        second_argument,
+        std::span<u8>(reinterpret_cast<u8*>(buffer.data()), std::strlen(buffer.data()) + 1)
+      );
       return;
     }
 
@@ -273,14 +410,12 @@ auto CPU::executeSyscall() -> void {
 
     case 11: { // print_char
       second_argument = this->registers[4];
-      std::cout << static_cast<char>(second_argument);
+      this->io.writeChar(static_cast<char>(second_argument));
       return;
     }
 
     case 12: { // read_char
-      char input_char;
-      std::cin >> input_char;
-      this->registers[2] = static_cast<u32>(input_char);
+      this->registers[2] = static_cast<u32>(this->io.readChar());
       return;
     }
 
@@ -290,6 +425,29 @@ auto CPU::executeSyscall() -> void {
       return;
     }
 
+    case 18: { // spawn_hart
+      second_argument = this->registers[4];
+      third_argument = this->registers[5];
+      u32 stack = this->registers[6]; // $a2
+      this->registers[2] = this->harts == nullptr ? Harts::NONE
+                                                  : this->harts->spawn(*this, second_argument, third_argument, stack);
+      return;
+    }
+
+    case 19: { // join_hart
+      second_argument = this->registers[4];
+      if (this->harts == nullptr) {
+        throw std::runtime_error{std::format("ERROR! There is no hart {}\n", second_argument)};
+      }
+      this->harts->join(*this, second_argument);
+      return;
+    }
+
+    case 20: { // hart_id
+      this->registers[2] = this->hartId;
+      return;
+    }
+
     default: {
       throw std::runtime_error{std::format("Wrong argument code in $v0: {}\n", first_argument)};
     }
@@ -353,6 +511,10 @@ auto CPU::executeR(Instruction i) -> void {
     this->writeRegister(i.rd, valueToWrite);
     break;
 
+  case 0x0F: // sync
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    break;
+
   case 0x0C: // Syscall
     this->executeSyscall();
     break;
@@ -361,6 +523,13 @@ auto CPU::executeR(Instruction i) -> void {
 }
 
 auto CPU::execute(u32 instruction) -> void {
+  // The switch below only knows the assembler's encoding
+  if (this->encoding == Encoding::MIPS32) {
+    DecodedOp op = Decoder::decode(instruction, this->pc, Encoding::MIPS32);
+    op.handler(*this, op);
+    return;
+  }
+
   u32 opcode = (instruction >> 26) & 0x3F;
   Instruction i;
   switch (opcode) {
@@ -381,6 +550,8 @@ auto CPU::execute(u32 instruction) -> void {
   case 0x24: // lb
   case 0x28: // sb
   case 0x2b: // sw
+  case 0x30: // ll
+  case 0x38: // sc
     i = this->decodeImm(instruction);
     this->executeImm(i);
     break;
@@ -392,17 +563,27 @@ auto CPU::execute(u32 instruction) -> void {
     break;
 
   default:
-    std::cout << std::bitset<32>(instruction) << " ";
-    std::cout << std::format("Not implemented yet\n");
+    this->io.writeString(std::format("{} Not implemented yet\n", std::bitset<32>(instruction).to_string()));
     break;
   }
 }
 
+auto CPU::readString(u64 address) -> std::string {
+  std::string str;
+  for (u8 c = this->readMemory(address); c != 0; c = this->readMemory(++address)) {
+    str.push_back(static_cast<char>(c));
+  }
+  return str;
+}
+
+auto CPU::committedPages() const -> u64 {
+  return this->memory.committedPages();
+}
+
 auto CPU::dumpMemory(size_t size) -> void {
   u64 address = 0;
   for (size_t i = 0; i < 100; i += 4) {
-     u32 instruction{u32((this->mem[i] <<  0)) | u32((this->mem[i + 1] <<  8)) |
-                  u32((this->mem[i + 2] << 16)) | u32((this->mem[i + 3] << 24))};
+    u32 instruction{this->memory.readWord(i)};
     std::cout << std::format("address {} -> ", address);
     std::cout << std::showbase << std::hex << instruction << '\n';
     address += 4;
@@ -2,9 +2,14 @@
 #define __CPU__
 
 #include "Config.hpp"
+#include "Memory.hpp"
+#include "Decoder.hpp"
+#include "GuestIO.hpp"
 
 namespace Emulator {
 
+class Harts;
+
 class CPU {
 public:
   // That is to easily move data across the functions
@@ -20,20 +25,68 @@ public:
   };
 
   std::array<u32, 32> registers;
-  u8* mem;
+
+  // Where mult and div leave their results, only MIPS32 programs have them
+  u32 hi;
+  u32 lo;
+
+  // How the words of the program are decoded, MIPS32 for ELF executables
+  Encoding encoding;
+
+  // Guest memory, shared with the harts spawned by the program
+  std::shared_ptr<Memory> sharedMemory;
+  Memory& memory;
+  GuestIO io;
   u32 max_size;
   u32 pc;
   bool halt;
 
+  // Instructions completed so far, an instruction that throws isn't counted
+  u64 retired;
+
+  // Pre-decoded text segment, indexed by (pc - textStart) >> 2
+  std::vector<DecodedOp> decoded;
+  u32 textStart;
+  u32 textEnd;
+
+  // Bumped every time the text segment is written, lets anything built
+  // on top of the decoded cache know it went stale
+  u64 textGeneration;
+
+  // Where the spawn_hart and join_hart syscalls go, without them spawn_hart
+  // returns -1. Hart 0 is the one the program started on
+  Harts* harts;
+  u32 hartId;
+
+  // Reservation taken by the last ll, sc only stores if it is still there
+  bool linked;
+  u32 linkAddress;
+  u32 linkReservation;
+
   CPU();
   ~CPU() = default;
 
+  // A hart running on memory shared with others
+  explicit CPU(std::shared_ptr<Memory> memory);
+
   // Reads next instruction and execute it
   auto fetchInstruction() -> void;
 
+  // Executes the instruction at pc using the decoded cache when possible
+  auto step() -> void;
+
+  // Sets up the decoded cache over [start, end)
+  auto setTextSegment(u32 start, u32 end) -> void;
+
+  // Drops decoded instructions overlapping [address, address + size)
+  auto invalidateDecoded(u64 address, u64 size) -> void;
+
   // Checks if program finished
   auto hasHalted() -> bool;
 
+  // Checks if the next instruction is a syscall reading input
+  auto waitsForInput() -> bool;
+
   // Extends immediate with signal
   constexpr inline auto immExt(s16 imm) -> s32;
 
@@ -76,8 +129,29 @@ public:
   // Reads 1 byte from memory
   auto readMemory(u64 address) -> u8;
 
-  // Reads "size" bytes from memory
-  auto readMemoryBlock(u64 address, u32 size) -> u8*;
+  // Reads "len(out)" bytes from memory
+  auto readMemoryBlock(u64 address, std::span<u8> out) -> void;
+
+  // Reads 2 bytes from memory
+  auto readHalf(u64 address) -> u16;
+
+  // Reads 4 bytes from memory
+  auto readWord(u64 address) -> u32;
+
+  // Writes 2 bytes to memory
+  auto writeHalf(u64 address, u16 value) -> void;
+
+  // Writes 4 bytes to memory
+  auto writeWord(u64 address, u32 value) -> void;
+
+  // ll, reads an aligned word and takes a reservation on it
+  auto loadLinked(u64 address) -> u32;
+
+  // sc, atomically stores value if nothing was stored to the line of
+  // address since loadLinked() and drops the reservation. Returns 1 when it
+  // stored and 0 otherwise. Stores of this hart only break it once other
+  // harts run
+  auto storeConditional(u64 address, u32 value) -> u32;
 
   // Writes 1 byte to memory
   auto writeMemory(u64 address, u8 value) -> void;
@@ -85,6 +159,12 @@ public:
   // Writes "len(value)" bytes to memory
   auto writeMemoryBlock(u64 address, const std::span<u8> value) -> void;
 
+  // Reads a null-terminated string from memory
+  auto readString(u64 address) -> std::string;
+
+  // Number of guest pages backed by host memory
+  auto committedPages() const -> u64;
+
   // Dumps the memory in hex format
   auto dumpMemory(size_t size) -> void;
 };
@@ -0,0 +1,265 @@
+#include "CacheModel.hpp"
+#include "Profiler.hpp"
+
+#include <algorithm>
+#include <bit>
+#include <charconv>
+
+namespace Emulator {
+
+static constexpr size_t HOT_SPOTS = 20;
+
+static auto percent(u64 part, u64 total) -> double {
+  return total == 0 ? 0.0 : 100.0 * double(part) / double(total);
+}
+
+static auto replacementName(Replacement replacement) -> std::string_view {
+  switch (replacement) {
+    case Replacement::LRU:    return "lru";
+    case Replacement::FIFO:   return "fifo";
+    case Replacement::RANDOM: return "random";
+  }
+  return "";
+}
+
+auto CacheConfig::parse(std::string_view settings) -> CacheConfig {
+  CacheConfig config;
+
+  while (!settings.empty()) {
+    std::string_view setting = settings.substr(0, settings.find(','));
+    settings.remove_prefix(std::min(setting.size() + 1, settings.size()));
+
+    if (setting == "lru" || setting == "fifo" || setting == "random") {
+      config.replacement = setting == "lru" ? Replacement::LRU : setting == "fifo" ? Replacement::FIFO : Replacement::RANDOM;
+      continue;
+    }
+    if (setting == "write-back" || setting == "write-through") {
+      config.writePolicy = setting == "write-back" ? WritePolicy::WRITE_BACK : WritePolicy::WRITE_THROUGH;
+      continue;
+    }
+
+    size_t equals = setting.find('=');
+    std::string_view name = setting.substr(0, equals);
+    std::string_view value = equals == std::string_view::npos ? std::string_view{} : setting.substr(equals + 1);
+
+    // Sizes can be given in KiB or MiB
+    u32 scale = 1;
+    if (value.ends_with('k') || value.ends_with('K'))
+      scale = 1 << 10;
+    else if (value.ends_with('m') || value.ends_with('M'))
+      scale = 1 << 20;
+    if (scale != 1)
+      value.remove_suffix(1);
+
+    u32 number = 0;
+    auto [end, error] = std::from_chars(value.data(), value.data() + value.size(), number);
+    if (value.empty() || error != std::errc{} || end != value.data() + value.size()) {
+      throw std::invalid_argument(std::format("ERROR! Invalid cache setting {}\n", setting));
+    }
+
+    if (name == "size")
+      config.size = number * scale;
+    else if (name == "ways")
+      config.associativity = number * scale;
+    else if (name == "line")
+      config.lineSize = number * scale;
+    else
+      throw std::invalid_argument(std::format("ERROR! Invalid cache setting {}\n", setting));
+  }
+
+  // Lets a bad geometry be reported with the other options
+  Cache{config};
+  return config;
+}
+
+Cache::Cache(const CacheConfig& config) : config{config} {
+  if (!std::has_single_bit(config.size) || !std::has_single_bit(config.associativity) ||
+      !std::has_single_bit(config.lineSize) || config.lineSize < 4 ||
+      u64(config.lineSize) * config.associativity > config.size) {
+    throw std::invalid_argument(std::format(
+      "ERROR! A cache of {} bytes can't have {} ways of {} bytes lines, they must be powers of two\n",
+      config.size, config.associativity, config.lineSize));
+  }
+
+  u32 sets = config.size / config.lineSize / config.associativity;
+  this->lineBits = std::countr_zero(config.lineSize);
+  this->setMask = sets - 1;
+  this->lines.assign(size_t(sets) * config.associativity, 0);
+  this->stamps.assign(this->lines.size(), 0);
+  this->dirty.assign(this->lines.size(), 0);
+}
+
+auto Cache::victim(u32 set) -> u32 {
+  size_t base = size_t(set) * this->config.associativity;
+  for (u32 way = 0; way < this->config.associativity; way++) {
+    if (this->lines[base + way] == 0)
+      return way;
+  }
+
+  if (this->config.replacement == Replacement::RANDOM) {
+    // xorshift64
+    this->seed ^= this->seed << 13;
+    this->seed ^= this->seed >> 7;
+    this->seed ^= this->seed << 17;
+    return this->seed & (this->config.associativity - 1);
+  }
+
+  // LRU and FIFO only differ in when the stamp is set
+  auto first = this->stamps.begin() + base;
+  return std::min_element(first, first + this->config.associativity) - first;
+}
+
+auto Cache::access(u32 address, bool write) -> bool {
+  u32 line = address >> this->lineBits;
+  u32 set = line & this->setMask;
+  size_t base = size_t(set) * this->config.associativity;
+  bool writeBack = this->config.writePolicy == WritePolicy::WRITE_BACK;
+  this->clock++;
+
+  for (u32 way = 0; way < this->config.associativity; way++) {
+    if (this->lines[base + way] != line + 1)
+      continue;
+
+    this->hits++;
+    if (this->config.replacement == Replacement::LRU)
+      this->stamps[base + way] = this->clock;
+    if (write && writeBack)
+      this->dirty[base + way] = 1;
+    else if (write)
+      this->memoryWrites++;
+    return true;
+  }
+
+  this->misses++;
+  if (write && !writeBack) {
+    this->memoryWrites++;
+    return false;
+  }
+
+  size_t slot = base + this->victim(set);
+  if (this->dirty[slot])
+    this->writeBacks++;
+
+  this->lines[slot] = line + 1;
+  this->stamps[slot] = this->clock;
+  this->dirty[slot] = write;
+  return false;
+}
+
+auto CacheModel::reset(const CPU& cpu) -> void {
+  this->icache = Cache(this->icache.config);
+  this->dcache = Cache(this->dcache.config);
+
+  this->textStart = cpu.textStart;
+  this->fetchMisses.assign(cpu.decoded.size(), 0);
+  this->fetches.assign(cpu.decoded.size(), 0);
+  this->dataMisses.assign(cpu.decoded.size(), 0);
+  this->dataAccesses.assign(cpu.decoded.size(), 0);
+  this->kinds.assign(cpu.decoded.size(), Op::UNKNOWN);
+}
+
+auto CacheModel::retire(const Retired& instruction) -> void {
+  u32 index = instruction.index;
+  Op kind = instruction.op.kind;
+  bool inside = index != Retired::OUTSIDE;
+
+  if (this->instructions) {
+    bool hit = this->icache.access(instruction.pc, false);
+    if (inside) {
+      this->fetches[index]++;
+      this->fetchMisses[index] += !hit;
+    }
+  }
+
+  bool load = kind == Op::LW || kind == Op::LBU || kind == Op::LB || kind == Op::LH || kind == Op::LHU || kind == Op::LL;
+  bool store = kind == Op::SW || kind == Op::SB || kind == Op::SH || kind == Op::SC;
+  if (this->data && (load || store)) {
+    bool hit = this->dcache.access(instruction.address, store);
+    if (inside) {
+      this->dataAccesses[index]++;
+      this->dataMisses[index] += !hit;
+    }
+  }
+
+  if (inside)
+    this->kinds[index] = kind;
+}
+
+auto CacheModel::report(const Tokenizer& tokenizer, std::ostream& out) -> void {
+  auto describe = [&](std::string_view name, const Cache& cache) {
+    const CacheConfig& config = cache.config;
+    u64 accesses = cache.hits + cache.misses;
+    std::string size = config.size % 1024 == 0 ? std::format("{} KiB", config.size >> 10) : std::format("{} B", config.size);
+    out << std::format("{}: {}, {} ways, {} B lines, {}, {}\n", name, size, config.associativity,
+                       config.lineSize, replacementName(config.replacement),
+                       config.writePolicy == WritePolicy::WRITE_BACK ? "write-back" : "write-through");
+    out << std::format("  {} accesses, {} hits, {} misses ({:.2f}% miss rate), {} write backs, {} memory writes\n",
+                       accesses, cache.hits, cache.misses, percent(cache.misses, accesses), cache.writeBacks,
+                       cache.memoryWrites);
+  };
+
+  if (this->instructions)
+    describe("icache", this->icache);
+  if (this->data)
+    describe("dcache", this->dcache);
+
+  auto labels = Profiler::textLabels(tokenizer, this->textStart, this->textStart + u64(this->fetches.size()) * 4);
+
+  // Labels that never ran are left out
+  std::vector<u64> executed(this->kinds.size());
+  for (size_t i = 0; i < executed.size(); i++) {
+    executed[i] = this->kinds[i] != Op::UNKNOWN;
+  }
+
+  auto ran = Profiler::perLabel(labels, this->textStart, executed);
+  auto fetches = Profiler::perLabel(labels, this->textStart, this->fetches);
+  auto fetchMisses = Profiler::perLabel(labels, this->textStart, this->fetchMisses);
+  auto dataAccesses = Profiler::perLabel(labels, this->textStart, this->dataAccesses);
+  auto dataMisses = Profiler::perLabel(labels, this->textStart, this->dataMisses);
+
+  // perLabel drops zero sums, so the columns are matched by name
+  auto sum = [](const std::vector<std::pair<std::string, u64>>& sums, const std::string& name) -> u64 {
+    auto it = std::ranges::find(sums, name, &std::pair<std::string, u64>::first);
+    return it != sums.end() ? it->second : 0;
+  };
+
+  struct Row {
+    std::string label;
+    u64 fetches, fetchMisses, dataAccesses, dataMisses;
+  };
+  std::vector<Row> rows;
+  for (const auto& [name, count] : ran) {
+    rows.push_back({name, sum(fetches, name), sum(fetchMisses, name), sum(dataAccesses, name), sum(dataMisses, name)});
+  }
+  std::stable_sort(rows.begin(), rows.end(), [](const Row& a, const Row& b) {
+    return a.fetchMisses + a.dataMisses > b.fetchMisses + b.dataMisses;
+  });
+
+  out << std::format("\n{:>14} {:>8} {:>14} {:>8}  {}\n", "fetches", "miss%", "data", "miss%", "label");
+  for (const Row& row : rows) {
+    out << std::format("{:>14} {:>7.2f}% {:>14} {:>7.2f}%  {}\n", row.fetches, percent(row.fetchMisses, row.fetches),
+                       row.dataAccesses, percent(row.dataMisses, row.dataAccesses), row.label);
+  }
+
+  // Instructions missing the most, in either cache
+  std::vector<u32> indexes;
+  for (u32 i = 0; i < this->kinds.size(); i++) {
+    if (this->fetchMisses[i] + this->dataMisses[i] != 0)
+      indexes.push_back(i);
+  }
+  std::stable_sort(indexes.begin(), indexes.end(), [this](u32 a, u32 b) {
+    return this->fetchMisses[a] + this->dataMisses[a] > this->fetchMisses[b] + this->dataMisses[b];
+  });
+
+  out << std::format("\n{:>14} {:>14} {:>14} {:>14}  {:<10}  {:<24} {}\n", "fetch misses", "fetches", "data misses",
+                     "data", "pc", "location", "instruction");
+  for (size_t i = 0; i < std::min(indexes.size(), HOT_SPOTS); i++) {
+    u32 index = indexes[i];
+    u32 pc = this->textStart + index * 4;
+    out << std::format("{:>14} {:>14} {:>14} {:>14}  0x{:08x}  {:<24} {}\n", this->fetchMisses[index],
+                       this->fetches[index], this->dataMisses[index], this->dataAccesses[index], pc,
+                       Profiler::locate(labels, pc), Decoder::name(this->kinds[index]));
+  }
+}
+
+} // namespace Emulator
@@ -0,0 +1,90 @@
+#pragma once
+
+#include "Core.hpp"
+#include "Tokenizer.hpp"
+
+namespace Emulator {
+
+// Which line of a set makes room for a new one
+enum class Replacement : u8 { LRU, FIFO, RANDOM };
+
+// WRITE_BACK allocates a line on a write miss and writes dirty lines out
+// when they're evicted, WRITE_THROUGH writes every store to memory and
+// doesn't allocate on a write miss
+enum class WritePolicy : u8 { WRITE_BACK, WRITE_THROUGH };
+
+// Geometry of a cache, sizes are powers of two
+struct CacheConfig {
+  u32 size = 32 << 10;
+  u32 associativity = 4;
+  u32 lineSize = 64;
+  Replacement replacement = Replacement::LRU;
+  WritePolicy writePolicy = WritePolicy::WRITE_BACK;
+
+  // Parses "size=32k,ways=4,line=64,lru|fifo|random,write-back|write-through",
+  // any subset in any order, throws std::invalid_argument on anything else
+  static auto parse(std::string_view settings) -> CacheConfig;
+};
+
+// Set associative cache keeping tags only, every access is one set lookup
+class Cache {
+public:
+  CacheConfig config;
+  u64 hits = 0;
+  u64 misses = 0;
+  u64 writeBacks = 0;    // Dirty lines evicted
+  u64 memoryWrites = 0;  // Stores sent to memory by WRITE_THROUGH
+
+  // Throws std::invalid_argument when the geometry isn't valid
+  explicit Cache(const CacheConfig& config = {});
+
+  // Looks address up, filling its line on a miss when the policy says so.
+  // Returns whether it hit
+  auto access(u32 address, bool write) -> bool;
+
+private:
+  // Per line of every set, consecutive ways of a set are contiguous
+  std::vector<u32> lines;  // Line number + 1, 0 when the way is empty
+  std::vector<u64> stamps; // Last use for LRU, fill for FIFO
+  std::vector<u8> dirty;
+
+  u32 lineBits;
+  u32 setMask;
+  u64 clock = 0;
+  u64 seed = 0x9E3779B97F4A7C15;
+
+  // Way of set to evict
+  auto victim(u32 set) -> u32;
+};
+
+// L1 instruction and data caches fed with every retired instruction by
+// runCore(): the fetch at pc goes to the instruction cache, lw and
+// lbu read the data cache and sw and sb write it. Hits and misses are kept
+// per instruction of the text segment for the report
+class CacheModel {
+public:
+  bool instructions = false;
+  bool data = false;
+  Cache icache;
+  Cache dcache;
+
+  // Clears the caches and counters and sizes them for the text segment of cpu
+  auto reset(const CPU& cpu) -> void;
+
+  // Simulates the accesses of one instruction
+  auto retire(const Retired& instruction) -> void;
+
+  // Prints hit rates for each cache, then per label and for the pcs missing the most
+  auto report(const Tokenizer& tokenizer, std::ostream& out) -> void;
+
+private:
+  // Per instruction of the text segment
+  std::vector<u64> fetchMisses;
+  std::vector<u64> fetches;
+  std::vector<u64> dataMisses;
+  std::vector<u64> dataAccesses;
+  std::vector<Op> kinds;
+  u32 textStart = 0;
+};
+
+} // namespace Emulator
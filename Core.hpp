@@ -0,0 +1,205 @@
+#pragma once
+
+#include "CPU.hpp"
+
+#include <atomic>
+
+namespace Emulator {
+
+// How much the policy core checks the loads and stores of a program
+enum class MemoryChecks { FULL, BOUNDS, NONE };
+
+[[noreturn]] inline auto outOfBounds(u64 address) -> void {
+  throw std::runtime_error(std::format("ERROR! Address {} is bigger than 32 bits addres space\n", address));
+}
+
+// Loads and stores of lw, sw and sb. lbu can't leave the address space so
+// it always reads memory straight away
+
+// Like CPU::readWord() and CPU::writeWord(): bounds checked, and a store
+// into the text segment has its instructions decoded again
+struct FullChecks {
+  static auto readWord(CPU& cpu, u32 address) -> u32 {
+    if (u64(address) + 3 > cpu.max_size - 1)
+      outOfBounds(u64(address) + 3);
+    return cpu.memory.readWord(address);
+  }
+
+  static auto writeWord(CPU& cpu, u32 address, u32 value) -> void {
+    if (u64(address) + 3 > cpu.max_size - 1)
+      outOfBounds(u64(address) + 3);
+    cpu.memory.writeWord(address, value);
+    if (address < cpu.textEnd && u64(address) + 4 > cpu.textStart)
+      cpu.invalidateDecoded(address, 4);
+  }
+
+  static auto writeByte(CPU& cpu, u32 address, u8 value) -> void {
+    if (address > cpu.max_size - 1)
+      outOfBounds(address);
+    cpu.memory.write(address, value);
+    if (address < cpu.textEnd && address >= cpu.textStart)
+      cpu.invalidateDecoded(address, 1);
+  }
+};
+
+// Bounds checked, but stores never look at the decoded cache, for programs
+// that don't write their own code
+struct BoundsChecks {
+  static auto readWord(CPU& cpu, u32 address) -> u32 {
+    return FullChecks::readWord(cpu, address);
+  }
+
+  static auto writeWord(CPU& cpu, u32 address, u32 value) -> void {
+    if (u64(address) + 3 > cpu.max_size - 1)
+      outOfBounds(u64(address) + 3);
+    cpu.memory.writeWord(address, value);
+  }
+
+  static auto writeByte(CPU& cpu, u32 address, u8 value) -> void {
+    if (address > cpu.max_size - 1)
+      outOfBounds(address);
+    cpu.memory.write(address, value);
+  }
+};
+
+// Straight to memory for trusted programs, a word at the very end of the
+// address space wraps around to 0
+struct NoChecks {
+  static auto readWord(CPU& cpu, u32 address) -> u32 { return cpu.memory.readWord(address); }
+  static auto writeWord(CPU& cpu, u32 address, u32 value) -> void { cpu.memory.writeWord(address, value); }
+  static auto writeByte(CPU& cpu, u32 address, u8 value) -> void { cpu.memory.write(address, value); }
+};
+
+// What observers are told about every retired instruction
+struct Retired {
+  static constexpr u32 OUTSIDE = ~u32(0);
+
+  DecodedOp op;  // A copy, a store may rewrite the one in the cache
+  u32 pc;
+  u32 next;      // pc once it ran
+  u32 address;   // Where loads and stores went, rs + imm for the rest
+  u32 index;     // In the decoded cache, OUTSIDE when it ran from outside .text
+
+  // Whether a branch was taken. One whose target is the next instruction
+  // doesn't leave the straight line, so it counts as not taken. next is
+  // where a branch with a delay slot goes once the slot ran
+  auto taken() const -> bool {
+    return this->next != this->pc + (isDelayed(this->op.kind) ? 8 : 4);
+  }
+};
+
+// Steps through the decoded cache until the program halts or has retired
+// limit instructions, checking loads and stores as Checks says and calling
+// retire(instruction) of every observer after each instruction that didn't
+// throw. Both are template arguments, so every combination compiles into a
+// loop of its own that only pays for what it was given. Instructions
+// behave exactly like the handlers of Decoder
+template <typename Checks, typename... Observers>
+auto runCore(CPU& cpu, u64 limit, Observers&... observers) -> void {
+  constexpr bool OBSERVED = sizeof...(Observers) > 0;
+  constexpr u32 NO_SLOT = ~u32(0);
+  u32* r = cpu.registers.data();
+
+  // Observers are told about a delay slot on its own, so a branch only
+  // decides where it goes and the slot then runs like any instruction
+  u32 slot = NO_SLOT;
+  u32 destination = 0;
+
+  while (!cpu.halt && (cpu.retired < limit || cpu.pc == slot)) {
+    u32 pc = cpu.pc;
+    u32 offset = pc - cpu.textStart;
+    u32 index = offset >> 2;
+
+    DecodedOp op;
+    if ((offset & 3) != 0 || index >= cpu.decoded.size()) {
+      // Lets fetchInstruction() throw for a pc past the end of memory
+      if (pc > cpu.max_size - 4) {
+        cpu.fetchInstruction();
+      }
+
+      op = Decoder::decode(cpu.memory.readWord(pc), pc, cpu.encoding);
+      index = Retired::OUTSIDE;
+    } else {
+      DecodedOp& cached = cpu.decoded[index];
+      if (cached.handler == nullptr) {
+        cached = Decoder::decode(cpu.memory.readWord(pc), pc, cpu.encoding);
+      }
+      op = cached;
+    }
+
+    // $zero is written freely and cleared once the instruction ran
+    u32 address = r[op.rs] + op.imm;
+    switch (op.kind) {
+      case Op::SLL: r[op.rd] = r[op.rt] << op.shamt; cpu.pc += 4; break;
+      case Op::MUL: r[op.rd] = r[op.rs] * r[op.rt]; cpu.pc += 4; break;
+      case Op::SRL: r[op.rd] = r[op.rt] >> op.shamt; cpu.pc += 4; break;
+      case Op::JR:  cpu.pc = r[op.rs] - 4; break;
+      case Op::ADD: r[op.rd] = r[op.rs] + r[op.rt]; cpu.pc += 4; break;
+      case Op::SUB: r[op.rd] = r[op.rs] - r[op.rt]; cpu.pc += 4; break;
+      case Op::AND: r[op.rd] = r[op.rs] & r[op.rt]; cpu.pc += 4; break;
+      case Op::OR:  r[op.rd] = r[op.rs] | r[op.rt]; cpu.pc += 4; break;
+      case Op::NOR: r[op.rd] = ~(r[op.rs] | r[op.rt]); cpu.pc += 4; break;
+      case Op::SLT: r[op.rd] = r[op.rs] < r[op.rt] ? 1 : 0; cpu.pc += 4; break;
+      case Op::SYSCALL: cpu.executeSyscall(); cpu.pc += 4; break;
+      case Op::NOP: cpu.pc += 4; break;
+
+      case Op::BEQ: cpu.pc = r[op.rs] == r[op.rt] ? op.target : pc + 4; break;
+      case Op::BNE: cpu.pc = r[op.rs] != r[op.rt] ? op.target : pc + 4; break;
+      case Op::BLT: cpu.pc = s32(r[op.rt]) < s32(r[op.rs]) ? op.target : pc + 4; break;
+      case Op::BGE: cpu.pc = s32(r[op.rt]) >= s32(r[op.rs]) ? op.target : pc + 4; break;
+
+      case Op::ADDI: r[op.rt] = r[op.rs] + op.imm; cpu.pc += 4; break;
+      case Op::SLTI: r[op.rt] = r[op.rs] < u32(op.imm) ? 1 : 0; cpu.pc += 4; break;
+      case Op::ANDI: r[op.rt] = r[op.rs] & u32(op.imm); cpu.pc += 4; break;
+      case Op::ORI:  r[op.rt] = r[op.rs] | u32(op.imm); cpu.pc += 4; break;
+
+      case Op::LW:  r[op.rt] = Checks::readWord(cpu, address); cpu.pc += 4; break;
+      case Op::LBU: r[op.rt] = cpu.memory.read(address); cpu.pc += 4; break;
+      case Op::SW:  Checks::writeWord(cpu, address, r[op.rt]); cpu.pc += 4; break;
+
+      case Op::SB:  // Addressed by rt, stores rs
+        address = r[op.rt] + op.imm;
+        Checks::writeByte(cpu, address, u8(r[op.rs]));
+        cpu.pc += 4;
+        break;
+
+      case Op::J:   cpu.pc = op.target; break;
+      case Op::JAL: r[31] = pc + 8; cpu.pc = op.target; break;
+
+      // Always checked, the atomics need the word to be there and aligned
+      case Op::LL:   r[op.rt] = cpu.loadLinked(address); cpu.pc += 4; break;
+      case Op::SC:   r[op.rt] = cpu.storeConditional(address, r[op.rt]); cpu.pc += 4; break;
+      case Op::SYNC: std::atomic_thread_fence(std::memory_order_seq_cst); cpu.pc += 4; break;
+
+      // What only MIPS32 programs use and unknown words, the handlers check
+      // loads and stores fully whatever Checks says
+      default:
+        if constexpr (OBSERVED) {
+          if (isDelayed(op.kind)) {
+            if (pc == slot)
+              branchInDelaySlot(pc - 4);
+            destination = Decoder::destination(cpu, op);
+            slot = pc + 4;
+            cpu.pc = slot;
+            break;
+          }
+        }
+        op.handler(cpu, op);
+        break;
+    }
+    r[0] = 0;
+    cpu.retired++;
+
+    if constexpr (OBSERVED) {
+      if (pc == slot) {
+        cpu.pc = destination;
+        slot = NO_SLOT;
+      }
+
+      Retired instruction{op, pc, isDelayed(op.kind) ? destination : cpu.pc, address, index};
+      (observers.retire(instruction), ...);
+    }
+  }
+}
+
+} // namespace Emulator
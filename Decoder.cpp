@@ -0,0 +1,587 @@
+#include "Decoder.hpp"
+#include "CPU.hpp"
+
+#include <atomic>
+#include <bitset>
+
+namespace Emulator {
+
+// Every handler must leave the CPU exactly as CPU::execute would
+
+static auto opSll(CPU& cpu, const DecodedOp& op) -> void {
+  cpu.writeRegister(op.rd, cpu.readRegister(op.rt) << op.shamt);
+  cpu.pc += 4;
+}
+
+static auto opMul(CPU& cpu, const DecodedOp& op) -> void {
+  cpu.writeRegister(op.rd, cpu.readRegister(op.rs) * cpu.readRegister(op.rt));
+  cpu.pc += 4;
+}
+
+static auto opSrl(CPU& cpu, const DecodedOp& op) -> void {
+  cpu.writeRegister(op.rd, cpu.readRegister(op.rt) >> op.shamt);
+  cpu.pc += 4;
+}
+
+static auto opJr(CPU& cpu, const DecodedOp& op) -> void {
+  cpu.pc = cpu.readRegister(op.rs) - 4;
+}
+
+static auto opAdd(CPU& cpu, const DecodedOp& op) -> void {
+  cpu.writeRegister(op.rd, cpu.readRegister(op.rs) + cpu.readRegister(op.rt));
+  cpu.pc += 4;
+}
+
+static auto opSub(CPU& cpu, const DecodedOp& op) -> void {
+  cpu.writeRegister(op.rd, cpu.readRegister(op.rs) - cpu.readRegister(op.rt));
+  cpu.pc += 4;
+}
+
+static auto opAnd(CPU& cpu, const DecodedOp& op) -> void {
+  cpu.writeRegister(op.rd, cpu.readRegister(op.rs) & cpu.readRegister(op.rt));
+  cpu.pc += 4;
+}
+
+static auto opOr(CPU& cpu, const DecodedOp& op) -> void {
+  cpu.writeRegister(op.rd, cpu.readRegister(op.rs) | cpu.readRegister(op.rt));
+  cpu.pc += 4;
+}
+
+static auto opNor(CPU& cpu, const DecodedOp& op) -> void {
+  cpu.writeRegister(op.rd, ~(cpu.readRegister(op.rs) | cpu.readRegister(op.rt)));
+  cpu.pc += 4;
+}
+
+static auto opSlt(CPU& cpu, const DecodedOp& op) -> void {
+  cpu.writeRegister(op.rd, cpu.readRegister(op.rs) < cpu.readRegister(op.rt) ? 1 : 0);
+  cpu.pc += 4;
+}
+
+static auto opSyscall(CPU& cpu, const DecodedOp& op) -> void {
+  cpu.executeSyscall();
+  cpu.pc += 4;
+}
+
+static auto opNop(CPU& cpu, const DecodedOp& op) -> void {
+  cpu.pc += 4;
+}
+
+static auto opBeq(CPU& cpu, const DecodedOp& op) -> void {
+  if (cpu.readRegister(op.rs) == cpu.readRegister(op.rt))
+    cpu.pc = op.target;
+  else
+    cpu.pc += 4;
+}
+
+static auto opBne(CPU& cpu, const DecodedOp& op) -> void {
+  if (cpu.readRegister(op.rs) != cpu.readRegister(op.rt))
+    cpu.pc = op.target;
+  else
+    cpu.pc += 4;
+}
+
+static auto opBlt(CPU& cpu, const DecodedOp& op) -> void {
+  if (static_cast<s32>(cpu.readRegister(op.rt)) < static_cast<s32>(cpu.readRegister(op.rs)))
+    cpu.pc = op.target;
+  else
+    cpu.pc += 4;
+}
+
+static auto opBge(CPU& cpu, const DecodedOp& op) -> void {
+  if (static_cast<s32>(cpu.readRegister(op.rt)) >= static_cast<s32>(cpu.readRegister(op.rs)))
+    cpu.pc = op.target;
+  else
+    cpu.pc += 4;
+}
+
+static auto opAddi(CPU& cpu, const DecodedOp& op) -> void {
+  cpu.writeRegister(op.rt, cpu.readRegister(op.rs) + op.imm);
+  cpu.pc += 4;
+}
+
+static auto opSlti(CPU& cpu, const DecodedOp& op) -> void {
+  cpu.writeRegister(op.rt, cpu.readRegister(op.rs) < u32(op.imm) ? 1 : 0);
+  cpu.pc += 4;
+}
+
+static auto opAndi(CPU& cpu, const DecodedOp& op) -> void {
+  cpu.writeRegister(op.rt, cpu.readRegister(op.rs) & u32(op.imm));
+  cpu.pc += 4;
+}
+
+static auto opOri(CPU& cpu, const DecodedOp& op) -> void {
+  cpu.writeRegister(op.rt, cpu.readRegister(op.rs) | u32(op.imm));
+  cpu.pc += 4;
+}
+
+static auto opLw(CPU& cpu, const DecodedOp& op) -> void {
+  cpu.writeRegister(op.rt, cpu.readWord(u32(cpu.readRegister(op.rs) + op.imm)));
+  cpu.pc += 4;
+}
+
+static auto opLbu(CPU& cpu, const DecodedOp& op) -> void {
+  cpu.writeRegister(op.rt, cpu.memory.read(u32(cpu.readRegister(op.rs) + op.imm)));
+  cpu.pc += 4;
+}
+
+static auto opSb(CPU& cpu, const DecodedOp& op) -> void {
+  cpu.writeMemory(u32(cpu.readRegister(op.rt) + op.imm), static_cast<u8>(cpu.readRegister(op.rs)));
+  cpu.pc += 4;
+}
+
+static auto opSw(CPU& cpu, const DecodedOp& op) -> void {
+  cpu.writeWord(u32(cpu.readRegister(op.rs) + op.imm), cpu.readRegister(op.rt));
+  cpu.pc += 4;
+}
+
+static auto opJ(CPU& cpu, const DecodedOp& op) -> void {
+  cpu.pc = op.target;
+}
+
+static auto opJal(CPU& cpu, const DecodedOp& op) -> void {
+  cpu.registers[31] = cpu.pc + 8;
+  cpu.pc = op.target;
+}
+
+static auto opLl(CPU& cpu, const DecodedOp& op) -> void {
+  cpu.writeRegister(op.rt, cpu.loadLinked(u32(cpu.readRegister(op.rs) + op.imm)));
+  cpu.pc += 4;
+}
+
+static auto opSc(CPU& cpu, const DecodedOp& op) -> void {
+  cpu.writeRegister(op.rt, cpu.storeConditional(u32(cpu.readRegister(op.rs) + op.imm), cpu.readRegister(op.rt)));
+  cpu.pc += 4;
+}
+
+static auto opSync(CPU& cpu, const DecodedOp& op) -> void {
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  cpu.pc += 4;
+}
+
+static auto opUnknown(CPU& cpu, const DecodedOp& op) -> void {
+  cpu.io.writeString(std::format("{} Not implemented yet\n", std::bitset<32>(op.word).to_string()));
+}
+
+// MIPS32 only from here on
+
+static auto opSra(CPU& cpu, const DecodedOp& op) -> void {
+  cpu.writeRegister(op.rd, static_cast<s32>(cpu.readRegister(op.rt)) >> op.shamt);
+  cpu.pc += 4;
+}
+
+static auto opSllv(CPU& cpu, const DecodedOp& op) -> void {
+  cpu.writeRegister(op.rd, cpu.readRegister(op.rt) << (cpu.readRegister(op.rs) & 0x1F));
+  cpu.pc += 4;
+}
+
+static auto opSrlv(CPU& cpu, const DecodedOp& op) -> void {
+  cpu.writeRegister(op.rd, cpu.readRegister(op.rt) >> (cpu.readRegister(op.rs) & 0x1F));
+  cpu.pc += 4;
+}
+
+static auto opSrav(CPU& cpu, const DecodedOp& op) -> void {
+  cpu.writeRegister(op.rd, static_cast<s32>(cpu.readRegister(op.rt)) >> (cpu.readRegister(op.rs) & 0x1F));
+  cpu.pc += 4;
+}
+
+static auto opMovz(CPU& cpu, const DecodedOp& op) -> void {
+  if (cpu.readRegister(op.rt) == 0)
+    cpu.writeRegister(op.rd, cpu.readRegister(op.rs));
+  cpu.pc += 4;
+}
+
+static auto opMovn(CPU& cpu, const DecodedOp& op) -> void {
+  if (cpu.readRegister(op.rt) != 0)
+    cpu.writeRegister(op.rd, cpu.readRegister(op.rs));
+  cpu.pc += 4;
+}
+
+static auto opMfhi(CPU& cpu, const DecodedOp& op) -> void {
+  cpu.writeRegister(op.rd, cpu.hi);
+  cpu.pc += 4;
+}
+
+static auto opMflo(CPU& cpu, const DecodedOp& op) -> void {
+  cpu.writeRegister(op.rd, cpu.lo);
+  cpu.pc += 4;
+}
+
+static auto opMthi(CPU& cpu, const DecodedOp& op) -> void {
+  cpu.hi = cpu.readRegister(op.rs);
+  cpu.pc += 4;
+}
+
+static auto opMtlo(CPU& cpu, const DecodedOp& op) -> void {
+  cpu.lo = cpu.readRegister(op.rs);
+  cpu.pc += 4;
+}
+
+static auto opMult(CPU& cpu, const DecodedOp& op) -> void {
+  s64 product = s64(s32(cpu.readRegister(op.rs))) * s64(s32(cpu.readRegister(op.rt)));
+  cpu.hi = u32(u64(product) >> 32);
+  cpu.lo = u32(product);
+  cpu.pc += 4;
+}
+
+static auto opMultu(CPU& cpu, const DecodedOp& op) -> void {
+  u64 product = u64(cpu.readRegister(op.rs)) * u64(cpu.readRegister(op.rt));
+  cpu.hi = u32(product >> 32);
+  cpu.lo = u32(product);
+  cpu.pc += 4;
+}
+
+// Dividing by zero leaves hi and lo unpredictable, here they keep what they had
+static auto opDiv(CPU& cpu, const DecodedOp& op) -> void {
+  s32 dividend = s32(cpu.readRegister(op.rs));
+  s32 divisor = s32(cpu.readRegister(op.rt));
+  if (divisor == -1) {
+    cpu.lo = 0u - u32(dividend); // INT_MIN / -1 wraps around
+    cpu.hi = 0;
+  } else if (divisor != 0) {
+    cpu.lo = u32(dividend / divisor);
+    cpu.hi = u32(dividend % divisor);
+  }
+  cpu.pc += 4;
+}
+
+static auto opDivu(CPU& cpu, const DecodedOp& op) -> void {
+  u32 dividend = cpu.readRegister(op.rs);
+  u32 divisor = cpu.readRegister(op.rt);
+  if (divisor != 0) {
+    cpu.lo = dividend / divisor;
+    cpu.hi = dividend % divisor;
+  }
+  cpu.pc += 4;
+}
+
+static auto opXor(CPU& cpu, const DecodedOp& op) -> void {
+  cpu.writeRegister(op.rd, cpu.readRegister(op.rs) ^ cpu.readRegister(op.rt));
+  cpu.pc += 4;
+}
+
+static auto opSlts(CPU& cpu, const DecodedOp& op) -> void {
+  cpu.writeRegister(op.rd, s32(cpu.readRegister(op.rs)) < s32(cpu.readRegister(op.rt)) ? 1 : 0);
+  cpu.pc += 4;
+}
+
+static auto opSltu(CPU& cpu, const DecodedOp& op) -> void {
+  cpu.writeRegister(op.rd, cpu.readRegister(op.rs) < cpu.readRegister(op.rt) ? 1 : 0);
+  cpu.pc += 4;
+}
+
+// gcc checks divisions with teq $divisor, $zero, 7
+static auto opTeq(CPU& cpu, const DecodedOp& op) -> void {
+  if (cpu.readRegister(op.rs) == cpu.readRegister(op.rt)) {
+    u32 code = (op.word >> 6) & 0x3FF;
+    throw std::runtime_error(code == 7 ? std::format("ERROR! Division by zero at {:#010x}\n", cpu.pc)
+                                       : std::format("ERROR! Trap {} at {:#010x}\n", code, cpu.pc));
+  }
+  cpu.pc += 4;
+}
+
+static auto opSltis(CPU& cpu, const DecodedOp& op) -> void {
+  cpu.writeRegister(op.rt, s32(cpu.readRegister(op.rs)) < op.imm ? 1 : 0);
+  cpu.pc += 4;
+}
+
+static auto opSltiu(CPU& cpu, const DecodedOp& op) -> void {
+  cpu.writeRegister(op.rt, cpu.readRegister(op.rs) < u32(op.imm) ? 1 : 0);
+  cpu.pc += 4;
+}
+
+static auto opXori(CPU& cpu, const DecodedOp& op) -> void {
+  cpu.writeRegister(op.rt, cpu.readRegister(op.rs) ^ u32(op.imm));
+  cpu.pc += 4;
+}
+
+static auto opLui(CPU& cpu, const DecodedOp& op) -> void {
+  cpu.writeRegister(op.rt, op.imm);
+  cpu.pc += 4;
+}
+
+static auto opLb(CPU& cpu, const DecodedOp& op) -> void {
+  cpu.writeRegister(op.rt, static_cast<s8>(cpu.memory.read(u32(cpu.readRegister(op.rs) + op.imm))));
+  cpu.pc += 4;
+}
+
+static auto opLh(CPU& cpu, const DecodedOp& op) -> void {
+  cpu.writeRegister(op.rt, static_cast<s16>(cpu.readHalf(u32(cpu.readRegister(op.rs) + op.imm))));
+  cpu.pc += 4;
+}
+
+static auto opLhu(CPU& cpu, const DecodedOp& op) -> void {
+  cpu.writeRegister(op.rt, cpu.readHalf(u32(cpu.readRegister(op.rs) + op.imm)));
+  cpu.pc += 4;
+}
+
+static auto opSh(CPU& cpu, const DecodedOp& op) -> void {
+  cpu.writeHalf(u32(cpu.readRegister(op.rs) + op.imm), static_cast<u16>(cpu.readRegister(op.rt)));
+  cpu.pc += 4;
+}
+
+// A word no MIPS32 core would run, unlike opUnknown it doesn't go on
+// Branches and jumps decide where they go, then run their delay slot, which
+// retires as an instruction of its own
+static auto opDelayed(CPU& cpu, const DecodedOp& op) -> void {
+  u32 destination = Decoder::destination(cpu, op);
+  u32 branch = cpu.pc;
+  cpu.pc += 4;
+
+  DecodedOp slot;
+  u32 offset = cpu.pc - cpu.textStart;
+  u32 index = offset >> 2;
+  if ((offset & 3) != 0 || index >= cpu.decoded.size()) {
+    // Lets fetchInstruction() throw for a pc past the end of memory
+    if (cpu.pc > cpu.max_size - 4) {
+      cpu.fetchInstruction();
+    }
+    slot = Decoder::decode(cpu.memory.readWord(cpu.pc), cpu.pc, cpu.encoding);
+  } else {
+    DecodedOp& cached = cpu.decoded[index];
+    if (cached.handler == nullptr) {
+      cached = Decoder::decode(cpu.memory.readWord(cpu.pc), cpu.pc, cpu.encoding);
+    }
+    slot = cached;
+  }
+
+  if (isDelayed(slot.kind))
+    branchInDelaySlot(branch);
+
+  slot.handler(cpu, slot);
+  cpu.retired++;
+  cpu.pc = destination;
+}
+
+static auto opIllegal(CPU& cpu, const DecodedOp& op) -> void {
+  throw std::runtime_error(std::format("ERROR! Unknown instruction {:#010x} at {:#010x}\n", op.word, cpu.pc));
+}
+
+// Splits instruction into its fields, the immediate sign extended
+static auto fields(u32 instruction) -> DecodedOp {
+  DecodedOp op;
+  op.word   = instruction;
+  op.opcode = (instruction >> 26) & 0x3F;
+  op.rs     = (instruction >> 21) & 0x1F;
+  op.rt     = (instruction >> 16) & 0x1F;
+  op.rd     = (instruction >> 11) & 0x1F;
+  op.shamt  = (instruction >>  6) & 0x1F;
+  op.funct  = (instruction >>  0) & 0x3F;
+  op.imm    = static_cast<s16>(instruction & 0xFFFF);
+  return op;
+}
+
+// The words Tokenizer assembles
+static auto decodeAssembler(u32 instruction, u32 address) -> DecodedOp {
+  DecodedOp op = fields(instruction);
+  op.target = address + 4;
+  op.handler = opUnknown;
+  op.kind = Op::UNKNOWN;
+
+  switch (op.opcode) {
+    case 0x00:
+      switch (op.funct) {
+        case 0x00: op.handler = opSll; op.kind = Op::SLL; break;
+        case 0x01: op.handler = opMul; op.kind = Op::MUL; break;
+        case 0x02: op.handler = opSrl; op.kind = Op::SRL; break;
+        case 0x08: op.handler = opJr;  op.kind = Op::JR;  break;
+        case 0x20: op.handler = opAdd; op.kind = Op::ADD; break;
+        case 0x22: op.handler = opSub; op.kind = Op::SUB; break;
+        case 0x24: op.handler = opAnd; op.kind = Op::AND; break;
+        case 0x25: op.handler = opOr;  op.kind = Op::OR;  break;
+        case 0x27: op.handler = opNor; op.kind = Op::NOR; break;
+        case 0x2A: op.handler = opSlt; op.kind = Op::SLT; break;
+        case 0x0C: op.handler = opSyscall; op.kind = Op::SYSCALL; break;
+        case 0x0F: op.handler = opSync; op.kind = Op::SYNC; break;
+        default:   op.handler = opNop; op.kind = Op::NOP; break;
+      }
+      break;
+
+    case 0x04: // beq
+    case 0x05: // bne
+    case 0x06: // blt (Pseudo)
+    case 0x07: // bge (Pseudo)
+      op.target = u32(s32(address) + (op.imm << 2));
+      op.handler = op.opcode == 0x04 ? opBeq :
+                   op.opcode == 0x05 ? opBne :
+                   op.opcode == 0x06 ? opBlt : opBge;
+      op.kind = op.opcode == 0x04 ? Op::BEQ :
+                op.opcode == 0x05 ? Op::BNE :
+                op.opcode == 0x06 ? Op::BLT : Op::BGE;
+      break;
+
+    // slti, andi, ori and lbu use the immediate without its sign
+    case 0x0A: op.handler = opSlti; op.kind = Op::SLTI; op.imm = std::abs(s16(op.imm)); break;
+    case 0x0C: op.handler = opAndi; op.kind = Op::ANDI; op.imm = std::abs(s16(op.imm)); break;
+    case 0x0D: op.handler = opOri;  op.kind = Op::ORI;  op.imm = std::abs(s16(op.imm)); break;
+    case 0x24: op.handler = opLbu;  op.kind = Op::LBU;  op.imm = std::abs(s16(op.imm)); break;
+
+    case 0x08: op.handler = opAddi; op.kind = Op::ADDI; break;
+    case 0x23: op.handler = opLw;   op.kind = Op::LW;   break;
+    case 0x28: op.handler = opSb;   op.kind = Op::SB;   break;
+    case 0x2b: op.handler = opSw;   op.kind = Op::SW;   break;
+    case 0x30: op.handler = opLl;   op.kind = Op::LL;   break;
+    case 0x38: op.handler = opSc;   op.kind = Op::SC;   break;
+
+    case 0x02: // j
+    case 0x03: // jal
+      op.target = instruction & 0x3FFFFFF;
+      op.handler = op.opcode == 0x02 ? opJ : opJal;
+      op.kind = op.opcode == 0x02 ? Op::J : Op::JAL;
+      break;
+  }
+
+  return op;
+}
+
+// Words built by a MIPS32 toolchain. Branches are relative to the next
+// instruction, j and jal stay in the 256 MB region of the next instruction
+// and all of them have a delay slot. Whatever behaves like an instruction of
+// the assembler is decoded to it: addiu to addi, addu and subu to add and
+// sub, and blez, bgtz, bltz and bgez to blt and bge against $zero
+static auto decodeMips32(u32 instruction, u32 address) -> DecodedOp {
+  DecodedOp op = fields(instruction);
+  u32 zeroExtended = instruction & 0xFFFF;
+  op.target = address + 4;
+  op.handler = opIllegal;
+  op.kind = Op::UNKNOWN;
+
+  switch (op.opcode) {
+    case 0x00:
+      switch (op.funct) {
+        case 0x00: op.handler = opSll;   op.kind = Op::SLL;   break;
+        case 0x02: op.handler = opSrl;   op.kind = Op::SRL;   break;
+        case 0x03: op.handler = opSra;   op.kind = Op::SRA;   break;
+        case 0x04: op.handler = opSllv;  op.kind = Op::SLLV;  break;
+        case 0x06: op.handler = opSrlv;  op.kind = Op::SRLV;  break;
+        case 0x07: op.handler = opSrav;  op.kind = Op::SRAV;  break;
+        case 0x08: op.handler = opDelayed; op.kind = Op::DJR; break;
+        case 0x09: op.handler = opDelayed; op.kind = Op::JALR; break;
+        case 0x0A: op.handler = opMovz;  op.kind = Op::MOVZ;  break;
+        case 0x0B: op.handler = opMovn;  op.kind = Op::MOVN;  break;
+        case 0x0C: op.handler = opSyscall; op.kind = Op::SYSCALL; break;
+        case 0x0F: op.handler = opSync;  op.kind = Op::SYNC;  break;
+        case 0x10: op.handler = opMfhi;  op.kind = Op::MFHI;  break;
+        case 0x11: op.handler = opMthi;  op.kind = Op::MTHI;  break;
+        case 0x12: op.handler = opMflo;  op.kind = Op::MFLO;  break;
+        case 0x13: op.handler = opMtlo;  op.kind = Op::MTLO;  break;
+        case 0x18: op.handler = opMult;  op.kind = Op::MULT;  break;
+        case 0x19: op.handler = opMultu; op.kind = Op::MULTU; break;
+        case 0x1A: op.handler = opDiv;   op.kind = Op::DIV;   break;
+        case 0x1B: op.handler = opDivu;  op.kind = Op::DIVU;  break;
+        case 0x20: // add
+        case 0x21: op.handler = opAdd;   op.kind = Op::ADD;   break;
+        case 0x22: // sub
+        case 0x23: op.handler = opSub;   op.kind = Op::SUB;   break;
+        case 0x24: op.handler = opAnd;   op.kind = Op::AND;   break;
+        case 0x25: op.handler = opOr;    op.kind = Op::OR;    break;
+        case 0x26: op.handler = opXor;   op.kind = Op::XOR;   break;
+        case 0x27: op.handler = opNor;   op.kind = Op::NOR;   break;
+        case 0x2A: op.handler = opSlts;  op.kind = Op::SLTS;  break;
+        case 0x2B: op.handler = opSltu;  op.kind = Op::SLTU;  break;
+        case 0x34: op.handler = opTeq;   op.kind = Op::TEQ;   break;
+      }
+      break;
+
+    case 0x01: // bltz and bgez, blt and bge compare rt against rs
+      if (op.rt == 0x00 || op.rt == 0x01) {
+        op.target = u32(s32(address) + 4 + (op.imm << 2));
+        op.handler = opDelayed;
+        op.kind = op.rt == 0x00 ? Op::DBLT : Op::DBGE;
+        op.rt = op.rs;
+        op.rs = 0;
+      }
+      break;
+
+    case 0x02: // j
+    case 0x03: // jal
+      op.target = ((address + 4) & 0xF0000000) | ((instruction & 0x3FFFFFF) << 2);
+      op.handler = opDelayed;
+      op.kind = op.opcode == 0x02 ? Op::DJ : Op::DJAL;
+      break;
+
+    case 0x04: // beq
+    case 0x05: // bne
+    case 0x06: // blez, 0 >= rs
+    case 0x07: // bgtz, 0 < rs
+      op.target = u32(s32(address) + 4 + (op.imm << 2));
+      op.handler = opDelayed;
+      op.kind = op.opcode == 0x04 ? Op::DBEQ :
+                op.opcode == 0x05 ? Op::DBNE :
+                op.opcode == 0x06 ? Op::DBGE : Op::DBLT;
+      break;
+
+    case 0x08: // addi
+    case 0x09: op.handler = opAddi;  op.kind = Op::ADDI;  break;
+    case 0x0A: op.handler = opSltis; op.kind = Op::SLTIS; break;
+    case 0x0B: op.handler = opSltiu; op.kind = Op::SLTIU; break;
+
+    // Logical immediates aren't sign extended
+    case 0x0C: op.handler = opAndi;  op.kind = Op::ANDI;  op.imm = s32(zeroExtended); break;
+    case 0x0D: op.handler = opOri;   op.kind = Op::ORI;   op.imm = s32(zeroExtended); break;
+    case 0x0E: op.handler = opXori;  op.kind = Op::XORI;  op.imm = s32(zeroExtended); break;
+    case 0x0F: op.handler = opLui;   op.kind = Op::LUI;   op.imm = s32(zeroExtended << 16); break;
+
+    case 0x1C: // mul is in SPECIAL2
+      if (op.funct == 0x02) {
+        op.handler = opMul;
+        op.kind = Op::MUL;
+      }
+      break;
+
+    case 0x20: op.handler = opLb;    op.kind = Op::LB;    break;
+    case 0x21: op.handler = opLh;    op.kind = Op::LH;    break;
+    case 0x23: op.handler = opLw;    op.kind = Op::LW;    break;
+    case 0x24: op.handler = opLbu;   op.kind = Op::LBU;   break;
+    case 0x25: op.handler = opLhu;   op.kind = Op::LHU;   break;
+    case 0x29: op.handler = opSh;    op.kind = Op::SH;    break;
+    case 0x2B: op.handler = opSw;    op.kind = Op::SW;    break;
+    case 0x30: op.handler = opLl;    op.kind = Op::LL;    break;
+    case 0x38: op.handler = opSc;    op.kind = Op::SC;    break;
+
+    case 0x28: // The assembler's sb is addressed by rt and stores rs
+      op.handler = opSb;
+      op.kind = Op::SB;
+      std::swap(op.rs, op.rt);
+      break;
+  }
+
+  return op;
+}
+
+auto Decoder::decode(u32 instruction, u32 address, Encoding encoding) -> DecodedOp {
+  return encoding == Encoding::MIPS32 ? decodeMips32(instruction, address) : decodeAssembler(instruction, address);
+}
+
+auto Decoder::destination(CPU& cpu, const DecodedOp& op) -> u32 {
+  u32 rs = cpu.readRegister(op.rs);
+  u32 rt = cpu.readRegister(op.rt);
+  u32 next = cpu.pc + 8;
+
+  switch (op.kind) {
+    case Op::DBEQ: return rs == rt ? op.target : next;
+    case Op::DBNE: return rs != rt ? op.target : next;
+    case Op::DBLT: return s32(rt) < s32(rs) ? op.target : next;
+    case Op::DBGE: return s32(rt) >= s32(rs) ? op.target : next;
+    case Op::DJ:   return op.target;
+    case Op::DJAL: cpu.writeRegister(31, next); return op.target;
+    case Op::DJR:  return rs;
+    case Op::JALR: cpu.writeRegister(op.rd, next); return rs;
+    default:       return cpu.pc + 4;
+  }
+}
+
+auto Decoder::name(Op kind) -> std::string_view {
+  static constexpr std::array<std::string_view, size_t(Op::COUNT)> names = {
+    "sll", "mul", "srl", "jr", "add", "sub", "and", "or", "nor", "slt", "syscall", "nop",
+    "beq", "bne", "blt", "bge", "addi", "slti", "andi", "ori", "lw", "lbu", "sb", "sw",
+    "j", "jal", "ll", "sc", "sync",
+    "sra", "sllv", "srlv", "srav", "jalr", "movz", "movn", "mfhi", "mthi", "mflo", "mtlo", "mult", "multu", "div", "divu", "xor",
+    "slt", "sltu", "teq", "slti", "sltiu", "xori", "lui", "lb", "lh", "lhu", "sh",
+    "beq", "bne", "blt", "bge", "j", "jal", "jr",
+    "unknown",
+  };
+
+  return names[size_t(kind)];
+}
+
+} // namespace Emulator
@@ -0,0 +1,68 @@
+#pragma once
+
+#include "Config.hpp"
+
+namespace Emulator {
+
+class CPU;
+
+// How instruction words are encoded: the assembler's own encoding for .asm
+// programs, the real one for MIPS32 executables built by a toolchain
+enum class Encoding : u8 { ASSEMBLER, MIPS32 };
+
+// Flat instruction identifier, lets interpreters dispatch with a single table.
+// The kinds after SYNC only come out of MIPS32 words, the cores leave them to
+// their handlers. DBEQ to DJR are the branches and jumps of MIPS32 words,
+// which run the instruction after them (their delay slot) before going
+// anywhere, and so does JALR
+enum class Op : u8 {
+  SLL, MUL, SRL, JR, ADD, SUB, AND, OR, NOR, SLT, SYSCALL, NOP,
+  BEQ, BNE, BLT, BGE, ADDI, SLTI, ANDI, ORI, LW, LBU, SB, SW,
+  J, JAL, LL, SC, SYNC,
+  SRA, SLLV, SRLV, SRAV, JALR, MOVZ, MOVN, MFHI, MTHI, MFLO, MTLO, MULT, MULTU, DIV, DIVU, XOR, SLTS, SLTU, TEQ,
+  SLTIS, SLTIU, XORI, LUI, LB, LH, LHU, SH,
+  DBEQ, DBNE, DBLT, DBGE, DJ, DJAL, DJR,
+  UNKNOWN, COUNT
+};
+
+// Whether kind runs its delay slot before going anywhere
+inline auto isDelayed(Op kind) -> bool {
+  return (kind >= Op::DBEQ && kind <= Op::DJR) || kind == Op::JALR;
+}
+
+[[noreturn]] inline auto branchInDelaySlot(u32 address) -> void {
+  throw std::runtime_error(std::format("ERROR! Branch in the delay slot of the branch at {:#010x}\n", address));
+}
+
+// An instruction decoded once and kept around, so running it again only
+// costs a call through its handler
+struct DecodedOp {
+  using Handler = auto (*)(CPU& cpu, const DecodedOp& op) -> void;
+
+  Handler handler;
+  u32 word;   // Raw instruction
+  u32 target; // Branch or jump destination
+  s32 imm;    // Immediate already extended the way the instruction uses it
+  Op kind;
+  u8 opcode;
+  u8 funct;
+  u8 rd;
+  u8 rs;
+  u8 rt;
+  u8 shamt;
+};
+
+class Decoder {
+public:
+  // Decodes the instruction located at address
+  static auto decode(u32 instruction, u32 address, Encoding encoding) -> DecodedOp;
+
+  // Where a branch or jump with a delay slot goes once the slot ran, jal and
+  // jalr write their link register right away like the hardware does
+  static auto destination(CPU& cpu, const DecodedOp& op) -> u32;
+
+  // Mnemonic of an instruction kind
+  static auto name(Op kind) -> std::string_view;
+};
+
+} // namespace Emulator
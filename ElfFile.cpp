@@ -0,0 +1,244 @@
+#include "ElfFile.hpp"
+
+#include <cstring>
+#include <optional>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace Emulator {
+
+static constexpr u16 ET_EXEC = 2;
+static constexpr u16 EM_MIPS = 8;
+static constexpr u32 PT_LOAD = 1;
+static constexpr u32 SHT_SYMTAB = 2;
+static constexpr u8 STT_SECTION = 3;
+static constexpr u8 STT_FILE = 4;
+
+static constexpr u32 HEADER_SIZE = 52;
+static constexpr u32 PROGRAM_HEADER_SIZE = 32;
+static constexpr u32 SECTION_HEADER_SIZE = 40;
+static constexpr u32 SYMBOL_SIZE = 16;
+
+static auto alignUp(u64 value) -> u64 {
+  return (value + Memory::PAGE_SIZE - 1) & ~u64(Memory::PAGE_SIZE - 1);
+}
+
+// The whole file mapped read only, for reading the tables
+struct Image {
+  std::shared_ptr<void> owner;
+  std::span<const u8> bytes;
+
+  // Reads a little-endian field at offset
+  template <typename T>
+  auto field(u64 offset) const -> T {
+    if (offset + sizeof(T) > this->bytes.size()) {
+      throw std::runtime_error(std::format("ERROR! ELF file is truncated at offset {}\n", offset));
+    }
+
+    T value;
+    std::memcpy(&value, this->bytes.data() + offset, sizeof(T));
+    return value;
+  }
+};
+
+static auto mapFile(const std::string& path) -> Image {
+  int fd = ::open(path.c_str(), O_RDONLY);
+  if (fd < 0) {
+    throw std::runtime_error(std::format("ERROR! Couldn't open {}\n", path));
+  }
+
+  struct stat status;
+  if (fstat(fd, &status) != 0 || status.st_size == 0) {
+    ::close(fd);
+    throw std::runtime_error(std::format("ERROR! Couldn't read {}\n", path));
+  }
+
+  size_t size = status.st_size;
+  void* memory = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+  ::close(fd);
+  if (memory == MAP_FAILED) {
+    throw std::runtime_error(std::format("ERROR! Couldn't map {}\n", path));
+  }
+
+  Image image;
+  image.owner = std::shared_ptr<void>(memory, [size](void* memory) { munmap(memory, size); });
+  image.bytes = {static_cast<const u8*>(memory), size};
+  return image;
+}
+
+auto ElfFile::isElf(const std::string& path) -> bool {
+  std::ifstream file(path, std::ios::binary);
+  char magic[4] = {};
+  return file.read(magic, sizeof(magic)) && std::memcmp(magic, "\x7F" "ELF", sizeof(magic)) == 0;
+}
+
+auto ElfFile::open(const std::string& path) -> std::unique_ptr<ElfFile> {
+  Image image = mapFile(path);
+  const auto& ident = image.bytes;
+
+  if (ident.size() < HEADER_SIZE || std::memcmp(ident.data(), "\x7F" "ELF", 4) != 0) {
+    throw std::runtime_error(std::format("ERROR! {} isn't an ELF file\n", path));
+  }
+  if (ident[4] != 1 || (ident[5] != 1 && ident[5] != 2)) {
+    throw std::runtime_error(std::format("ERROR! {} isn't a 32 bits ELF file\n", path));
+  }
+  // The CPU and its memory are little-endian, big-endian data would be read
+  // byte swapped
+  if (ident[5] == 2) {
+    throw std::runtime_error(std::format("ERROR! {} is big-endian, only little-endian (-EL) programs can be run\n", path));
+  }
+
+  if (image.field<u16>(18) != EM_MIPS) {
+    throw std::runtime_error(std::format("ERROR! {} isn't a MIPS executable\n", path));
+  }
+  if (image.field<u16>(16) != ET_EXEC) {
+    throw std::runtime_error(std::format("ERROR! {} isn't statically linked, only ET_EXEC files can be run\n", path));
+  }
+
+  auto elf = std::make_unique<ElfFile>();
+  elf->path = path;
+  elf->entry = image.field<u32>(24);
+
+  u32 programHeaders = image.field<u32>(28);
+  u16 programHeaderSize = image.field<u16>(42);
+  u16 programHeaderCount = image.field<u16>(44);
+  if (programHeaderCount > 0 && programHeaderSize < PROGRAM_HEADER_SIZE) {
+    throw std::runtime_error(std::format("ERROR! {} has malformed program headers\n", path));
+  }
+
+  for (u32 i = 0; i < programHeaderCount; i++) {
+    u64 header = programHeaders + u64(i) * programHeaderSize;
+    if (image.field<u32>(header) != PT_LOAD)
+      continue;
+
+    Segment segment;
+    segment.offset = image.field<u32>(header + 4);
+    segment.address = image.field<u32>(header + 8);
+    segment.fileSize = image.field<u32>(header + 16);
+    segment.memorySize = image.field<u32>(header + 20);
+    segment.flags = image.field<u32>(header + 24);
+
+    if (segment.fileSize > segment.memorySize || u64(segment.offset) + segment.fileSize > image.bytes.size() ||
+        u64(segment.address) + segment.memorySize > Memory::ADDRESS_SPACE) {
+      throw std::runtime_error(std::format("ERROR! {} has a malformed segment at {:#x}\n", path, segment.address));
+    }
+    elf->segments.push_back(segment);
+  }
+
+  // Checked here so text() can't fail later
+  elf->text();
+
+  // Symbols are optional, a stripped binary still runs
+  u32 sectionHeaders = image.field<u32>(32);
+  u16 sectionHeaderSize = image.field<u16>(46);
+  u16 sectionHeaderCount = image.field<u16>(48);
+  if (sectionHeaderSize < SECTION_HEADER_SIZE)
+    sectionHeaderCount = 0;
+
+  for (u32 i = 0; i < sectionHeaderCount; i++) {
+    u64 header = sectionHeaders + u64(i) * sectionHeaderSize;
+    if (image.field<u32>(header + 4) != SHT_SYMTAB)
+      continue;
+
+    u32 offset = image.field<u32>(header + 16);
+    u32 size = image.field<u32>(header + 20);
+    u32 link = image.field<u32>(header + 24);
+    if (link >= sectionHeaderCount)
+      continue;
+
+    u64 strings = image.field<u32>(sectionHeaders + u64(link) * sectionHeaderSize + 16);
+    u64 stringsSize = image.field<u32>(sectionHeaders + u64(link) * sectionHeaderSize + 20);
+    if (strings + stringsSize > image.bytes.size())
+      continue;
+    std::string_view names{reinterpret_cast<const char*>(image.bytes.data()) + strings, stringsSize};
+
+    for (u64 symbol = offset; symbol + SYMBOL_SIZE <= u64(offset) + size; symbol += SYMBOL_SIZE) {
+      u32 name = image.field<u32>(symbol);
+      u32 value = image.field<u32>(symbol + 4);
+      u8 type = image.field<u8>(symbol + 12) & 0xF;
+      u16 section = image.field<u16>(symbol + 14);
+
+      if (section == 0 || type == STT_SECTION || type == STT_FILE || name >= names.size())
+        continue;
+
+      std::string_view label = names.substr(name, names.find('\0', name) - name);
+      if (!label.empty()) {
+        elf->symbols.emplace(label, value);
+      }
+    }
+  }
+
+  return elf;
+}
+
+auto ElfFile::isMappable(const Segment& segment) const -> bool {
+  if (segment.fileSize == 0 || segment.address % Memory::PAGE_SIZE != 0 ||
+      segment.offset % Memory::PAGE_SIZE != 0)
+    return false;
+
+  // Mapping replaces whole pages, they can't be shared with another segment
+  u64 end = segment.address + alignUp(segment.fileSize);
+  for (const Segment& other : this->segments) {
+    if (&other == &segment || other.memorySize == 0)
+      continue;
+
+    u64 otherStart = other.address & ~u64(Memory::PAGE_SIZE - 1);
+    u64 otherEnd = alignUp(u64(other.address) + other.memorySize);
+    if (otherStart < end && segment.address < otherEnd)
+      return false;
+  }
+  return true;
+}
+
+auto ElfFile::load(Memory& memory) const -> void {
+  std::optional<Image> image;
+
+  for (const Segment& segment : this->segments) {
+    if (segment.fileSize == 0)
+      continue;
+
+    if (this->isMappable(segment)) {
+      int fd = ::open(this->path.c_str(), O_RDONLY);
+      if (fd < 0) {
+        throw std::runtime_error(std::format("ERROR! Couldn't open {}\n", this->path));
+      }
+
+      size_t size = alignUp(segment.fileSize);
+      void* pages = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, segment.offset);
+      ::close(fd);
+      if (pages == MAP_FAILED) {
+        throw std::runtime_error(std::format("ERROR! Couldn't map {}\n", this->path));
+      }
+      std::shared_ptr<void> owner(pages, [size](void* pages) { munmap(pages, size); });
+
+      // The last page also holds whatever follows the segment in the file
+      std::memset(static_cast<u8*>(pages) + segment.fileSize, 0, size - segment.fileSize);
+      memory.map(segment.address, {static_cast<u8*>(pages), size}, std::move(owner));
+      continue;
+    }
+
+    if (!image) {
+      image = mapFile(this->path);
+    }
+
+    memory.writeBlock(segment.address, image->bytes.subspan(segment.offset, segment.fileSize));
+  }
+}
+
+auto ElfFile::text() const -> const Segment& {
+  for (const Segment& segment : this->segments) {
+    if ((segment.flags & PF_X) && this->entry >= segment.address &&
+        this->entry < u64(segment.address) + segment.memorySize)
+      return segment;
+  }
+  throw std::runtime_error(std::format("ERROR! Entry point {:#x} isn't in an executable segment\n", this->entry));
+}
+
+auto ElfFile::globalPointer() const -> u32 {
+  auto it = this->symbols.find("_gp");
+  return it != this->symbols.end() ? static_cast<u32>(it->second) : 0;
+}
+
+} // namespace Emulator
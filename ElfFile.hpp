@@ -0,0 +1,62 @@
+#pragma once
+
+#include "Config.hpp"
+#include "Memory.hpp"
+#include "Tokenizer.hpp"
+
+#include <memory>
+#include <unordered_map>
+
+namespace Emulator {
+
+// Little-endian MIPS ELF32 executable built by a cross toolchain. Only
+// what's needed to run it is read: the PT_LOAD segments, the entry point
+// and the symbol table
+class ElfFile {
+public:
+  struct Segment {
+    u32 address;
+    u32 fileSize;
+    u32 memorySize; // The part past fileSize is zero filled (.bss)
+    u32 offset;     // Where it starts in the file
+    u32 flags;      // PF_X, PF_W, PF_R
+  };
+
+  static constexpr u32 PF_X = 1;
+  static constexpr u32 PF_W = 2;
+  static constexpr u32 PF_R = 4;
+
+  // Where $sp starts, right below the kernel segment
+  static constexpr u32 STACK_TOP = 0x7FFFFFF0;
+
+  u32 entry = 0;
+  std::vector<Segment> segments;
+  Labels symbols;
+
+  // Whether path starts with the ELF magic number
+  static auto isElf(const std::string& path) -> bool;
+
+  // Reads the headers and the symbol table, throws when path isn't a MIPS
+  // ELF32 executable
+  static auto open(const std::string& path) -> std::unique_ptr<ElfFile>;
+
+  // Puts every PT_LOAD segment into memory. Segments whose address and
+  // offset are page aligned are mapped privately from the file, the others
+  // are copied and only get pages for what the file holds, .bss stays
+  // untouched until the program writes to it
+  auto load(Memory& memory) const -> void;
+
+  // Executable segment holding the entry point
+  auto text() const -> const Segment&;
+
+  // Value of $gp, _gp when the program defines it
+  auto globalPointer() const -> u32;
+
+private:
+  std::string path;
+
+  // Whether segment can be mapped straight from the file
+  auto isMappable(const Segment& segment) const -> bool;
+};
+
+} // namespace Emulator
@@ -1,6 +1,10 @@
 #include "Engine.hpp"
+#include "Parallel.hpp"
+#include "Threaded.hpp"
 
 #include <bitset>
+#include <cstring>
+#include <ctime>
 #include <random>
 #include <set>
 
@@ -8,43 +12,6 @@ namespace Emulator {
 
 static constexpr u64 WORD_SIZE = 4;
 
-static constexpr std::string_view MOVE = "move";
-static constexpr std::string_view LI = "li";
-static constexpr std::string_view LA = "la";
-
-static const std::unordered_map<std::string_view, u8> functMap = {
-    {"add", 0x20},
-    {"sub", 0x22}, 
-    {"and", 0x24}, 
-    {"or" , 0x25},
-    {"nor", 0x27}, 
-    {"sll", 0x00}, 
-    {"srl", 0x02}, 
-    {"slt", 0x2A},
-    {"jr" , 0x08},
-    {"mul", 0x01}, // Pseudo
-};
-
-static const std::unordered_map<std::string_view, u8> opcodeMap = {
-    {"addi", 0x08},
-    {"slti", 0x0A},
-    {"andi", 0x0C},
-    {"ori" , 0x0D},
-    {"beq" , 0x04},
-    {"bne" , 0x05},
-    {"blt" , 0x06}, // Pseudo
-    {"bge" , 0x07}, // Pseudo
-    {"lw"  , 0x23},
-    {"lbu" , 0x24},
-    {"sb"  , 0x28},
-    {"sw"  , 0x2b},
-};
-
-static const std::unordered_map<std::string_view, u8> jumpMap = {
-  {"j"  , 0x02},
-  {"jal", 0x03},
-};
-
 auto Engine::insertCode(u8* program, u32 bin, u64& address) -> void {
   for (size_t i = 0; i < WORD_SIZE; i++) {
       program[address + i] = static_cast<u8>((bin >> i * 8) & 0xFF);
@@ -52,92 +19,67 @@ auto Engine::insertCode(u8* program, u32 bin, u64& address) -> void {
   address += WORD_SIZE;
 }
 
-auto Engine::isPseudoInstruction(const std::string& mnemonic) -> bool {
-  return mnemonic == MOVE || mnemonic == LI || mnemonic == LA;
-}
-
-auto Engine::isRTypeInstruction(const std::string& mnemonic) -> bool {
-  return functMap.contains(mnemonic);
-}
-
-auto Engine::isITypeInstruction(const std::string& mnemonic) -> bool {
-  return opcodeMap.contains(mnemonic);
-}
-
-auto Engine::isJTypeInstruction(const std::string& mnemonic) -> bool {
-  return jumpMap.contains(mnemonic);
-}
-
 auto Engine::assemblePseudoInstruction(u8* program, const Token& token, u32& bin) -> void {
+  const InstructionInfo& info = Instructions::info(token.mnemonic);
 
   // "move" instruction turns into: "add $dest, $src, zero" to cpu
-  if (token.value == MOVE) {
+  if (info.operands == Operands::RD_RS) {
     u8 rd = static_cast<u8>(token.args.at(0)); // Destiny
     u8 rs = static_cast<u8>(token.args.at(1)); // Source
     u8 rt = 0; // zero
 
-    bin |= (rs    & 0x1F) << 21; // rs
-    bin |= (rt    & 0x1F) << 16; // rt ($zero)
-    bin |= (rd    & 0x1F) << 11; // rd
-    bin |= (0     & 0x1F) << 6;  // shamt = 0
-    bin |= (0x20  & 0x3F) << 0;  // funct = add (0x20)
+    bin |= (rs         & 0x1F) << 21; // rs
+    bin |= (rt         & 0x1F) << 16; // rt ($zero)
+    bin |= (rd         & 0x1F) << 11; // rd
+    bin |= (0          & 0x1F) << 6;  // shamt = 0
+    bin |= (info.funct & 0x3F) << 0;  // funct = add (0x20)
   } 
-  // "li" instruction turns into: "addi $dst, $src, zero" to cpu
-  // Note that this implementation only works for 16 bits immediate
-  // 32 bits immediate will eventually deal with it
-  else if (token.value == LI) {
+  // "li" and "la" instructions turn into: "addi $dst, zero, imm" to cpu
+  // Note that this implementation only works for 16 bits immediates and
+  // addresses (64Kb), 32 bits ones will eventually be dealt with
+  else if (info.operands == Operands::RT_IMM) {
     u8 rt = static_cast<u8>(token.args.at(0)); //Destiny
-    s32 imm = static_cast<s32>(token.args.at(1)); // immediate
+    u32 imm = token.args.at(1); // immediate or label
 
-    bin |= (0x08 & 0x3F) << 26; // opcode 
-    bin |= (0x00 & 0x1F) << 21; // rs (zero)
-    bin |= (rt   & 0x1F) << 16; // rt 
-    bin |= (imm  & 0xFFFF) << 0; // immediate
-  }
-  // "la" instruction tuns into: "addi $dst, zero, label" to cpu 
-  // Note that this implementation only works for 16 bits address space (64Kb)
-  else if (token.value == LA) {
-    u8 rd = static_cast<u8>(token.args.at(0));
-    u16 address_label = static_cast<u16>(token.args.at(1));
-
-    bin |= (0x08 & 0x3F) << 26; // opcode addi
-    bin |= (0    & 0x1F) << 21; // rs = $zero
-    bin |= (rd   & 0x1F) << 16; // rt
-    bin |= (address_label & 0xFFFF);
+    bin |= (info.opcode & 0x3F) << 26; // opcode addi
+    bin |= (0x00        & 0x1F) << 21; // rs (zero)
+    bin |= (rt          & 0x1F) << 16; // rt 
+    bin |= (imm         & 0xFFFF) << 0; // immediate
   } else {
-    throw std::runtime_error{std::format("ERROR! Pseudo instruction {} doesn't exist\n", token.value)};
+    throw std::runtime_error{std::format("ERROR! Pseudo instruction {} doesn't exist\n", info.name)};
   }
 }
 
 auto Engine::assembleR(u8* program, const Token& token, u32& bin) -> void {
+  const InstructionInfo& info = Instructions::info(token.mnemonic);
   u8 rs, rt, rd, shamt, funct;
   rs = rt = 0;
   shamt = 0;
  
-  funct = functMap.at(token.value);
+  funct = info.funct;
   rd = static_cast<u8>(token.args.at(0));
 
-  switch (funct) {
-    case 0x00: // sll
-    case 0x02: // srl
+  switch (info.operands) {
+    case Operands::RD_RT_SHAMT: // sll, srl
       rt = static_cast<u8>(token.args.at(1));
       shamt = static_cast<u8>(token.args.at(2));
       break;
 
-    case 0x01: // mul
-    case 0x20: // add
-    case 0x22: // sub
-    case 0x24: // and
-    case 0x25: // or
-    case 0x27: // nor 
-    case 0x2A: // slt
+    case Operands::RD_RS_RT: // add, sub, and, or, nor, slt, mul
       rs = static_cast<u8>(token.args.at(1));
       rt = static_cast<u8>(token.args.at(2));
       break;
 
-    case 0x08: // jr
+    case Operands::RS: // jr
       rs = static_cast<u8>(token.args.at(0));
       break;
+
+    case Operands::NONE: // sync
+      rd = 0;
+      break;
+
+    default:
+      break;
   }
 
   bin |= (rs    & 0x1F) << 21;    // rs
@@ -148,77 +90,59 @@ auto Engine::assembleR(u8* program, const Token& token, u32& bin) -> void {
 }
 
 auto Engine::assembleI(u8* porgram, const Token& token, u32& bin, u64& address) -> void {
-  u8 opcode, rt, rs;
+  const InstructionInfo& info = Instructions::info(token.mnemonic);
+  u8 rt, rs;
   s16 imm;
-    
+
   rt = static_cast<u8>(token.args.at(0));
   rs = static_cast<u8>(token.args.at(1));
   imm = static_cast<s16>(token.args.at(2));
-  opcode = opcodeMap.at(token.value);
-
-  bin |= (opcode &   0x3F) << 26;
-  bin |= (rs     &   0x1F) << 21;
-  bin |= (rt     &   0x1F) << 16;
-  switch (opcode) {
-    case 0x04: // beq
-    case 0x05: // bne
-    case 0x06: // blt
-    case 0x07: // bge
-    {
-      s32 offset = (imm - address) >> 2;
-      bin |= (offset & 0xFFFF);
-    }
-    break;
-
-    case 0x08: // addi
-    case 0x0A: // slti
-    case 0x0C: // andi
-    case 0x0D: // ori
-    //case 0x23: // lw
-    //case 0x24: // lbu
-    //case 0x28: // sb
-    //case 0x2b: // sw
-      bin |= (imm & 0xFFFF);
-    break;
-
-    case 0x23: // lw
-    case 0x24: // lbu
-    case 0x28: // sb
-    case 0x2b: // sw
-      rs = static_cast<u8>(token.args.at(2));
-      imm = static_cast<s16>(token.args.at(1));
-      bin |= (rs     &   0x1F) << 21;
-      bin |= (imm & 0xFFFF);
-      break;
+
+  // lw $rt, offset($rs)
+  if (info.operands == Operands::RT_OFFSET_RS) {
+    rs = static_cast<u8>(token.args.at(2));
+    imm = static_cast<s16>(token.args.at(1));
+  }
+
+  bin |= (info.opcode &   0x3F) << 26;
+  bin |= (rs          &   0x1F) << 21;
+  bin |= (rt          &   0x1F) << 16;
+
+  // beq, bne, blt, bge
+  if (info.operands == Operands::RT_RS_LABEL) {
+    s32 offset = (imm - address) >> 2;
+    bin |= (offset & 0xFFFF);
+  } else {
+    bin |= (imm & 0xFFFF);
   }
 }
 
 auto Engine::assembleJ(u8* porgram, const Token& token, u32& bin) -> void {
-  u8 opcode;
-  u32 address;
-  opcode = jumpMap.at(token.value);
-  address = static_cast<u32>(token.args.at(0));
+  u32 address = token.args.at(0);
 
-  bin |= (opcode & 0x3F) << 26;
+  bin |= (Instructions::info(token.mnemonic).opcode & 0x3F) << 26;
   bin |= (address & 0x3FFFFFF);
 }
 
 auto Engine::assembleInstruction(u8* program, const Token& token, u64& address) -> void {
   u32 bin = 0;
-  if (this->isPseudoInstruction(token.value))
-    this->assemblePseudoInstruction(program, token, bin);
-
-  else if (this->isRTypeInstruction(token.value)) 
-    this->assembleR(program, token, bin);
+  switch (Instructions::info(token.mnemonic).format) {
+    case Format::PSEUDO:
+      this->assemblePseudoInstruction(program, token, bin);
+      break;
 
-  else if (this->isITypeInstruction(token.value))
-    this->assembleI(program, token, bin, address);
+    case Format::R:
+      this->assembleR(program, token, bin);
+      break;
 
-  else if (this->isJTypeInstruction(token.value))
-    this->assembleJ(program, token, bin);
+    case Format::I:
+      this->assembleI(program, token, bin, address);
+      break;
 
-  else 
-    throw std::runtime_error{std::format("ERROR! Mnemonic {} not found\n", token.value)};
+    case Format::J:
+      this->assembleJ(program, token, bin);
+      break;
+  }
 
   this->insertCode(program, bin, address);
 }
@@ -226,33 +150,24 @@ auto Engine::assembleInstruction(u8* program, const Token& token, u64& address)
 auto Engine::assembleSysCall(u8* program, const Token& token, u64& address)
     -> void {
   u32 bin = 0;
-  if (token.value == "syscall") {
-    bin |= (0x0C & 0x3F); // funct for an syscall is 0x0C
+  if (token.mnemonic == Mnemonic::SYSCALL) {
+    bin |= (Instructions::info(token.mnemonic).funct & 0x3F); // funct for an syscall is 0x0C
   } else {
-    throw std::runtime_error{std::format("Mnemonic {} doesn't exist\n", token.value)};
+    throw std::runtime_error{std::format("Mnemonic {} doesn't exist\n", Tokenizer::name(token.mnemonic))};
   }
 
   this->insertCode(program, bin, address);
 }
 
 auto Engine::assembleLiteral(u8* program, const Token& token, u64& address) -> void {
-  if (token.directive == Directive::WORD) {
+  if (token.directive == Directive::WORD || token.directive == Directive::ASCIIZ) {
 
-    for (u8 i = 0; i < token.args.size(); i++) {
-      u32 bin = static_cast<u32>(token.args[i]);
-      this->insertCode(program, bin, address);
-    }
+    std::memcpy(program + address, this->tokenizer.literals.data() + token.literal.data, token.literal.size);
+    address += token.literal.size;
 
   } else if (token.directive == Directive::SPACE) {
 
-    address += token.args.front();
-
-  } else if (token.directive == Directive::ASCIIZ) {
-
-    for (u32 i = 0; i < token.args.size(); i++) {
-      program[address] = static_cast<u8>(token.args.at(i));
-      address++;
-    }
+    address += token.literal.size;
 
   } else {
     throw std::invalid_argument("Not implemented yet\n");
@@ -265,14 +180,7 @@ auto Engine::preComputeProgramLength() -> u64 {
   for (const auto& token : this->tokenizer.tokens) {
     if (token.tokenType == Type::LITERAL) {
 
-      if (token.directive == Directive::WORD)
-        length += WORD_SIZE * token.args.size();
-      else if (token.directive == Directive::SPACE)
-        length += token.args.front();
-      else if (token.directive == Directive::ASCIIZ)
-        length += token.args.size();
-      else 
-        throw std::runtime_error(std::format("Unknown directive\n"));
+      length += token.literal.size;
 
     } else if (token.tokenType == Type::INSTRUCTION || token.tokenType == Type::SYS_CALL) {
 
@@ -284,32 +192,43 @@ auto Engine::preComputeProgramLength() -> u64 {
 }
 
 auto Engine::assemble(u8* program) -> void {
-  u64 address = 0;
+  // Below this many tokens a thread costs more than it saves
+  static constexpr size_t GRAIN = 16384;
 
-  for (const auto& token : this->tokenizer.tokens) {
-    if (token.tokenType == Type::INSTRUCTION)
-      this->assembleInstruction(program, token, address);
+  // Every token already knows its address, so chunks of them are encoded
+  // independently straight into their place in program
+  const std::vector<Token>& tokens = this->tokenizer.tokens;
+  parallelFor(tokens.size(), GRAIN, [&](size_t begin, size_t end) {
+    for (size_t i = begin; i < end; i++) {
+      const Token& token = tokens[i];
+      u64 address = token.address;
 
-    else if (token.tokenType == Type::SYS_CALL)
-      this->assembleSysCall(program, token, address);
+      if (token.tokenType == Type::INSTRUCTION)
+        this->assembleInstruction(program, token, address);
 
-    else if (token.tokenType == Type::LITERAL)
-      this->assembleLiteral(program, token, address);
+      else if (token.tokenType == Type::SYS_CALL)
+        this->assembleSysCall(program, token, address);
 
-    else 
-      throw std::runtime_error(
-        std::format("Invalid token {}\n", token.value)
-      ); 
-  }
+      else if (token.tokenType == Type::LITERAL)
+        this->assembleLiteral(program, token, address);
+
+      else 
+        throw std::runtime_error(
+          std::format("Invalid token at {}\n", token.address)
+        ); 
+    }
+  });
 }
 
 auto Engine::assembler(const std::string& file) -> std::tuple<u8*, size_t> {
+  auto start = std::chrono::steady_clock::now();
 
   this->tokenizer.tokenize(file);
   u64 length = this->preComputeProgramLength();
-  u8* program = new u8[length];
+  u8* program = new u8[length]();
   this->assemble(program); 
 
+  this->assemblyTime = std::chrono::steady_clock::now() - start;
   return {program, length};
 }
 
@@ -317,12 +236,270 @@ auto Engine::setCPUstartAddress() -> void {
   cpu.pc = tokenizer.textStartAddress;
 }
 
-auto Engine::run(const std::span<u8>& code) -> void {
-  this->cpu.loadProgram(code);
+// CPU time used by the calling thread so far
+static auto threadCpuTime() -> std::chrono::nanoseconds {
+  timespec now;
+  clock_gettime(CLOCK_THREAD_CPUTIME_ID, &now);
+  return std::chrono::seconds{now.tv_sec} + std::chrono::nanoseconds{now.tv_nsec};
+}
+
+auto Engine::enter(u64 textStart, u64 textEnd) -> void {
   this->setCPUstartAddress();
+  this->cpu.setTextSegment(textStart, textEnd);
+  this->profiler.reset(this->cpu);
+  this->pipeline.reset(this->cpu);
+  this->caches.reset(this->cpu);
+  this->branches.reset(this->cpu);
+  this->tracer.reset(this->cpu);
+  this->cpu.harts = &this->harts;
+  this->selectCore();
+  this->executionTime = {};
+  this->cpuTime = {};
+}
+
+auto Engine::load(const std::span<u8>& code) -> void {
+  this->cpu.loadProgram(code);
+  this->enter(this->tokenizer.textStartAddress, code.size());
+}
+
+auto Engine::load(const ObjectFile& object) -> void {
+  std::shared_ptr<void> owner;
+  std::span<u8> image = object.mapImage(owner);
+  this->cpu.memory.map(0, image, std::move(owner));
+
+  // The rest of the engine only knows about programs through the tokenizer
+  this->tokenizer.textStartAddress = object.entry;
+  this->tokenizer.labelsToAddress = object.symbols;
+  this->enter(object.textStart(), object.imageSize());
+}
+
+auto Engine::loadCached(const std::string& file) -> void {
+  auto start = std::chrono::steady_clock::now();
+
+  std::ifstream input(file, std::ios::binary);
+  if (!input.is_open()) {
+    throw std::runtime_error(std::format("Couldn't open file {}", file));
+  }
+  std::string source{std::istreambuf_iterator<char>(input), std::istreambuf_iterator<char>()};
+  u64 hash = ObjectFile::hash(source);
+  std::string path = ObjectFile::pathFor(file);
+
+  auto object = ObjectFile::open(path);
+  if (object != nullptr && object->sourceHash == hash) {
+    this->load(*object);
+    this->assemblyTime = std::chrono::steady_clock::now() - start;
+    return;
+  }
+
+  auto [code, size] = this->assembler(file);
+  std::unique_ptr<u8[]> owner{code};
+  std::span<u8> image(code, size);
+
+  // The cache only saves time, a directory we can't write to isn't an error
+  try {
+    ObjectFile::write(path, hash, this->tokenizer, image);
+  } catch (const std::exception&) {
+  }
 
-  while (!this->cpu.hasHalted()) {
-    this->cpu.fetchInstruction();
+  this->load(image);
+  this->assemblyTime = std::chrono::steady_clock::now() - start;
+}
+
+auto Engine::load(const ElfFile& elf) -> void {
+  elf.load(this->cpu.memory);
+  this->cpu.encoding = Encoding::MIPS32;
+
+  this->tokenizer.textStartAddress = elf.entry;
+  this->tokenizer.labelsToAddress = elf.symbols;
+  const ElfFile::Segment& text = elf.text();
+  this->enter(text.address, u64(text.address) + text.memorySize);
+
+  this->cpu.registers[28] = elf.globalPointer();
+  this->cpu.registers[29] = ElfFile::STACK_TOP;
+}
+
+auto Engine::load(const Snapshot& snapshot) -> void {
+  snapshot.mapPages(this->cpu.memory);
+  this->cpu.encoding = snapshot.encoding;
+
+  this->tokenizer.textStartAddress = snapshot.entry;
+  this->tokenizer.labelsToAddress = snapshot.symbols;
+  this->enter(snapshot.textStart, snapshot.textEnd);
+
+  // enter() points the CPU at the entry, the guest carries on from pc instead
+  this->cpu.registers = snapshot.registers;
+  this->cpu.hi = snapshot.hi;
+  this->cpu.lo = snapshot.lo;
+  this->cpu.pc = snapshot.pc;
+  this->cpu.halt = snapshot.halt;
+  this->cpu.retired = snapshot.retired;
+}
+
+auto Engine::loadFile(const std::string& file, bool cache) -> void {
+  if (ElfFile::isElf(file)) {
+    auto start = std::chrono::steady_clock::now();
+    this->load(*ElfFile::open(file));
+    this->assemblyTime = std::chrono::steady_clock::now() - start;
+    return;
+  }
+
+  if (cache) {
+    this->loadCached(file);
+    return;
+  }
+
+  auto [code, size] = this->assembler(file);
+  std::unique_ptr<u8[]> owner{code};
+  this->load(std::span<u8>(code, size));
+}
+
+auto Engine::run(u64 instructions) -> Status {
+  u64 retired = this->cpu.retired;
+  u64 limit = std::min(this->maxInstructions, retired + std::min(instructions, ~retired));
+
+  auto start = std::chrono::steady_clock::now();
+  auto cpuStart = threadCpuTime();
+  auto account = [&] {
+    this->executionTime += std::chrono::steady_clock::now() - start;
+    this->cpuTime += threadCpuTime() - cpuStart;
+  };
+
+  try {
+    this->execute(limit);
+  } catch (...) {
+    // Whatever the program printed before failing still has to show up
+    this->cpu.io.flush();
+    this->harts.stop();
+    account();
+    throw;
+  }
+
+  if (!this->cpu.hasHalted() && this->cpu.retired < this->maxInstructions) {
+    account();
+    return Status::PAUSED;
+  }
+
+  this->cpu.io.flush();
+  std::exception_ptr error = this->harts.stop();
+  account();
+  if (error) {
+    std::rethrow_exception(error);
+  }
+  return this->cpu.hasHalted() ? Status::HALTED : Status::TIMEOUT;
+}
+
+auto Engine::runUntilInput() -> Status {
+  auto start = std::chrono::steady_clock::now();
+  while (!this->cpu.hasHalted() && this->cpu.retired < this->maxInstructions && !this->cpu.waitsForInput()) {
+    this->cpu.step();
+    this->cpu.retired++;
+  }
+  this->executionTime += std::chrono::steady_clock::now() - start;
+
+  if (this->cpu.hasHalted())
+    return Status::HALTED;
+  return this->cpu.retired < this->maxInstructions ? Status::PAUSED : Status::TIMEOUT;
+}
+
+auto Engine::execute(u64 limit) -> void {
+  this->core(*this, limit);
+}
+
+static auto runSwitch(Engine& engine, u64 limit) -> void {
+  while (!engine.cpu.hasHalted() && engine.cpu.retired < limit) {
+    engine.cpu.fetchInstruction();
+    engine.cpu.retired++;
+  }
+}
+
+static auto runThreaded(Engine& engine, u64 limit) -> void {
+  ThreadedInterpreter::run(engine.cpu, limit);
+}
+
+static auto runBlocks(Engine& engine, u64 limit) -> void {
+  engine.blocks.run(engine.cpu, limit);
+}
+
+static auto runJit(Engine& engine, u64 limit) -> void {
+  engine.blocks.jit = &engine.jit;
+  engine.blocks.run(engine.cpu, limit);
+}
+
+// Engine members a policy core instantiation hands to runCore() as observers
+template <auto... Members>
+struct Observers {};
+
+template <typename Checks, auto... Members>
+static auto runObserved(Engine& engine, u64 limit) -> void {
+  runCore<Checks>(engine.cpu, limit, (engine.*Members)...);
+}
+
+// Whether the observer held by a member takes part in the run
+static auto isEnabled(const Engine& engine, Profiler Engine::*) -> bool { return engine.profile; }
+static auto isEnabled(const Engine& engine, Pipeline Engine::*) -> bool { return engine.timing; }
+static auto isEnabled(const Engine& engine, CacheModel Engine::*) -> bool {
+  return engine.caches.instructions || engine.caches.data;
+}
+static auto isEnabled(const Engine& engine, BranchModel Engine::*) -> bool { return engine.predictBranches; }
+static auto isEnabled(const Engine& engine, Tracer Engine::*) -> bool { return engine.tracer.isOpen(); }
+
+// Moves the enabled observers of rest to chosen, one at a time. Every
+// combination is an instantiation of its own, a disabled model costs nothing
+template <typename Checks, auto... Chosen>
+static auto selectObserved(const Engine&, Observers<Chosen...>, Observers<>) -> Engine::Core {
+  return runObserved<Checks, Chosen...>;
+}
+
+template <typename Checks, auto... Chosen, auto Next, auto... Rest>
+static auto selectObserved(const Engine& engine, Observers<Chosen...>, Observers<Next, Rest...>) -> Engine::Core {
+  if (isEnabled(engine, Next))
+    return selectObserved<Checks>(engine, Observers<Chosen..., Next>{}, Observers<Rest...>{});
+  return selectObserved<Checks>(engine, Observers<Chosen...>{}, Observers<Rest...>{});
+}
+
+auto Engine::selectCore() -> void {
+  switch (this->checks) {
+    case MemoryChecks::FULL:   this->harts.core = runCore<FullChecks>; break;
+    case MemoryChecks::BOUNDS: this->harts.core = runCore<BoundsChecks>; break;
+    case MemoryChecks::NONE:   this->harts.core = runCore<NoChecks>; break;
+  }
+
+  using Models = Observers<&Engine::profiler, &Engine::pipeline, &Engine::caches, &Engine::branches, &Engine::tracer>;
+
+  // The models only run on the policy core
+  bool observed = this->profile || this->timing || this->caches.instructions || this->caches.data ||
+                  this->predictBranches || this->tracer.isOpen();
+
+  if (!observed && this->interpreter != Interpreter::DECODED) {
+    switch (this->interpreter) {
+      case Interpreter::SWITCH:   this->core = runSwitch; return;
+      case Interpreter::THREADED: this->core = runThreaded; return;
+      case Interpreter::BLOCK:    this->core = runBlocks; return;
+      case Interpreter::JIT:      this->core = runJit; return;
+      case Interpreter::DECODED:  break;
+    }
+  }
+
+  switch (this->checks) {
+    case MemoryChecks::FULL:   this->core = selectObserved<FullChecks>(*this, Observers<>{}, Models{}); break;
+    case MemoryChecks::BOUNDS: this->core = selectObserved<BoundsChecks>(*this, Observers<>{}, Models{}); break;
+    case MemoryChecks::NONE:   this->core = selectObserved<NoChecks>(*this, Observers<>{}, Models{}); break;
+  }
+}
+
+auto Engine::printStats() -> void {
+  std::cerr << std::format("assembly time:     {} ns\n", this->assemblyTime.count());
+  std::cerr << std::format("execution time:    {} ns\n", this->executionTime.count());
+  std::cerr << std::format("cpu time:          {} ns\n", this->cpuTime.count());
+  std::cerr << std::format("retired:           {}\n", this->cpu.retired);
+  std::cerr << std::format("committed pages:   {}\n", this->cpu.committedPages());
+  if (this->harts.spawned() > 0) {
+    std::cerr << std::format("harts spawned:     {}\n", this->harts.spawned());
+    std::cerr << std::format("hart retired:      {}\n", this->harts.retired());
+    std::cerr << std::format("hart cpu time:     {} ns\n", this->harts.cpuTime().count());
+  }
+  if (this->interpreter == Interpreter::BLOCK || this->interpreter == Interpreter::JIT) {
+    this->blocks.printStats();
   }
 }
 
@@ -1,14 +1,78 @@
 #pragma once
 
+#include "BlockCache.hpp"
+#include "BranchPredictor.hpp"
+#include "CacheModel.hpp"
 #include "CPU.hpp"
+#include "ElfFile.hpp"
+#include "Harts.hpp"
+#include "Jit.hpp"
+#include "ObjectFile.hpp"
+#include "Pipeline.hpp"
+#include "Profiler.hpp"
+#include "Snapshot.hpp"
 #include "Tokenizer.hpp"
+#include "Trace.hpp"
+
+#include <chrono>
 
 namespace Emulator {
 
+// Which interpreter core runs the program, they all share the CPU state
+enum class Interpreter { SWITCH, DECODED, THREADED, BLOCK, JIT };
+
+// Why Engine::run returned
+enum class Status {
+  HALTED,  // The program exited
+  PAUSED,  // Ran the instructions it was given, run again to continue
+  TIMEOUT, // Reached maxInstructions
+};
+
 class Engine {
 public:
   Tokenizer& tokenizer;
   CPU& cpu;
+  Interpreter interpreter = Interpreter::DECODED;
+
+  // The program is stopped once it has retired this many instructions
+  u64 maxInstructions = std::numeric_limits<u64>::max();
+  BlockCache blocks;
+  Jit jit;
+
+  // How the decoded core and the models below check loads and stores
+  MemoryChecks checks = MemoryChecks::FULL;
+
+  // Counts retired instructions instead of running on the selected interpreter
+  bool profile = false;
+  Profiler profiler;
+
+  // Runs through the pipeline timing model instead of the selected interpreter
+  bool timing = false;
+  Pipeline pipeline;
+
+  // Runs through the L1 cache simulator when either of its caches is enabled
+  CacheModel caches;
+
+  // Runs the branch predictors side by side instead of the selected interpreter
+  bool predictBranches = false;
+  BranchModel branches;
+
+  // Records every retired instruction once opened, instead of running on the selected interpreter
+  Tracer tracer;
+
+  // The harts the program spawns, they run on the policy core without models
+  Harts harts;
+
+  // Runs the program until it halts or has retired limit instructions.
+  // selectCore() picks it from the settings above when a program is loaded
+  using Core = auto (*)(Engine& engine, u64 limit) -> void;
+  Core core = nullptr;
+
+  // Wall time spent by the last assembler() call or binary load and by every run() since
+  // the program was loaded, plus the CPU time of the threads that ran it
+  std::chrono::nanoseconds assemblyTime{};
+  std::chrono::nanoseconds executionTime{};
+  std::chrono::nanoseconds cpuTime{};
 
   Engine() = default;
   Engine(Tokenizer& tokenizer, CPU& cpu) : tokenizer{tokenizer}, cpu{cpu} {};
@@ -40,30 +104,60 @@ public:
   // Helper function that handles the assemble
   auto assemble(u8* program) -> void;
 
-  // Self-explanatory
-  auto isRTypeInstruction(const std::string& mnemonic) -> bool;
-
-  // Self-explanatory
-  auto isITypeInstruction(const std::string& mnemonic) -> bool;
-
-  // Self-explanatory
-  auto isJTypeInstruction(const std::string& mnemonic) -> bool;
-
-  // Self-explanatory
-  auto isPseudoInstruction(const std::string& mnemonic) -> bool;
-
   // Inserts a binary 32-bits code into the program
   auto insertCode(u8* program, u32 bin, u64& address) -> void;
 
   // Computes the program's length before assemble it
   auto preComputeProgramLength() -> u64;
 
-  // Runs the asm program
-  auto run(const std::span<u8>& code) -> void;
+  // Loads the program and points the CPU at its start
+  auto load(const std::span<u8>& code) -> void;
+
+  // Maps an assembled object into guest memory and points the CPU at its entry
+  auto load(const ObjectFile& object) -> void;
+
+  // Loads the cached object of an .asm file when it is up to date, otherwise
+  // assembles the file, loads it and writes the object for the next time
+  auto loadCached(const std::string& file) -> void;
+
+  // Loads the segments of an ELF executable, points the CPU at its entry and
+  // sets up $sp and $gp
+  auto load(const ElfFile& elf) -> void;
+
+  // Restores a saved guest, the next run() resumes it where it was saved
+  auto load(const Snapshot& snapshot) -> void;
+
+  // Loads an ELF executable or assembles an .asm file, going through the
+  // object cache when cache is set
+  auto loadFile(const std::string& file, bool cache) -> void;
+
+  // Sets up the CPU for the program just loaded, its text segment is [textStart, textEnd)
+  auto enter(u64 textStart, u64 textEnd) -> void;
+
+  // Runs the loaded program for at most "instructions" more instructions,
+  // it can be called again to pick up where it stopped. Once the program
+  // halts, fails or times out the harts it spawned are stopped
+  auto run(u64 instructions = std::numeric_limits<u64>::max()) -> Status;
+
+  // Runs the program on the decoded core until it halts or its next
+  // instruction reads input, that syscall is left for the next run()
+  auto runUntilInput() -> Status;
+
+  // Runs on the selected core until the program halts or has retired
+  // limit instructions
+  auto execute(u64 limit) -> void;
+
+  // Picks the interpreter, or the instantiation of the policy core matching
+  // the memory checks and the enabled models, for every later execute(), and
+  // the policy core of the spawned harts
+  auto selectCore() -> void;
 
   // Sets the start of main function
   auto setCPUstartAddress() -> void;
 
+  // Prints timings, memory and translation statistics
+  auto printStats() -> void;
+
   // Debug purposes
   auto printContentFromAllRegisters() -> void;
   auto setContentToAllRegisters() -> void;
@@ -0,0 +1,239 @@
+#include "ForkServer.hpp"
+
+#include <algorithm>
+#include <csignal>
+#include <cstring>
+#include <deque>
+#include <filesystem>
+#include <poll.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+namespace Emulator {
+
+// Written by a child at the start of its file, followed by its output
+struct ChildHeader {
+  ForkRun::Status status;
+  u64 retired;
+  u64 time;
+};
+
+static auto statusName(ForkRun::Status status) -> std::string_view {
+  switch (status) {
+    case ForkRun::Status::OK:      return "ok";
+    case ForkRun::Status::ERROR:   return "error";
+    case ForkRun::Status::TIMEOUT: return "timeout";
+    case ForkRun::Status::CRASH:   return "crash";
+  }
+  return "";
+}
+
+static auto readFile(const std::string& path) -> std::string {
+  std::ifstream file(path, std::ios::binary);
+  if (!file) {
+    throw std::runtime_error(std::format("ERROR! Couldn't open {}\n", path));
+  }
+
+  std::ostringstream content;
+  content << file.rdbuf();
+  return content.str();
+}
+
+auto ForkServer::load(const std::string& corpus) -> std::vector<std::string> {
+  if (!std::filesystem::is_directory(corpus)) {
+    throw std::runtime_error(std::format("ERROR! Corpus {} isn't a directory\n", corpus));
+  }
+
+  std::vector<std::string> inputs;
+  for (const auto& entry : std::filesystem::directory_iterator(corpus)) {
+    if (entry.is_regular_file()) {
+      inputs.push_back(entry.path().string());
+    }
+  }
+  std::ranges::sort(inputs);
+  return inputs;
+}
+
+auto ForkServer::spawn(size_t input) -> Child {
+  FILE* file = std::tmpfile();
+  if (file == nullptr) {
+    throw std::runtime_error(std::format("ERROR! Couldn't create a file for {}\n", this->inputs[input]));
+  }
+
+  pid_t pid = fork();
+  if (pid < 0) {
+    std::fclose(file);
+    throw std::runtime_error(std::format("ERROR! Couldn't fork for {}\n", this->inputs[input]));
+  }
+
+  if (pid == 0) {
+    this->runChild(this->inputs[input], fileno(file));
+  }
+
+  auto deadline = this->timeout.count() > 0 ? std::chrono::steady_clock::now() + this->timeout
+                                            : std::chrono::steady_clock::time_point::max();
+  int pidfd = static_cast<int>(syscall(SYS_pidfd_open, pid, 0));
+  if (pidfd < 0) {
+    kill(pid, SIGKILL);
+    while (waitpid(pid, nullptr, 0) < 0 && errno == EINTR) {}
+    std::fclose(file);
+    throw std::runtime_error(std::format("ERROR! Couldn't watch the child running {}\n", this->inputs[input]));
+  }
+  return {pid, pidfd, file, input, deadline};
+}
+
+auto ForkServer::runChild(const std::string& input, int fd) -> void {
+  auto start = std::chrono::steady_clock::now();
+  ChildHeader header{ForkRun::Status::OK, 0, 0};
+
+  try {
+    this->cpu.io.setInput(readFile(input));
+    if (this->engine.run() != Status::HALTED) {
+      header.status = ForkRun::Status::TIMEOUT;
+    }
+  } catch (const std::exception& e) {
+    this->output << e.what();
+    header.status = ForkRun::Status::ERROR;
+  }
+
+  header.retired = this->cpu.retired;
+  header.time = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+
+  std::string content(reinterpret_cast<const char*>(&header), sizeof(header));
+  content += std::move(this->output).str();
+  for (size_t done = 0; done < content.size();) {
+    ssize_t written = ::write(fd, content.data() + done, content.size() - done);
+    if (written <= 0)
+      _exit(1);
+    done += written;
+  }
+
+  // Skips the destructors and stdio buffers, they belong to the parent
+  _exit(0);
+}
+
+auto ForkServer::wait(const Child& child, int& status) -> bool {
+  using namespace std::chrono;
+
+  pollfd exited{child.pidfd, POLLIN, 0};
+  for (;;) {
+    int wait = -1;
+    if (child.deadline != steady_clock::time_point::max()) {
+      auto left = ceil<milliseconds>(child.deadline - steady_clock::now()).count();
+      wait = static_cast<int>(std::clamp<s64>(left, 0, std::numeric_limits<int>::max()));
+    }
+
+    int ready = poll(&exited, 1, wait);
+    if (ready > 0 || (ready == 0 && steady_clock::now() >= child.deadline))
+      break;
+    if (ready < 0 && errno != EINTR)
+      break;
+  }
+
+  // Whatever woke us up, it's the state of the child that decides
+  bool finished = waitpid(child.pid, &status, WNOHANG) == child.pid;
+  if (!finished) {
+    kill(child.pid, SIGKILL);
+    while (waitpid(child.pid, &status, 0) < 0 && errno == EINTR) {}
+  }
+  close(child.pidfd);
+  return finished;
+}
+
+auto ForkServer::collect(const Child& child) -> ForkRun {
+  int status = 0;
+  bool finished = this->wait(child, status);
+
+  ForkRun run;
+  run.input = this->inputs[child.input];
+
+  if (!finished) {
+    std::fclose(child.file);
+    run.status = ForkRun::Status::TIMEOUT;
+    run.time = this->timeout;
+    run.output = std::format("ERROR! Still running after {} ms\n", this->timeout.count());
+    return run;
+  }
+
+  std::string content;
+  std::rewind(child.file);
+  char buffer[1 << 14];
+  for (size_t read; (read = std::fread(buffer, 1, sizeof(buffer), child.file)) > 0;) {
+    content.append(buffer, read);
+  }
+  std::fclose(child.file);
+
+  if (!WIFEXITED(status) || WEXITSTATUS(status) != 0 || content.size() < sizeof(ChildHeader)) {
+    run.status = ForkRun::Status::CRASH;
+    run.output = WIFSIGNALED(status) ? std::format("ERROR! Killed by signal {}\n", strsignal(WTERMSIG(status)))
+                                     : std::format("ERROR! Exited without a result\n");
+    return run;
+  }
+
+  ChildHeader header;
+  std::memcpy(&header, content.data(), sizeof(header));
+  run.status = header.status;
+  run.retired = header.retired;
+  run.time = std::chrono::nanoseconds{header.time};
+  run.output = content.substr(sizeof(header));
+  return run;
+}
+
+auto ForkServer::run(std::ostream& out) -> void {
+  auto start = std::chrono::steady_clock::now();
+  this->cpu.io.sink = &this->output;
+  this->engine.interpreter = this->interpreter;
+  this->engine.maxInstructions = this->maxInstructions;
+
+  // Done once, every child picks up from here
+  try {
+    this->engine.loadFile(this->program, this->cache);
+    this->engine.runUntilInput();
+    this->cpu.io.flush();
+  } catch (const std::exception& e) {
+    this->cpu.io.flush();
+    out << this->output.str() << e.what();
+    return;
+  }
+  auto setup = std::chrono::steady_clock::now() - start;
+  u64 setupRetired = this->cpu.retired;
+
+  // Nothing buffered may be written twice by the children
+  out.flush();
+  std::cerr.flush();
+
+  std::array<u64, 4> statuses{};
+  u64 retired = 0;
+  std::deque<Child> running;
+  size_t next = 0;
+
+  while (next < this->inputs.size() || !running.empty()) {
+    while (running.size() < std::max(this->threads, 1u) && next < this->inputs.size()) {
+      running.push_back(this->spawn(next++));
+    }
+
+    ForkRun run = this->collect(running.front());
+    running.pop_front();
+
+    out << std::format("==> {} <== {}, {} instructions, {:.3f} ms\n", run.input, statusName(run.status),
+                       run.retired, std::chrono::duration<double, std::milli>(run.time).count());
+    out << run.output;
+    if (!run.output.empty() && !run.output.ends_with('\n'))
+      out << '\n';
+
+    retired += run.retired - std::min(run.retired, setupRetired);
+    statuses[size_t(run.status)]++;
+  }
+  out.flush();
+
+  double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  std::cerr << std::format("{} inputs: {} ok, {} errors, {} timeouts, {} crashes\n", this->inputs.size(),
+                           statuses[size_t(ForkRun::Status::OK)], statuses[size_t(ForkRun::Status::ERROR)],
+                           statuses[size_t(ForkRun::Status::TIMEOUT)], statuses[size_t(ForkRun::Status::CRASH)]);
+  std::cerr << std::format("{} instructions before the first read ({:.3f} ms), then {} in {:.3f} s ({:.0f} inputs/s)\n",
+                           setupRetired, std::chrono::duration<double, std::milli>(setup).count(), retired,
+                           seconds, seconds > 0 ? this->inputs.size() / seconds : 0.0);
+}
+
+} // namespace Emulator
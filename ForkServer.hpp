@@ -0,0 +1,77 @@
+#pragma once
+
+#include "Engine.hpp"
+
+#include <chrono>
+#include <cstdio>
+#include <sstream>
+#include <sys/types.h>
+
+namespace Emulator {
+
+// What came out of running the program on one input of the corpus
+struct ForkRun {
+  enum class Status : u32 { OK, ERROR, TIMEOUT, CRASH };
+
+  std::string input;
+  Status status = Status::OK;
+  std::string output; // Everything the program printed, then the error if it failed
+  u64 retired = 0;
+  std::chrono::nanoseconds time{}; // Spent by the child running it
+};
+
+// Runs one program on every input of a corpus without assembling or
+// loading it again. The program runs once up to its first read syscall,
+// then the process forks for each input: the child gets the CPU as it was
+// and a copy-on-write view of guest memory, reads the input and runs to the
+// end, and the parent collects what it printed. "threads" children run at
+// once, results are printed in corpus order as they come. A child still
+// running "timeout" after it was forked is killed and reported as a timeout
+class ForkServer {
+public:
+  std::string program;
+  std::vector<std::string> inputs;
+  Interpreter interpreter = Interpreter::DECODED;
+  u64 maxInstructions = std::numeric_limits<u64>::max();
+  unsigned threads = 1;
+  bool cache = false;
+  std::chrono::milliseconds timeout{10'000}; // 0 waits forever
+
+  // Lists the regular files of a corpus directory, in name order
+  static auto load(const std::string& corpus) -> std::vector<std::string>;
+
+  // Runs every input, printing each result to out and a summary to std::cerr
+  auto run(std::ostream& out) -> void;
+
+private:
+  // A forked child, it writes its result into file. pidfd becomes readable
+  // once it exits
+  struct Child {
+    pid_t pid;
+    int pidfd;
+    FILE* file;
+    size_t input;
+    std::chrono::steady_clock::time_point deadline;
+  };
+
+  // Everything printed before the fork, every child starts with it
+  std::ostringstream output;
+  Tokenizer tokenizer;
+  CPU cpu;
+  Engine engine{tokenizer, cpu};
+
+  // Forks a child running input, returns in the parent only
+  auto spawn(size_t input) -> Child;
+
+  // Runs input in the child, never returns
+  [[noreturn]] auto runChild(const std::string& input, int fd) -> void;
+
+  // Waits for child until its deadline, killing it if it's still running by
+  // then. Returns whether it exited on its own
+  auto wait(const Child& child, int& status) -> bool;
+
+  // Waits for child and reads its result
+  auto collect(const Child& child) -> ForkRun;
+};
+
+} // namespace Emulator
@@ -0,0 +1,186 @@
+#include "GuestIO.hpp"
+
+#include <cctype>
+#include <cerrno>
+#include <charconv>
+#include <unistd.h>
+
+namespace Emulator {
+
+GuestIO::GuestIO() : input{std::make_shared<Input>()} {
+  this->output.reserve(OUTPUT_THRESHOLD);
+}
+
+GuestIO::~GuestIO() {
+  this->flush();
+}
+
+auto GuestIO::flush() -> void {
+  if (this->output.empty())
+    return;
+
+  this->sink->write(this->output.data(), this->output.size());
+  this->sink->flush();
+  this->output.clear();
+}
+
+auto GuestIO::setInput(std::string data) -> void {
+  std::lock_guard lock{this->input->mutex};
+  this->input->bytes.assign(data.begin(), data.end());
+  this->input->position = 0;
+  this->input->endOfInput = true;
+}
+
+auto GuestIO::shareInput(const GuestIO& other) -> void {
+  this->input = other.input;
+}
+
+auto GuestIO::afterWrite(bool newLine) -> void {
+  if (this->output.size() >= OUTPUT_THRESHOLD || (newLine && this->lineBuffered)) {
+    this->flush();
+  }
+}
+
+auto GuestIO::writeInt(s32 value) -> void {
+  char digits[16];
+  auto [end, error] = std::to_chars(digits, digits + sizeof(digits), value);
+  this->output.append(digits, end);
+  this->afterWrite(false);
+}
+
+auto GuestIO::writeChar(char value) -> void {
+  this->output.push_back(value);
+  this->afterWrite(value == '\n');
+}
+
+auto GuestIO::writeString(std::string_view value) -> void {
+  this->output.append(value);
+  this->afterWrite(value.contains('\n'));
+}
+
+auto GuestIO::refill() -> bool {
+  Input& input = *this->input;
+  if (input.endOfInput)
+    return false;
+
+  // Keeps whatever wasn't consumed yet
+  input.bytes.erase(input.bytes.begin(), input.bytes.begin() + input.position);
+  input.position = 0;
+
+  size_t kept = input.bytes.size();
+  input.bytes.resize(kept + INPUT_CHUNK);
+
+  ssize_t count;
+  do {
+    count = ::read(STDIN_FILENO, input.bytes.data() + kept, INPUT_CHUNK);
+  } while (count < 0 && errno == EINTR);
+
+  input.bytes.resize(kept + std::max<ssize_t>(count, 0));
+  if (count <= 0) {
+    input.endOfInput = true;
+    return false;
+  }
+  return true;
+}
+
+auto GuestIO::peek() -> int {
+  if (this->input->position == this->input->bytes.size() && !this->refill())
+    return EOF;
+
+  return static_cast<unsigned char>(this->input->bytes[this->input->position]);
+}
+
+auto GuestIO::get() -> int {
+  int c = this->peek();
+  if (c != EOF)
+    this->input->position++;
+  return c;
+}
+
+auto GuestIO::readInt() -> s32 {
+  // The prompt has to show up before we wait for input
+  this->flush();
+  std::lock_guard lock{this->input->mutex};
+  if (this->input->failed)
+    return 0;
+
+  while (std::isspace(this->peek()))
+    this->get();
+
+  bool negative = false;
+  if (this->peek() == '-' || this->peek() == '+') {
+    negative = this->get() == '-';
+  }
+
+  if (!std::isdigit(this->peek())) {
+    this->input->failed = true;
+    return 0;
+  }
+
+  s64 value = 0;
+  bool overflow = false;
+  while (std::isdigit(this->peek())) {
+    value = value * 10 + (this->get() - '0');
+    if (value > s64(std::numeric_limits<s32>::max()) + 1) {
+      overflow = true;
+      value = s64(std::numeric_limits<s32>::max()) + 1;
+    }
+  }
+  value = negative ? -value : value;
+
+  // Out of range values are clamped and fail the stream, as std::cin does
+  if (overflow || value > std::numeric_limits<s32>::max() || value < std::numeric_limits<s32>::min()) {
+    this->input->failed = true;
+    return value < 0 ? std::numeric_limits<s32>::min() : std::numeric_limits<s32>::max();
+  }
+  return static_cast<s32>(value);
+}
+
+auto GuestIO::readChar() -> char {
+  this->flush();
+  std::lock_guard lock{this->input->mutex};
+  if (this->input->failed)
+    return 0;
+
+  while (std::isspace(this->peek()))
+    this->get();
+
+  int c = this->get();
+  if (c == EOF) {
+    this->input->failed = true;
+    return 0;
+  }
+  return static_cast<char>(c);
+}
+
+auto GuestIO::readLine(std::span<char> out) -> void {
+  this->flush();
+  if (out.empty())
+    return;
+
+  std::lock_guard lock{this->input->mutex};
+  size_t count = 0;
+  if (!this->input->failed) {
+    while (count < out.size() - 1) {
+      int c = this->get();
+      if (c == EOF) {
+        this->input->failed = count == 0;
+        break;
+      }
+      if (c == '\n')
+        break;
+      out[count++] = static_cast<char>(c);
+    }
+
+    // Line didn't fit, the delimiter right after is still consumed
+    if (count == out.size() - 1) {
+      if (this->peek() == '\n')
+        this->get();
+      else
+        this->input->failed = true;
+    }
+  }
+  out[count] = '\0';
+}
+
+} // namespace Emulator
@@ -0,0 +1,85 @@
+#pragma once
+
+#include "Config.hpp"
+
+#include <memory>
+#include <mutex>
+
+namespace Emulator {
+
+// Console used by the syscalls. Output is collected in a large buffer and
+// written out when it fills up, before reading input and when the program
+// ends. Input is pulled from stdin in big chunks and parsed in place, harts
+// of the same program read it through one shared buffer
+class GuestIO {
+public:
+  static constexpr size_t OUTPUT_THRESHOLD = 64 << 10;
+  static constexpr size_t INPUT_CHUNK = 64 << 10;
+
+  // Flushes output on every '\n', for interactive use
+  bool lineBuffered = false;
+
+  // Where flushed output goes
+  std::ostream* sink = &std::cout;
+
+  GuestIO();
+  ~GuestIO();
+
+  GuestIO(const GuestIO&) = delete;
+  auto operator=(const GuestIO&) -> GuestIO& = delete;
+
+  // print_int
+  auto writeInt(s32 value) -> void;
+
+  // print_char
+  auto writeChar(char value) -> void;
+
+  // print_string
+  auto writeString(std::string_view value) -> void;
+
+  // read_int, behaves like std::cin >> int
+  auto readInt() -> s32;
+
+  // read_char, behaves like std::cin >> char
+  auto readChar() -> char;
+
+  // read_string, behaves like std::cin.getline(out, size(out))
+  auto readLine(std::span<char> out) -> void;
+
+  // Hands buffered output to the sink
+  auto flush() -> void;
+
+  // Reads from data instead of stdin
+  auto setInput(std::string data) -> void;
+
+  // Reads from the same input as other from now on, each read takes what
+  // the other's left
+  auto shareInput(const GuestIO& other) -> void;
+
+private:
+  // Held while a read parses, so reads from different harts don't interleave
+  struct Input {
+    std::mutex mutex;
+    std::vector<char> bytes;
+    size_t position = 0;
+    bool endOfInput = false;
+    bool failed = false; // Like std::cin, a failed read makes every later read fail
+  };
+
+  std::string output;
+  std::shared_ptr<Input> input;
+
+  // Next input character without consuming it, EOF when input is over
+  auto peek() -> int;
+
+  // Consumes the next input character
+  auto get() -> int;
+
+  // Pulls the next chunk from stdin
+  auto refill() -> bool;
+
+  // Flushes when the buffer is full or the line ended in line-buffered mode
+  auto afterWrite(bool newLine) -> void;
+};
+
+} // namespace Emulator
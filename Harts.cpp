@@ -0,0 +1,153 @@
+#include "Harts.hpp"
+
+#include <ctime>
+
+namespace Emulator {
+
+struct Harts::Hart {
+  CPU cpu;
+  std::exception_ptr error;
+  bool rethrown = false;
+  std::chrono::nanoseconds cpuTime{};
+  std::atomic<bool> done{false};
+
+  // Last, so it's stopped and joined before anything it uses goes away
+  std::jthread thread;
+
+  explicit Hart(std::shared_ptr<Memory> memory) : cpu{std::move(memory)} {}
+};
+
+// CPU time used by the calling thread so far
+static auto threadCpuTime() -> std::chrono::nanoseconds {
+  timespec now;
+  clock_gettime(CLOCK_THREAD_CPUTIME_ID, &now);
+  return std::chrono::seconds{now.tv_sec} + std::chrono::nanoseconds{now.tv_nsec};
+}
+
+Harts::Harts() = default;
+
+Harts::~Harts() {
+  this->stop();
+}
+
+auto Harts::spawn(const CPU& parent, u32 entry, u32 argument, u32 stack) -> u32 {
+  std::lock_guard lock{this->mutex};
+  if (this->stopping || this->harts.size() + 1 >= this->limit)
+    return NONE;
+
+  u32 id = static_cast<u32>(this->harts.size()) + 1;
+  parent.sharedMemory->share();
+  auto hart = std::make_unique<Hart>(parent.sharedMemory);
+
+  CPU& cpu = hart->cpu;
+  cpu.max_size = parent.max_size;
+  cpu.encoding = parent.encoding;
+  cpu.setTextSegment(parent.textStart, parent.textEnd);
+  cpu.io.lineBuffered = parent.io.lineBuffered;
+  cpu.io.sink = parent.io.sink;
+  cpu.io.shareInput(parent.io);
+  cpu.harts = this;
+  cpu.hartId = id;
+  cpu.pc = entry;
+  cpu.registers[4] = argument;
+  cpu.registers[28] = parent.registers[28];
+  cpu.registers[29] = stack != 0 ? stack : parent.max_size - id * STACK_SIZE;
+
+  // Starting the thread orders everything the parent wrote before it
+  hart->thread = std::jthread([this, hart = hart.get()](std::stop_token stop) { this->run(*hart, stop); });
+  this->harts.push_back(std::move(hart));
+  return id;
+}
+
+auto Harts::run(Hart& hart, std::stop_token stop) -> void {
+  auto start = threadCpuTime();
+
+  try {
+    while (!hart.cpu.hasHalted() && !stop.stop_requested()) {
+      this->core(hart.cpu, hart.cpu.retired + QUANTUM);
+    }
+  } catch (...) {
+    hart.error = std::current_exception();
+  }
+  hart.cpu.io.flush();
+  hart.cpuTime = threadCpuTime() - start;
+
+  // Whoever sees done sees everything the hart wrote
+  hart.done.store(true, std::memory_order_release);
+  hart.done.notify_all();
+}
+
+auto Harts::join(const CPU& caller, u32 id) -> void {
+  Hart* hart = nullptr;
+  {
+    std::lock_guard lock{this->mutex};
+    if (id == 0 || id > this->harts.size()) {
+      throw std::runtime_error{std::format("ERROR! There is no hart {}\n", id)};
+    }
+    hart = this->harts[id - 1].get();
+  }
+
+  if (id == caller.hartId) {
+    throw std::runtime_error{std::format("ERROR! Hart {} can't join itself\n", id)};
+  }
+
+  hart->done.wait(false, std::memory_order_acquire);
+
+  std::lock_guard lock{this->mutex};
+  if (hart->error && !hart->rethrown) {
+    hart->rethrown = true;
+    std::rethrow_exception(hart->error);
+  }
+}
+
+auto Harts::stop() -> std::exception_ptr {
+  std::vector<Hart*> running;
+  {
+    // Harts may still spawn others until they see stopping
+    std::lock_guard lock{this->mutex};
+    this->stopping = true;
+    for (auto& hart : this->harts) {
+      hart->thread.request_stop();
+      running.push_back(hart.get());
+    }
+  }
+
+  for (Hart* hart : running) {
+    if (hart->thread.joinable())
+      hart->thread.join();
+  }
+
+  std::lock_guard lock{this->mutex};
+  for (auto& hart : this->harts) {
+    if (hart->error && !hart->rethrown) {
+      hart->rethrown = true;
+      return hart->error;
+    }
+  }
+  return nullptr;
+}
+
+auto Harts::spawned() const -> u32 {
+  std::lock_guard lock{this->mutex};
+  return static_cast<u32>(this->harts.size());
+}
+
+auto Harts::retired() const -> u64 {
+  std::lock_guard lock{this->mutex};
+  u64 retired = 0;
+  for (const auto& hart : this->harts) {
+    retired += hart->cpu.retired;
+  }
+  return retired;
+}
+
+auto Harts::cpuTime() const -> std::chrono::nanoseconds {
+  std::lock_guard lock{this->mutex};
+  std::chrono::nanoseconds time{};
+  for (const auto& hart : this->harts) {
+    time += hart->cpuTime;
+  }
+  return time;
+}
+
+} // namespace Emulator
@@ -0,0 +1,69 @@
+#pragma once
+
+#include "CPU.hpp"
+
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+namespace Emulator {
+
+// The harts a program spawns on top of the one it started on, each running
+// on a host thread of its own over the memory and input of the hart that
+// spawned it. They share nothing else: every hart has its registers, decoded
+// cache, ll/sc reservation and console output, flushed when it exits
+class Harts {
+public:
+  // What spawn_hart returns when no hart is left
+  static constexpr u32 NONE = ~u32(0);
+
+  // Stack a hart gets when it isn't given one, below the stacks of the harts before it
+  static constexpr u32 STACK_SIZE = 1 << 20;
+
+  // Instructions a hart runs between looking for a stop request
+  static constexpr u64 QUANTUM = 1 << 16;
+
+  using Core = auto (*)(CPU& cpu, u64 limit) -> void;
+
+  // Harts a program may start, the one it started on included
+  u32 limit = 1;
+
+  // Runs the spawned harts, the engine picks it
+  Core core = nullptr;
+
+  Harts();
+  ~Harts();
+
+  Harts(const Harts&) = delete;
+  auto operator=(const Harts&) -> Harts& = delete;
+
+  // Starts a hart at entry with argument in $a0 and stack in $sp, 0 for a
+  // stack of its own. Returns its id, or NONE once limit harts were started
+  auto spawn(const CPU& parent, u32 entry, u32 argument, u32 stack) -> u32;
+
+  // Waits until hart id exits, rethrows what stopped it if it failed
+  auto join(const CPU& caller, u32 id) -> void;
+
+  // Stops every hart still running and waits for them. Returns the first
+  // failure no join() rethrew, nullptr if there was none
+  auto stop() -> std::exception_ptr;
+
+  // Harts spawned so far, and once they stopped, the instructions they
+  // retired and the CPU time their threads used
+  auto spawned() const -> u32;
+  auto retired() const -> u64;
+  auto cpuTime() const -> std::chrono::nanoseconds;
+
+private:
+  struct Hart;
+
+  mutable std::mutex mutex;
+  std::vector<std::unique_ptr<Hart>> harts; // Hart id - 1
+  bool stopping = false;
+
+  // Runs hart until it halts or is asked to stop
+  auto run(Hart& hart, std::stop_token stop) -> void;
+};
+
+} // namespace Emulator
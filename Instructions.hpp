@@ -0,0 +1,207 @@
+#pragma once
+
+#include "Config.hpp"
+
+#include <array>
+#include <optional>
+
+namespace Emulator {
+
+enum class Mnemonic : u8 {
+  ADDI, ANDI, ORI, ADD, SUB, AND, OR, NOR, SLL, SRL, SLT, JR, BEQ, BNE, J, JAL, SW, LW, SLTI, LBU, SB, MUL,
+  LL, SC, SYNC,
+  BLT, BGE, MOVE, LI, LA, // Pseudo instructions
+  SYSCALL,
+};
+
+// How an instruction is encoded
+enum class Format : u8 { R, I, J, PSEUDO };
+
+// What the arguments of an instruction are, in source order
+enum class Operands : u8 {
+  RD_RS_RT,     // add $rd, $rs, $rt
+  RD_RT_SHAMT,  // sll $rd, $rt, shamt
+  RS,           // jr $rs
+  RT_RS_IMM,    // addi $rt, $rs, imm
+  RT_RS_LABEL,  // beq $rt, $rs, label (relative to the instruction)
+  RT_OFFSET_RS, // lw $rt, offset($rs)
+  TARGET,       // j label
+  RD_RS,        // move $rd, $rs
+  RT_IMM,       // li $rt, imm
+  NONE,         // syscall, sync
+};
+
+struct InstructionInfo {
+  std::string_view name;
+  Format format;
+  u8 opcode;
+  u8 funct;
+  Operands operands;
+  u8 argsSize;
+};
+
+// Maps each of a fixed set of names to its index with one hash and one
+// comparison. The seed is searched for at compile time until no two names
+// share a slot
+template <size_t N, size_t SLOTS = 128>
+class PerfectHash {
+public:
+  static_assert(N < 0xFF && (SLOTS & (SLOTS - 1)) == 0);
+
+  consteval PerfectHash(const std::array<std::string_view, N>& names) : names{names} {
+    for (this->seed = 1;; this->seed++) {
+      this->slots.fill(EMPTY);
+
+      bool unique = true;
+      for (size_t i = 0; i < N && unique; i++) {
+        u8& slot = this->slots[hash(names[i], this->seed) & (SLOTS - 1)];
+        unique = slot == EMPTY;
+        slot = static_cast<u8>(i);
+      }
+
+      if (unique)
+        return;
+    }
+  }
+
+  // Index of name, or -1 when it isn't one of the names
+  constexpr auto find(std::string_view name) const -> int {
+    u8 slot = this->slots[hash(name, this->seed) & (SLOTS - 1)];
+    return slot != EMPTY && this->names[slot] == name ? slot : -1;
+  }
+
+private:
+  static constexpr u8 EMPTY = 0xFF;
+
+  std::array<std::string_view, N> names;
+  std::array<u8, SLOTS> slots{};
+  u32 seed = 0;
+
+  // FNV-1a mixed with the seed
+  static constexpr auto hash(std::string_view name, u32 seed) -> u32 {
+    u32 hash = 0x811C9DC5 ^ (seed * 0x9E3779B9);
+    for (char c : name) {
+      hash = (hash ^ static_cast<u8>(c)) * 0x01000193;
+    }
+    return hash ^ (hash >> 15);
+  }
+};
+
+namespace Instructions {
+
+// Number of arguments written in the source
+constexpr auto argumentsOf(Operands operands) -> u8 {
+  switch (operands) {
+    case Operands::RS:
+    case Operands::TARGET: return 1;
+    case Operands::RD_RS:
+    case Operands::RT_IMM: return 2;
+    case Operands::NONE:   return 0;
+    default:               return 3;
+  }
+}
+
+constexpr auto describe(std::string_view name, Format format, u8 opcode, u8 funct, Operands operands)
+    -> InstructionInfo {
+  return {name, format, opcode, funct, operands, argumentsOf(operands)};
+}
+
+// Everything the assembler knows about each mnemonic, in Mnemonic order
+inline constexpr std::array table = {
+  describe("addi", Format::I, 0x08, 0x00, Operands::RT_RS_IMM),
+  describe("andi", Format::I, 0x0C, 0x00, Operands::RT_RS_IMM),
+  describe("ori" , Format::I, 0x0D, 0x00, Operands::RT_RS_IMM),
+  describe("add" , Format::R, 0x00, 0x20, Operands::RD_RS_RT),
+  describe("sub" , Format::R, 0x00, 0x22, Operands::RD_RS_RT),
+  describe("and" , Format::R, 0x00, 0x24, Operands::RD_RS_RT),
+  describe("or"  , Format::R, 0x00, 0x25, Operands::RD_RS_RT),
+  describe("nor" , Format::R, 0x00, 0x27, Operands::RD_RS_RT),
+  describe("sll" , Format::R, 0x00, 0x00, Operands::RD_RT_SHAMT),
+  describe("srl" , Format::R, 0x00, 0x02, Operands::RD_RT_SHAMT),
+  describe("slt" , Format::R, 0x00, 0x2A, Operands::RD_RS_RT),
+  describe("jr"  , Format::R, 0x00, 0x08, Operands::RS),
+  describe("beq" , Format::I, 0x04, 0x00, Operands::RT_RS_LABEL),
+  describe("bne" , Format::I, 0x05, 0x00, Operands::RT_RS_LABEL),
+  describe("j"   , Format::J, 0x02, 0x00, Operands::TARGET),
+  describe("jal" , Format::J, 0x03, 0x00, Operands::TARGET),
+  describe("sw"  , Format::I, 0x2B, 0x00, Operands::RT_OFFSET_RS),
+  describe("lw"  , Format::I, 0x23, 0x00, Operands::RT_OFFSET_RS),
+  describe("slti", Format::I, 0x0A, 0x00, Operands::RT_RS_IMM),
+  describe("lbu" , Format::I, 0x24, 0x00, Operands::RT_OFFSET_RS),
+  describe("sb"  , Format::I, 0x28, 0x00, Operands::RT_OFFSET_RS),
+  describe("mul" , Format::R, 0x00, 0x01, Operands::RD_RS_RT), // Not MIPS32, the CPU has it as funct 0x01
+  describe("ll"  , Format::I, 0x30, 0x00, Operands::RT_OFFSET_RS),
+  describe("sc"  , Format::I, 0x38, 0x00, Operands::RT_OFFSET_RS),
+  describe("sync", Format::R, 0x00, 0x0F, Operands::NONE),
+  // Pseudo instructions, blt and bge have opcodes of their own in the CPU
+  describe("blt" , Format::I, 0x06, 0x00, Operands::RT_RS_LABEL),
+  describe("bge" , Format::I, 0x07, 0x00, Operands::RT_RS_LABEL),
+  describe("move", Format::PSEUDO, 0x00, 0x20, Operands::RD_RS),  // add $rd, $rs, $zero
+  describe("li"  , Format::PSEUDO, 0x08, 0x00, Operands::RT_IMM), // addi $rt, $zero, imm
+  describe("la"  , Format::PSEUDO, 0x08, 0x00, Operands::RT_IMM), // addi $rt, $zero, label
+  describe("syscall", Format::R, 0x00, 0x0C, Operands::NONE),
+};
+
+static_assert(table.size() == static_cast<size_t>(Mnemonic::SYSCALL) + 1);
+
+inline constexpr std::array<std::string_view, 32> registerNames = {
+  "$zero", "$at", "$v0", "$v1", "$a0", "$a1", "$a2", "$a3",
+  "$t0"  , "$t1", "$t2", "$t3", "$t4", "$t5", "$t6", "$t7",
+  "$s0"  , "$s1", "$s2", "$s3", "$s4", "$s5", "$s6", "$s7",
+  "$t8"  , "$t9", "$k0", "$k1", "$gp", "$sp", "$fp", "$ra",
+};
+
+// Names of the table, in Mnemonic order
+constexpr auto mnemonicNames() -> std::array<std::string_view, table.size()> {
+  std::array<std::string_view, table.size()> names{};
+  for (size_t i = 0; i < table.size(); i++) {
+    names[i] = table[i].name;
+  }
+  return names;
+}
+
+// FNV-1a of everything in the table, so what was cached from one encoding
+// goes stale as soon as the table changes
+constexpr auto fingerprint() -> u64 {
+  u64 hash = 0xCBF29CE484222325;
+  auto mix = [&hash](u8 byte) { hash = (hash ^ byte) * 0x100000001B3; };
+
+  for (const InstructionInfo& info : table) {
+    for (char c : info.name) {
+      mix(static_cast<u8>(c));
+    }
+    mix(0);
+    mix(static_cast<u8>(info.format));
+    mix(info.opcode);
+    mix(info.funct);
+    mix(static_cast<u8>(info.operands));
+  }
+  return hash;
+}
+
+inline constexpr PerfectHash<table.size()> mnemonics(mnemonicNames());
+inline constexpr PerfectHash<registerNames.size()> registers(registerNames);
+
+// Descriptor of a mnemonic
+constexpr auto info(Mnemonic mnemonic) -> const InstructionInfo& {
+  return table[static_cast<size_t>(mnemonic)];
+}
+
+// Mnemonic named name, nullopt when there is none
+constexpr auto find(std::string_view name) -> std::optional<Mnemonic> {
+  int index = mnemonics.find(name);
+  return index < 0 ? std::nullopt : std::optional{static_cast<Mnemonic>(index)};
+}
+
+// Number of a register given by name ($t0), -1 when there is none
+constexpr auto findRegister(std::string_view name) -> int {
+  return registers.find(name);
+}
+
+static_assert(find("addi") == Mnemonic::ADDI && find("la") == Mnemonic::LA && find("syscall") == Mnemonic::SYSCALL &&
+              !find("addu"));
+static_assert(findRegister("$zero") == 0 && findRegister("$ra") == 31 && findRegister("$t10") == -1);
+
+} // namespace Instructions
+
+} // namespace Emulator
@@ -0,0 +1,465 @@
+#include "Jit.hpp"
+
+#include <cstring>
+#include <sys/mman.h>
+
+namespace Emulator {
+
+#if defined(__x86_64__)
+
+// Exceptions can't unwind through generated code, helpers park them here
+static thread_local std::exception_ptr pending;
+
+// Helpers called from generated code. Loads return the value in the low
+// half and 1 in the high half on failure. Stores return 0 on success, 1 on
+// failure and 2 when they rewrote the text segment
+static auto helperLoadWord(CPU* cpu, u32 address) -> u64 {
+  try {
+    return cpu->readWord(address);
+  } catch (...) {
+    pending = std::current_exception();
+    return u64(1) << 32;
+  }
+}
+
+static auto helperLoadByte(CPU* cpu, u32 address) -> u64 {
+  try {
+    return cpu->memory.read(address);
+  } catch (...) {
+    pending = std::current_exception();
+    return u64(1) << 32;
+  }
+}
+
+static auto helperStoreWord(CPU* cpu, u32 address, u32 value) -> u32 {
+  u64 generation = cpu->textGeneration;
+  try {
+    cpu->writeWord(address, value);
+  } catch (...) {
+    pending = std::current_exception();
+    return 1;
+  }
+  return cpu->textGeneration != generation ? 2 : 0;
+}
+
+static auto helperStoreByte(CPU* cpu, u32 address, u32 value) -> u32 {
+  u64 generation = cpu->textGeneration;
+  try {
+    cpu->writeMemory(address, static_cast<u8>(value));
+  } catch (...) {
+    pending = std::current_exception();
+    return 1;
+  }
+  return cpu->textGeneration != generation ? 2 : 0;
+}
+
+// Raw x86-64 encoder, only what the translation below needs
+// eax and ecx are scratch, rbx points to the guest registers, r12 to the
+// CPU and r13 to the fuel left
+class Emitter {
+public:
+  std::vector<u8> code;
+  std::vector<size_t> exits;                  // rel32 fields to patch with the epilogue
+  std::vector<std::pair<size_t, u32>> chains; // rel32 fields that may jump straight to another block
+
+  auto byte(u8 value) -> void { this->code.push_back(value); }
+
+  auto bytes(std::initializer_list<u8> values) -> void {
+    this->code.insert(this->code.end(), values);
+  }
+
+  auto imm32(u32 value) -> void {
+    for (u32 i = 0; i < 4; i++) {
+      this->byte(static_cast<u8>(value >> i * 8));
+    }
+  }
+
+  auto imm64(u64 value) -> void {
+    this->imm32(static_cast<u32>(value));
+    this->imm32(static_cast<u32>(value >> 32));
+  }
+
+  // mov eax/ecx/edx, [rbx + reg * 4]
+  auto loadEax(u32 reg) -> void { this->bytes({0x8B, 0x43, static_cast<u8>(reg * 4)}); }
+  auto loadEcx(u32 reg) -> void { this->bytes({0x8B, 0x4B, static_cast<u8>(reg * 4)}); }
+  auto loadEdx(u32 reg) -> void { this->bytes({0x8B, 0x53, static_cast<u8>(reg * 4)}); }
+
+  // mov [rbx + reg * 4], eax, writes to $zero are dropped
+  auto storeEax(u32 reg) -> void {
+    if (reg != 0)
+      this->bytes({0x89, 0x43, static_cast<u8>(reg * 4)});
+  }
+
+  // mov eax, value
+  auto movEax(u32 value) -> void { this->byte(0xB8); this->imm32(value); }
+
+  // mov edx, value
+  auto movEdx(u32 value) -> void { this->byte(0xBA); this->imm32(value); }
+
+  // setb al; movzx eax, al
+  auto setBelow() -> void { this->bytes({0x0F, 0x92, 0xC0, 0x0F, 0xB6, 0xC0}); }
+
+  // Calls a helper with rdi = cpu, esi = eax, edx already set
+  auto call(const void* helper) -> void {
+    this->bytes({0x4C, 0x89, 0xE7});       // mov rdi, r12
+    this->bytes({0x89, 0xC6});             // mov esi, eax
+    this->bytes({0x48, 0xB8});             // mov rax, helper
+    this->imm64(reinterpret_cast<u64>(helper));
+    this->bytes({0xFF, 0xD0});             // call rax
+  }
+
+  // Jumps to the epilogue, eax holds the next pc
+  auto exit() -> void {
+    this->byte(0xE9);
+    this->exits.push_back(this->code.size());
+    this->imm32(0);
+  }
+
+  // Leaves for a pc known now. Once the block at pc is compiled the jump
+  // goes straight into its code instead of back to the dispatcher
+  auto exitTo(u32 pc) -> void {
+    this->movEax(pc);
+    this->byte(0xE9);
+    this->chains.emplace_back(this->code.size(), pc);
+    this->imm32(0);
+  }
+
+  // add qword [r13], value
+  auto refuel(u32 value) -> void {
+    this->bytes({0x49, 0x81, 0x45, 0x00});
+    this->imm32(value);
+  }
+
+  // Fuel is taken for the whole block on entry, leaving early gives back
+  // what the instructions that didn't run had paid for. unpaid counts the
+  // instruction that failed and everything after it
+
+  // After a store helper: eax = 1 -> leave at pc, eax = 2 -> leave at pc + 4
+  auto checkStore(u32 pc, u32 unpaid) -> void {
+    this->bytes({0x85, 0xC0});             // test eax, eax
+    this->bytes({0x74, 0x17});             // jz +23
+    this->byte(0xB9);                      // mov ecx, unpaid + 1
+    this->imm32(unpaid + 1);
+    this->bytes({0x29, 0xC1});             // sub ecx, eax
+    this->bytes({0x49, 0x01, 0x4D, 0x00}); // add [r13], rcx
+    this->bytes({0x8D, 0x04, 0x85});       // lea eax, [rax * 4 + pc - 4]
+    this->imm32(pc - 4);
+    this->exit();
+  }
+
+  // After a load helper: leave at pc when the high half is set
+  auto checkLoad(u32 pc, u32 unpaid) -> void {
+    this->bytes({0x48, 0x89, 0xC2});       // mov rdx, rax
+    this->bytes({0x48, 0xC1, 0xEA, 0x20}); // shr rdx, 32
+    this->bytes({0x74, 0x12});             // jz +18
+    this->refuel(unpaid);
+    this->movEax(pc);
+    this->exit();
+  }
+};
+
+// Emits a single instruction, returns false when it has to be interpreted.
+// unpaid is how many compiled instructions are left counting this one
+static auto emitOp(Emitter& e, const DecodedOp& op, u32 pc, u32 unpaid) -> bool {
+  switch (op.kind) {
+    case Op::SLL:
+      e.loadEax(op.rt);
+      e.bytes({0xC1, 0xE0, op.shamt});      // shl eax, shamt
+      e.storeEax(op.rd);
+      return true;
+
+    case Op::SRL:
+      e.loadEax(op.rt);
+      e.bytes({0xC1, 0xE8, op.shamt});      // shr eax, shamt
+      e.storeEax(op.rd);
+      return true;
+
+    case Op::MUL:
+      e.loadEax(op.rs);
+      e.loadEcx(op.rt);
+      e.bytes({0x0F, 0xAF, 0xC1});          // imul eax, ecx
+      e.storeEax(op.rd);
+      return true;
+
+    case Op::ADD:
+    case Op::SUB:
+    case Op::AND:
+    case Op::OR:
+    case Op::NOR:
+      e.loadEax(op.rs);
+      e.loadEcx(op.rt);
+      switch (op.kind) {
+        case Op::ADD: e.bytes({0x01, 0xC8}); break;             // add eax, ecx
+        case Op::SUB: e.bytes({0x29, 0xC8}); break;             // sub eax, ecx
+        case Op::AND: e.bytes({0x21, 0xC8}); break;             // and eax, ecx
+        case Op::OR:  e.bytes({0x09, 0xC8}); break;             // or eax, ecx
+        default:      e.bytes({0x09, 0xC8, 0xF7, 0xD0}); break; // or eax, ecx; not eax
+      }
+      e.storeEax(op.rd);
+      return true;
+
+    case Op::SLT:
+      e.loadEax(op.rs);
+      e.loadEcx(op.rt);
+      e.bytes({0x39, 0xC8});                // cmp eax, ecx
+      e.setBelow();
+      e.storeEax(op.rd);
+      return true;
+
+    case Op::NOP:
+      return true;
+
+    case Op::ADDI:
+      e.loadEax(op.rs);
+      e.byte(0x05); e.imm32(u32(op.imm));   // add eax, imm
+      e.storeEax(op.rt);
+      return true;
+
+    case Op::SLTI:
+      e.loadEax(op.rs);
+      e.byte(0x3D); e.imm32(u32(op.imm));   // cmp eax, imm
+      e.setBelow();
+      e.storeEax(op.rt);
+      return true;
+
+    case Op::ANDI:
+      e.loadEax(op.rs);
+      e.byte(0x25); e.imm32(u32(op.imm));   // and eax, imm
+      e.storeEax(op.rt);
+      return true;
+
+    case Op::ORI:
+      e.loadEax(op.rs);
+      e.byte(0x0D); e.imm32(u32(op.imm));   // or eax, imm
+      e.storeEax(op.rt);
+      return true;
+
+    case Op::LW:
+    case Op::LBU:
+      e.loadEax(op.rs);
+      e.byte(0x05); e.imm32(u32(op.imm));   // add eax, imm
+      e.call(reinterpret_cast<const void*>(op.kind == Op::LW ? helperLoadWord : helperLoadByte));
+      e.checkLoad(pc, unpaid);
+      e.storeEax(op.rt);
+      return true;
+
+    case Op::SW:
+      e.loadEax(op.rs);
+      e.byte(0x05); e.imm32(u32(op.imm));   // add eax, imm
+      e.loadEdx(op.rt);
+      e.call(reinterpret_cast<const void*>(helperStoreWord));
+      e.checkStore(pc, unpaid);
+      return true;
+
+    case Op::SB:
+      e.loadEax(op.rt);
+      e.byte(0x05); e.imm32(u32(op.imm));   // add eax, imm
+      e.loadEdx(op.rs);
+      e.call(reinterpret_cast<const void*>(helperStoreByte));
+      e.checkStore(pc, unpaid);
+      return true;
+
+    case Op::BEQ:
+    case Op::BNE:
+    case Op::BLT:
+    case Op::BGE:
+      // blt/bge compare rt against rs
+      if (op.kind == Op::BLT || op.kind == Op::BGE) {
+        e.loadEax(op.rt);
+        e.loadEcx(op.rs);
+      } else {
+        e.loadEax(op.rs);
+        e.loadEcx(op.rt);
+      }
+      e.bytes({0x39, 0xC8});                // cmp eax, ecx
+      switch (op.kind) {
+        case Op::BEQ: e.bytes({0x0F, 0x84}); break;            // je taken
+        case Op::BNE: e.bytes({0x0F, 0x85}); break;            // jne taken
+        case Op::BLT: e.bytes({0x0F, 0x8C}); break;            // jl taken
+        default:      e.bytes({0x0F, 0x8D}); break;            // jge taken
+      }
+      e.imm32(10);                          // skips the not taken exit
+      e.exitTo(pc + 4);
+      e.exitTo(op.target);
+      return true;
+
+    case Op::J:
+      e.exitTo(op.target);
+      return true;
+
+    case Op::JAL:
+      e.bytes({0xC7, 0x43, 31 * 4});        // mov [rbx + 124], pc + 8
+      e.imm32(pc + 8);
+      e.exitTo(op.target);
+      return true;
+
+    case Op::JR:
+      e.loadEax(op.rs);
+      e.bytes({0x83, 0xE8, 0x04});          // sub eax, 4
+      e.exit();
+      return true;
+
+    default:
+      return false;
+  }
+}
+
+Jit::~Jit() {
+  if (this->buffer != nullptr) {
+    munmap(this->buffer, BUFFER_SIZE);
+  }
+}
+
+// Syscalls, atomics, unknown instructions and the kinds only MIPS32 words
+// decode to (SRA on) are left to the dispatcher
+static auto isCompiled(const DecodedOp& op) -> bool {
+  return op.kind < Op::SRA && op.kind != Op::SYSCALL && op.kind != Op::LL && op.kind != Op::SC &&
+         op.kind != Op::SYNC;
+}
+
+auto Jit::compile(Block& block) -> void {
+  // Instructions run natively, the block is cut at the first one that isn't
+  u32 compiled = 0;
+  while (compiled < block.ops.size() && isCompiled(block.ops[compiled]))
+    compiled++;
+
+  // Nothing worth running natively
+  if (compiled == 0)
+    return;
+
+  Emitter e;
+  e.bytes({0x53});                          // push rbx
+  e.bytes({0x41, 0x54});                    // push r12
+  e.bytes({0x41, 0x55});                    // push r13 (keeps rsp aligned for helpers)
+  e.bytes({0x48, 0x89, 0xFB});              // mov rbx, rdi
+  e.bytes({0x49, 0x89, 0xF4});              // mov r12, rsi
+  e.bytes({0x49, 0x89, 0xD5});              // mov r13, rdx
+
+  // Chained blocks jump here, past the prologue of whoever was entered first
+  size_t body = e.code.size();
+
+  // Pays for the whole block upfront, leaves without running anything
+  // when there isn't enough fuel
+  e.bytes({0x49, 0x81, 0x6D, 0x00});        // sub qword [r13], compiled
+  e.imm32(compiled);
+  e.bytes({0x0F, 0x8C});                    // jl empty
+  size_t empty = e.code.size();
+  e.imm32(0);
+
+  u32 length = 0;
+  bool exited = false;
+  for (const DecodedOp& op : block.ops) {
+    u32 pc = block.start + length * 4;
+
+    if (!emitOp(e, op, pc, compiled - length)) {
+      e.movEax(pc);
+      e.exit();
+      exited = true;
+      break;
+    }
+    length++;
+
+    if (op.kind == Op::BEQ || op.kind == Op::BNE || op.kind == Op::BLT || op.kind == Op::BGE ||
+        op.kind == Op::J || op.kind == Op::JAL || op.kind == Op::JR) {
+      exited = true;
+      break;
+    }
+  }
+
+  // Block ran off the end of the text segment
+  if (!exited) {
+    e.movEax(block.fallthroughPc);
+    e.exit();
+  }
+
+  size_t epilogue = e.code.size();
+  e.bytes({0x41, 0x5D});                    // pop r13
+  e.bytes({0x41, 0x5C});                    // pop r12
+  e.bytes({0x5B});                          // pop rbx
+  e.bytes({0xC3});                          // ret
+
+  // Out of fuel, gives it back and leaves at the start of the block
+  u32 rel = static_cast<u32>(e.code.size() - (empty + 4));
+  std::memcpy(e.code.data() + empty, &rel, sizeof(rel));
+  e.refuel(compiled);
+  e.movEax(block.start);
+  e.exit();
+
+  if (this->buffer == nullptr) {
+    void* memory = mmap(nullptr, BUFFER_SIZE, PROT_READ | PROT_EXEC,
+                        MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (memory == MAP_FAILED)
+      return;
+    this->buffer = static_cast<u8*>(memory);
+  }
+
+  if (this->used + e.code.size() > BUFFER_SIZE)
+    return;
+
+  u8* code = this->buffer + this->used;
+  auto patch = [](u8* field, const u8* destination) {
+    u32 rel = static_cast<u32>(destination - (field + 4));
+    std::memcpy(field, &rel, sizeof(rel));
+  };
+
+  // The buffer is only writable while code is being copied in and linked
+  if (mprotect(this->buffer, BUFFER_SIZE, PROT_READ | PROT_WRITE) != 0)
+    return;
+
+  std::memcpy(code, e.code.data(), e.code.size());
+  this->bodies[block.start] = code + body;
+
+  for (size_t at : e.exits) {
+    patch(code + at, code + epilogue);
+  }
+
+  for (const auto& [at, pc] : e.chains) {
+    auto it = this->bodies.find(pc);
+    if (it != this->bodies.end()) {
+      patch(code + at, it->second);
+    } else {
+      patch(code + at, code + epilogue);
+      this->unlinked[pc].push_back(code + at);
+    }
+  }
+
+  // Exits of older blocks waiting for this one
+  auto waiting = this->unlinked.find(block.start);
+  if (waiting != this->unlinked.end()) {
+    for (u8* field : waiting->second) {
+      patch(field, code + body);
+    }
+    this->unlinked.erase(waiting);
+  }
+
+  if (mprotect(this->buffer, BUFFER_SIZE, PROT_READ | PROT_EXEC) != 0) {
+    throw std::runtime_error{std::format("ERROR! Couldn't protect the JIT buffer\n")};
+  }
+
+  block.native = reinterpret_cast<NativeBlock>(code);
+  this->used += e.code.size();
+}
+
+auto Jit::reset() -> void {
+  this->used = 0;
+  this->bodies.clear();
+  this->unlinked.clear();
+}
+
+auto Jit::rethrowPending() -> void {
+  if (pending) {
+    std::rethrow_exception(std::exchange(pending, nullptr));
+  }
+}
+
+#else
+
+// No backend for this host, every block stays interpreted
+Jit::~Jit() = default;
+auto Jit::compile(Block& block) -> void {}
+auto Jit::reset() -> void {}
+auto Jit::rethrowPending() -> void {}
+
+#endif
+
+} // namespace Emulator
@@ -0,0 +1,50 @@
+#pragma once
+
+#include "BlockCache.hpp"
+
+#include <exception>
+#include <unordered_map>
+
+namespace Emulator {
+
+// Translates hot blocks into x86-64 code. Guest registers stay in
+// CPU::registers and are addressed through a pinned pointer (rbx), memory
+// accesses call back into the CPU, syscalls are left to the interpreter.
+// Static exits are linked straight to the code of their successor, so hot
+// loops run without going back to the dispatcher
+class Jit {
+public:
+  // Executions before a block gets compiled
+  static constexpr u64 HOT_THRESHOLD = 64;
+
+  // Size of the executable buffer
+  static constexpr size_t BUFFER_SIZE = 16 << 20;
+
+  Jit() = default;
+  ~Jit();
+
+  Jit(const Jit&) = delete;
+  auto operator=(const Jit&) -> Jit& = delete;
+
+  // Fills block.native, leaves it untouched when the block has nothing
+  // to compile or the buffer is full
+  auto compile(Block& block) -> void;
+
+  // Forgets every compiled block
+  auto reset() -> void;
+
+  // Rethrows an exception raised by the CPU while running host code
+  auto rethrowPending() -> void;
+
+private:
+  u8* buffer = nullptr;
+  size_t used = 0;
+
+  // Code of each compiled block, past its prologue
+  std::unordered_map<u32, u8*> bodies;
+
+  // Jumps waiting for the block at a pc to be compiled
+  std::unordered_map<u32, std::vector<u8*>> unlinked;
+};
+
+} // namespace Emulator
@@ -0,0 +1,304 @@
+#include "Memory.hpp"
+
+#include <algorithm>
+#include <bit>
+#include <cstring>
+#include <thread>
+
+namespace Emulator {
+
+static constexpr u64 OFFSET_MASK = Memory::PAGE_SIZE - 1;
+
+Memory::Memory() {
+  this->directory.fill(nullptr);
+  this->pages = 0;
+}
+
+Memory::~Memory() {
+  for (auto table : this->directory) {
+    if (table == nullptr)
+      continue;
+
+    for (u32 i = 0; i < TABLE_SIZE; i++) {
+      if (!this->isBorrowed(table[i]))
+        delete[] table[i];
+    }
+    delete[] table;
+  }
+}
+
+// Entries are published with a release store once what they point to is
+// zeroed, so a thread that sees one also sees a zeroed table or page
+auto Memory::findPage(u64 address) -> u8* {
+  u8**& entry = this->directory[(address >> (PAGE_BITS + TABLE_BITS)) & (TABLE_SIZE - 1)];
+  u8** table = std::atomic_ref(entry).load(std::memory_order_acquire);
+  if (table == nullptr)
+    return nullptr;
+
+  return std::atomic_ref(table[(address >> PAGE_BITS) & (TABLE_SIZE - 1)]).load(std::memory_order_acquire);
+}
+
+auto Memory::commitPage(u64 address) -> u8* {
+  std::atomic_ref entry(this->directory[(address >> (PAGE_BITS + TABLE_BITS)) & (TABLE_SIZE - 1)]);
+  u8** table = entry.load(std::memory_order_acquire);
+  if (table == nullptr) {
+    u8** fresh = new u8*[TABLE_SIZE]();
+    if (entry.compare_exchange_strong(table, fresh, std::memory_order_acq_rel))
+      table = fresh;
+    else
+      delete[] fresh;
+  }
+
+  std::atomic_ref slot(table[(address >> PAGE_BITS) & (TABLE_SIZE - 1)]);
+  u8* page = slot.load(std::memory_order_acquire);
+  if (page == nullptr) {
+    u8* fresh = new u8[PAGE_SIZE]();
+    if (slot.compare_exchange_strong(page, fresh, std::memory_order_acq_rel)) {
+      page = fresh;
+      std::atomic_ref(this->pages).fetch_add(1, std::memory_order_relaxed);
+    } else {
+      delete[] fresh;
+    }
+  }
+
+  return page;
+}
+
+auto Memory::read(u64 address) -> u8 {
+  if (address >= ADDRESS_SPACE) {
+    throw std::runtime_error{
+      std::format("ERROR! Address {} is bigger than 32 bits addres space\n", address)
+    };
+  }
+
+  u8* page = this->findPage(address);
+  if (page == nullptr)
+    return 0;
+
+  if (this->shared.load(std::memory_order_relaxed))
+    return std::atomic_ref(page[address & OFFSET_MASK]).load(std::memory_order_relaxed);
+  return page[address & OFFSET_MASK];
+}
+
+auto Memory::write(u64 address, u8 value) -> void {
+  if (address >= ADDRESS_SPACE) {
+    throw std::runtime_error{
+      std::format("ERROR! Address {} is bigger than 32 bits addres space\n", address)
+    };
+  }
+
+  u8* data = this->commitPage(address) + (address & OFFSET_MASK);
+  if (!this->shared.load(std::memory_order_relaxed)) {
+    *data = value;
+    return;
+  }
+
+  std::atomic<u32>& line = this->lockLine(address);
+  std::atomic_ref(*data).store(value, std::memory_order_relaxed);
+  line.fetch_add(1, std::memory_order_release);
+}
+
+auto Memory::readHalf(u32 address) -> u16 {
+  // Fast path, both bytes are in the same page and no other hart writes them
+  if ((address & OFFSET_MASK) <= PAGE_SIZE - sizeof(u16) && !this->shared.load(std::memory_order_relaxed)) {
+    u8* page = this->findPage(address);
+    if (page == nullptr)
+      return 0;
+
+    u8* data = page + (address & OFFSET_MASK);
+    return u16(data[0] << 0) | u16(data[1] << 8);
+  }
+
+  return u16(this->read(address) << 0) | u16(this->read(address + 1) << 8);
+}
+
+auto Memory::readWord(u32 address) -> u32 {
+  static_assert(std::endian::native == std::endian::little, "Guest words are stored little-endian");
+
+  bool shared = this->shared.load(std::memory_order_relaxed);
+  if (shared && address % 4 == 0) {
+    u8* page = this->findPage(address);
+    if (page == nullptr)
+      return 0;
+
+    return std::atomic_ref(*reinterpret_cast<u32*>(page + (address & OFFSET_MASK))).load(std::memory_order_relaxed);
+  }
+
+  // Fast path, the whole word is in the same page
+  if ((address & OFFSET_MASK) <= PAGE_SIZE - sizeof(u32) && !shared) {
+    u8* page = this->findPage(address);
+    if (page == nullptr)
+      return 0;
+
+    u8* data = page + (address & OFFSET_MASK);
+    return u32(data[0] <<  0) | u32(data[1] <<  8) |
+           u32(data[2] << 16) | u32(data[3] << 24);
+  }
+
+  return u32(this->read(address + 0) <<  0) | u32(this->read(address + 1) <<  8) |
+         u32(this->read(address + 2) << 16) | u32(this->read(address + 3) << 24);
+}
+
+auto Memory::writeWord(u32 address, u32 value) -> void {
+  bool shared = this->shared.load(std::memory_order_relaxed);
+  if (shared && address % 4 == 0) {
+    u8* data = this->commitPage(address) + (address & OFFSET_MASK);
+    std::atomic<u32>& line = this->lockLine(address);
+    std::atomic_ref(*reinterpret_cast<u32*>(data)).store(value, std::memory_order_relaxed);
+    line.fetch_add(1, std::memory_order_release);
+    return;
+  }
+
+  if ((address & OFFSET_MASK) <= PAGE_SIZE - sizeof(u32) && !shared) {
+    u8* data = this->commitPage(address) + (address & OFFSET_MASK);
+    data[0] = static_cast<u8>(value >>  0);
+    data[1] = static_cast<u8>(value >>  8);
+    data[2] = static_cast<u8>(value >> 16);
+    data[3] = static_cast<u8>(value >> 24);
+    return;
+  }
+
+  // Unaligned words of a shared memory go byte by byte, like on real
+  // hardware they aren't atomic
+  for (u32 i = 0; i < sizeof(u32); i++) {
+    this->write(address + i, static_cast<u8>(value >> i * 8));
+  }
+}
+
+auto Memory::share() -> void {
+  this->shared.store(true, std::memory_order_relaxed);
+}
+
+auto Memory::lockLine(u64 address) -> std::atomic<u32>& {
+  std::atomic<u32>& line = this->reservations[(address >> LINE_BITS) % RESERVATIONS];
+  while (true) {
+    u32 stamp = line.load(std::memory_order_relaxed);
+    if ((stamp & 1) == 0 &&
+        line.compare_exchange_weak(stamp, stamp + 1, std::memory_order_acquire, std::memory_order_relaxed))
+      return line;
+    std::this_thread::yield();
+  }
+}
+
+auto Memory::loadLinked(u32 address, u32& reservation) -> u32 {
+  std::atomic<u32>& line = this->reservations[(address >> LINE_BITS) % RESERVATIONS];
+
+  // Taken before the word is read, so a store in between breaks it
+  reservation = line.load(std::memory_order_acquire);
+  while ((reservation & 1) != 0) {
+    std::this_thread::yield();
+    reservation = line.load(std::memory_order_acquire);
+  }
+
+  u8* data = this->commitPage(address) + (address & OFFSET_MASK);
+  return std::atomic_ref(*reinterpret_cast<u32*>(data)).load(std::memory_order_acquire);
+}
+
+auto Memory::storeConditional(u32 address, u32 value, u32 reservation) -> bool {
+  std::atomic<u32>& line = this->reservations[(address >> LINE_BITS) % RESERVATIONS];
+  u8* data = this->commitPage(address) + (address & OFFSET_MASK);
+
+  // Holding the line with the stamp ll saw proves nothing stored to it since
+  u32 expected = reservation;
+  if (!line.compare_exchange_strong(expected, reservation + 1, std::memory_order_acquire, std::memory_order_relaxed))
+    return false;
+
+  std::atomic_ref(*reinterpret_cast<u32*>(data)).store(value, std::memory_order_relaxed);
+  line.fetch_add(1, std::memory_order_release);
+  return true;
+}
+
+auto Memory::readBlock(u64 address, std::span<u8> out) -> void {
+  if (address + out.size() > ADDRESS_SPACE) {
+    throw std::runtime_error{
+      std::format("ERROR! Address {} is bigger than 32 bits addres space\n", address + out.size())
+    };
+  }
+
+  if (this->shared.load(std::memory_order_relaxed)) {
+    for (size_t i = 0; i < out.size(); i++) {
+      out[i] = this->read(address + i);
+    }
+    return;
+  }
+
+  // Copies page by page, untouched pages are read as zeros
+  size_t done = 0;
+  while (done < out.size()) {
+    u64 offset = (address + done) & OFFSET_MASK;
+    size_t chunk = std::min<size_t>(PAGE_SIZE - offset, out.size() - done);
+    u8* page = this->findPage(address + done);
+
+    if (page == nullptr)
+      std::memset(out.data() + done, 0, chunk);
+    else
+      std::memcpy(out.data() + done, page + offset, chunk);
+
+    done += chunk;
+  }
+}
+
+auto Memory::writeBlock(u64 address, std::span<const u8> value) -> void {
+  if (address + value.size() > ADDRESS_SPACE) {
+    throw std::runtime_error{
+      std::format("ERROR! Address {} is bigger than 32 bits addres space\n", address + value.size())
+    };
+  }
+
+  if (this->shared.load(std::memory_order_relaxed)) {
+    for (size_t i = 0; i < value.size(); i++) {
+      this->write(address + i, value[i]);
+    }
+    return;
+  }
+
+  size_t done = 0;
+  while (done < value.size()) {
+    u64 offset = (address + done) & OFFSET_MASK;
+    size_t chunk = std::min<size_t>(PAGE_SIZE - offset, value.size() - done);
+    std::memcpy(this->commitPage(address + done) + offset, value.data() + done, chunk);
+    done += chunk;
+  }
+}
+
+auto Memory::isBorrowed(const u8* page) const -> bool {
+  return std::ranges::any_of(this->borrowed, [page](std::span<u8> region) {
+    return page >= region.data() && page < region.data() + region.size();
+  });
+}
+
+auto Memory::map(u64 address, std::span<u8> pages, std::shared_ptr<void> owner) -> void {
+  if ((address & OFFSET_MASK) != 0 || (pages.size() & OFFSET_MASK) != 0) {
+    throw std::invalid_argument(std::format("ERROR! Mapping at {} isn't page aligned\n", address));
+  }
+
+  if (address + pages.size() > ADDRESS_SPACE) {
+    throw std::runtime_error{
+      std::format("ERROR! Address {} is bigger than 32 bits addres space\n", address + pages.size())
+    };
+  }
+
+  for (u64 offset = 0; offset < pages.size(); offset += PAGE_SIZE) {
+    u8**& table = this->directory[((address + offset) >> (PAGE_BITS + TABLE_BITS)) & (TABLE_SIZE - 1)];
+    if (table == nullptr) {
+      table = new u8*[TABLE_SIZE]();
+    }
+
+    // Whatever was there before is replaced
+    u8*& page = table[((address + offset) >> PAGE_BITS) & (TABLE_SIZE - 1)];
+    if (page != nullptr && !this->isBorrowed(page)) {
+      delete[] page;
+      this->pages--;
+    }
+    page = pages.data() + offset;
+  }
+
+  this->borrowed.push_back(pages);
+  this->owners.push_back(std::move(owner));
+}
+
+auto Memory::committedPages() const -> u64 {
+  return this->pages;
+}
+
+} // namespace Emulator
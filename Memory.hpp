@@ -0,0 +1,125 @@
+#pragma once
+
+#include "Config.hpp"
+
+#include <atomic>
+#include <memory>
+
+namespace Emulator {
+
+// Guest memory split into 4 KiB pages. A page is only allocated the first
+// time something is written into it, reading an untouched page yields zeros,
+// so resident memory follows what the program actually uses. Harts running
+// on different threads may read, write and commit pages at once, map() and
+// forEachPage() expect nothing else to touch the memory. Once shared, bytes
+// and aligned words are accessed as host atomics and every store breaks the
+// ll/sc reservations on its line
+class Memory {
+public:
+  static constexpr u32 PAGE_BITS = 12;
+  static constexpr u32 PAGE_SIZE = 1 << PAGE_BITS;
+  static constexpr u32 TABLE_BITS = 10;
+  static constexpr u32 TABLE_SIZE = 1 << TABLE_BITS;
+  static constexpr u64 ADDRESS_SPACE = u64(1) << 32;
+
+  // ll/sc reservations are kept per 64 bytes line, lines far apart may share one
+  static constexpr u32 LINE_BITS = 6;
+  static constexpr u32 RESERVATIONS = 1024;
+
+  Memory();
+  ~Memory();
+
+  Memory(const Memory&) = delete;
+  auto operator=(const Memory&) -> Memory& = delete;
+
+  // Reads 1 byte
+  auto read(u64 address) -> u8;
+
+  // Writes 1 byte
+  auto write(u64 address, u8 value) -> void;
+
+  // Reads a little-endian 16 bits value
+  // The typed accessors expect the caller to have checked that the
+  // value doesn't wrap around the end of the address space
+  auto readHalf(u32 address) -> u16;
+
+  // Reads a little-endian 32 bits value
+  auto readWord(u32 address) -> u32;
+
+  // Writes a little-endian 32 bits value
+  auto writeWord(u32 address, u32 value) -> void;
+
+  // Called before a second hart starts using the memory
+  auto share() -> void;
+
+  // ll, reads the aligned word at address. reservation is what sc needs to
+  // know whether the line was stored to since
+  auto loadLinked(u32 address, u32& reservation) -> u32;
+
+  // sc, stores value at the aligned address if nothing was stored to its
+  // line since loadLinked() gave reservation. Returns whether it stored
+  auto storeConditional(u32 address, u32 value, u32 reservation) -> bool;
+
+  // Reads "len(out)" bytes starting at address
+  auto readBlock(u64 address, std::span<u8> out) -> void;
+
+  // Writes "len(value)" bytes starting at address
+  auto writeBlock(u64 address, std::span<const u8> value) -> void;
+
+  // Backs [address, address + len(pages)) with memory owned by someone
+  // else, e.g. a file mapping, instead of allocating it. Writes go straight
+  // to it. address and len(pages) must be multiples of PAGE_SIZE, owner
+  // is kept alive as long as the pages are in use
+  auto map(u64 address, std::span<u8> pages, std::shared_ptr<void> owner) -> void;
+
+  // Number of pages allocated so far
+  auto committedPages() const -> u64;
+
+  // Calls each(address, page) for every page that is allocated or mapped, in
+  // increasing address order
+  template <typename Each>
+  auto forEachPage(Each each) const -> void {
+    for (u64 i = 0; i < TABLE_SIZE; i++) {
+      u8** table = this->directory[i];
+      if (table == nullptr)
+        continue;
+
+      for (u64 j = 0; j < TABLE_SIZE; j++) {
+        if (table[j] != nullptr) {
+          each(((i << TABLE_BITS) | j) << PAGE_BITS, std::span<const u8>{table[j], PAGE_SIZE});
+        }
+      }
+    }
+  }
+
+private:
+  // Two level page table: directory -> table -> page
+  std::array<u8**, TABLE_SIZE> directory;
+  u64 pages;
+
+  // Memory handed to map(), its pages aren't ours to free
+  std::vector<std::span<u8>> borrowed;
+  std::vector<std::shared_ptr<void>> owners;
+
+  // Whether harts on other threads use the memory too
+  std::atomic<bool> shared{false};
+
+  // Bumped by 2 by every store to one of their lines while the memory is
+  // shared and by every sc, odd while one of them is writing
+  std::array<std::atomic<u32>, RESERVATIONS> reservations{};
+
+  // Waits until no store holds the line of address and takes it
+  auto lockLine(u64 address) -> std::atomic<u32>&;
+
+  // Whether page came from map()
+  auto isBorrowed(const u8* page) const -> bool;
+
+  // Returns the page holding address or nullptr if it wasn't touched yet
+  auto findPage(u64 address) -> u8*;
+
+  // Returns the page holding address, allocating it if needed. When two
+  // threads allocate the same table or page, the first one to publish it wins
+  auto commitPage(u64 address) -> u8*;
+};
+
+} // namespace Emulator
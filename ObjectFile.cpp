@@ -0,0 +1,205 @@
+#include "ObjectFile.hpp"
+
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <filesystem>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace Emulator {
+
+struct Header {
+  u32 magic;
+  u32 version;
+  u64 sourceHash;
+  u32 entry;
+  u32 segmentCount;
+  u32 symbolCount;
+  u32 symbolsOffset;
+  u32 imageOffset;
+  u32 imageSize;
+};
+
+static auto alignUp(u64 value) -> u64 {
+  return (value + ObjectFile::ALIGNMENT - 1) & ~u64(ObjectFile::ALIGNMENT - 1);
+}
+
+template <typename T>
+static auto append(std::string& out, const T& value) -> void {
+  out.append(reinterpret_cast<const char*>(&value), sizeof(value));
+}
+
+template <typename T>
+static auto extract(std::string_view& in, T& value) -> bool {
+  if (in.size() < sizeof(value))
+    return false;
+
+  std::memcpy(&value, in.data(), sizeof(value));
+  in.remove_prefix(sizeof(value));
+  return true;
+}
+
+auto ObjectFile::hash(std::string_view source) -> u64 {
+  // FNV-1a, seeded with what the source was assembled by
+  static constexpr u64 SEED = Instructions::fingerprint() ^ VERSION;
+  u64 hash = SEED;
+  for (char c : source) {
+    hash = (hash ^ static_cast<u8>(c)) * 0x100000001B3;
+  }
+  return hash;
+}
+
+auto ObjectFile::pathFor(const std::string& source) -> std::string {
+  return std::filesystem::path(source).replace_extension(".mobj").string();
+}
+
+auto ObjectFile::write(const std::string& path, u64 sourceHash, const Tokenizer& tokenizer,
+                       std::span<const u8> image) -> void {
+  u32 textStart = std::min<u64>(tokenizer.textStartAddress, image.size());
+
+  std::vector<Segment> segments = {
+    {0, textStart, 0, DATA},
+    {textStart, static_cast<u32>(image.size() - textStart), 0, TEXT},
+  };
+
+  std::string symbols;
+  for (const auto& [name, address] : tokenizer.labelsToAddress) {
+    append(symbols, static_cast<u32>(address));
+    append(symbols, static_cast<u16>(name.size()));
+    symbols.append(name);
+  }
+
+  Header header;
+  header.magic = MAGIC;
+  header.version = VERSION;
+  header.sourceHash = sourceHash;
+  header.entry = static_cast<u32>(tokenizer.textStartAddress);
+  header.segmentCount = static_cast<u32>(segments.size());
+  header.symbolCount = static_cast<u32>(tokenizer.labelsToAddress.size());
+  header.symbolsOffset = static_cast<u32>(sizeof(Header) + segments.size() * sizeof(Segment));
+  header.imageOffset = static_cast<u32>(alignUp(header.symbolsOffset + symbols.size()));
+  header.imageSize = static_cast<u32>(image.size());
+
+  for (Segment& segment : segments) {
+    segment.offset = header.imageOffset + segment.address;
+  }
+
+  std::string content;
+  append(content, header);
+  for (const Segment& segment : segments) {
+    append(content, segment);
+  }
+  content.append(symbols);
+  content.resize(header.imageOffset, '\0');
+  content.append(reinterpret_cast<const char*>(image.data()), image.size());
+  content.resize(alignUp(content.size()), '\0');
+
+  // Written aside and renamed, so whoever reads it never sees half a file.
+  // mkstemp gives every writer a file of its own, threads of a batch may
+  // be caching the same program at once
+  std::string temporary = path + ".XXXXXX";
+  int fd = mkstemp(temporary.data());
+  if (fd < 0) {
+    throw std::runtime_error(std::format("ERROR! Couldn't create {}\n", temporary));
+  }
+
+  bool written = fchmod(fd, 0644) == 0;
+  for (size_t done = 0; written && done < content.size();) {
+    ssize_t count = ::write(fd, content.data() + done, content.size() - done);
+    written = count > 0;
+    done += written ? count : 0;
+  }
+  written = ::close(fd) == 0 && written;
+
+  if (!written) {
+    std::filesystem::remove(temporary);
+    throw std::runtime_error(std::format("ERROR! Couldn't write {}\n", temporary));
+  }
+  std::filesystem::rename(temporary, path);
+}
+
+auto ObjectFile::open(const std::string& path) -> std::unique_ptr<ObjectFile> {
+  std::ifstream file(path, std::ios::binary);
+  if (!file)
+    return nullptr;
+
+  Header header;
+  if (!file.read(reinterpret_cast<char*>(&header), sizeof(header)) ||
+      header.magic != MAGIC || header.version != VERSION || header.imageOffset % ALIGNMENT != 0 ||
+      header.symbolsOffset < sizeof(header) || header.symbolsOffset > header.imageOffset)
+    return nullptr;
+
+  // Everything between the header and the image
+  std::string tables(header.imageOffset - sizeof(header), '\0');
+  if (!file.read(tables.data(), tables.size()))
+    return nullptr;
+
+  file.seekg(0, std::ios::end);
+  if (u64(file.tellg()) < alignUp(u64(header.imageOffset) + header.imageSize))
+    return nullptr;
+
+  auto object = std::make_unique<ObjectFile>();
+  object->path = path;
+  object->sourceHash = header.sourceHash;
+  object->entry = header.entry;
+  object->imageOffset = header.imageOffset;
+  object->imageBytes = header.imageSize;
+
+  std::string_view in{tables};
+  for (u32 i = 0; i < header.segmentCount; i++) {
+    Segment segment;
+    if (!extract(in, segment) || u64(segment.address) + segment.size > header.imageSize)
+      return nullptr;
+    object->segments.push_back(segment);
+  }
+
+  in = std::string_view{tables}.substr(header.symbolsOffset - sizeof(header));
+  for (u32 i = 0; i < header.symbolCount; i++) {
+    u32 address;
+    u16 length;
+    if (!extract(in, address) || !extract(in, length) || in.size() < length)
+      return nullptr;
+
+    object->symbols.emplace(std::string(in.substr(0, length)), address);
+    in.remove_prefix(length);
+  }
+
+  return object;
+}
+
+auto ObjectFile::mapImage(std::shared_ptr<void>& owner) const -> std::span<u8> {
+  size_t size = alignUp(this->imageBytes);
+  if (size == 0)
+    return {};
+
+  int fd = ::open(this->path.c_str(), O_RDONLY);
+  if (fd < 0) {
+    throw std::runtime_error(std::format("ERROR! Couldn't open {}\n", this->path));
+  }
+
+  // Private and writable, the guest writes to its own copy of each page
+  void* memory = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, this->imageOffset);
+  ::close(fd);
+  if (memory == MAP_FAILED) {
+    throw std::runtime_error(std::format("ERROR! Couldn't map {}\n", this->path));
+  }
+
+  owner = std::shared_ptr<void>(memory, [size](void* memory) { munmap(memory, size); });
+  return {static_cast<u8*>(memory), size};
+}
+
+auto ObjectFile::imageSize() const -> u32 {
+  return this->imageBytes;
+}
+
+auto ObjectFile::textStart() const -> u32 {
+  for (const Segment& segment : this->segments) {
+    if (segment.flags & TEXT)
+      return segment.address;
+  }
+  return this->entry;
+}
+
+} // namespace Emulator
@@ -0,0 +1,74 @@
+#pragma once
+
+#include "Config.hpp"
+#include "Tokenizer.hpp"
+
+#include <memory>
+#include <unordered_map>
+
+namespace Emulator {
+
+// Assembled program saved to disk so the next run can skip the tokenizer
+// and the assembler. Fields are in host byte order:
+//
+//   header    magic "MIPO", version, hash of the source, entry point,
+//             segment and symbol counts, where the symbols and image are
+//   segments  address, size and file offset of .data and .text
+//   symbols   address, name length, name (labelsToAddress)
+//   image     the program as assembled, starting at address 0, placed at a
+//             page aligned offset and padded to whole pages so it can be
+//             mapped straight into guest memory
+class ObjectFile {
+public:
+  static constexpr u32 MAGIC = 0x4F50494D; // "MIPO"
+  static constexpr u32 VERSION = 1;
+  static constexpr u32 ALIGNMENT = 4096;
+
+  struct Segment {
+    u32 address;
+    u32 size;
+    u32 offset; // Where it starts in the file
+    u32 flags;
+  };
+
+  static constexpr u32 DATA = 1;
+  static constexpr u32 TEXT = 2;
+
+  u64 sourceHash = 0;
+  u32 entry = 0;
+  std::vector<Segment> segments;
+  Labels symbols;
+
+  // Hash the cache is keyed on, covers the source, the object version and
+  // the instruction table of the assembler. VERSION only has to be bumped
+  // for changes the table doesn't show, like the layout of the file
+  static auto hash(std::string_view source) -> u64;
+
+  // Where the object of an .asm file is cached
+  static auto pathFor(const std::string& source) -> std::string;
+
+  // Saves an assembled program
+  static auto write(const std::string& path, u64 sourceHash, const Tokenizer& tokenizer,
+                    std::span<const u8> image) -> void;
+
+  // Reads the header, segments and symbols of an object file, nullptr when
+  // it is missing or isn't a valid object
+  static auto open(const std::string& path) -> std::unique_ptr<ObjectFile>;
+
+  // Maps the image privately, writes to it never reach the file or any other
+  // mapping. It is padded to whole pages and stays mapped while owner lives
+  auto mapImage(std::shared_ptr<void>& owner) const -> std::span<u8>;
+
+  // Size of the image as assembled
+  auto imageSize() const -> u32;
+
+  // Start of .text
+  auto textStart() const -> u32;
+
+private:
+  std::string path;
+  u32 imageOffset = 0;
+  u32 imageBytes = 0;
+};
+
+} // namespace Emulator
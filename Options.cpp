@@ -0,0 +1,269 @@
+#include "Options.hpp"
+
+#include <charconv>
+#include <optional>
+
+namespace Emulator {
+
+static const std::unordered_map<std::string_view, Interpreter> interpreterNames = {
+  {"switch"  , Interpreter::SWITCH},
+  {"decoded" , Interpreter::DECODED},
+  {"threaded", Interpreter::THREADED},
+  {"block"   , Interpreter::BLOCK},
+  {"jit"     , Interpreter::JIT},
+};
+
+static const std::unordered_map<std::string_view, MemoryChecks> checkNames = {
+  {"full"  , MemoryChecks::FULL},
+  {"bounds", MemoryChecks::BOUNDS},
+  {"none"  , MemoryChecks::NONE},
+};
+
+// Host threads are cheap, but not that cheap
+static constexpr u64 MAX_HARTS = 1024;
+
+// Returns the value of "--name=value" or nullopt if arg isn't that flag
+static auto flagValue(std::string_view arg, std::string_view name) -> std::optional<std::string_view> {
+  if (!arg.starts_with(name) || arg.size() <= name.size() || arg[name.size()] != '=')
+    return std::nullopt;
+
+  return arg.substr(name.size() + 1);
+}
+
+// Parses a positive number given to option
+static auto number(std::string_view option, std::string_view value) -> u64 {
+  u64 result = 0;
+  auto [end, error] = std::from_chars(value.data(), value.data() + value.size(), result);
+  if (error != std::errc{} || end != value.data() + value.size() || result == 0) {
+    throw std::invalid_argument(std::format("ERROR! Invalid value {} for {}\n", value, option));
+  }
+  return result;
+}
+
+auto Options::parse(int argc, char* argv[]) -> Options {
+  Options options;
+
+  // Options taking their value as the next argument
+  auto nextArgument = [&](int& i, std::string_view option) -> std::string_view {
+    if (i + 1 >= argc) {
+      throw std::invalid_argument(std::format("ERROR! Missing value for {}\n", option));
+    }
+    return argv[++i];
+  };
+
+  for (int i = 1; i < argc; i++) {
+    std::string_view arg{argv[i]};
+
+    if (arg == "--batch") {
+      options.batch = nextArgument(i, arg);
+
+    } else if (auto value = flagValue(arg, "--batch")) {
+      options.batch = *value;
+
+    } else if (arg == "-j") {
+      options.jobs = number(arg, nextArgument(i, arg));
+
+    } else if (arg.starts_with("-j") && !arg.starts_with("--")) {
+      options.jobs = number("-j", arg.substr(2));
+
+    } else if (auto value = flagValue(arg, "--quantum")) {
+      options.quantum = number("--quantum", *value);
+
+    } else if (auto value = flagValue(arg, "--max-instructions")) {
+      options.maxInstructions = number("--max-instructions", *value);
+
+    } else if (auto value = flagValue(arg, "--harts")) {
+      u64 harts = number("--harts", *value);
+      if (harts > MAX_HARTS) {
+        throw std::invalid_argument(std::format("ERROR! --harts takes at most {}\n", MAX_HARTS));
+      }
+      options.harts = static_cast<u32>(harts);
+
+    } else if (auto value = flagValue(arg, "--fork-server")) {
+      options.forkServer = *value;
+
+    } else if (auto value = flagValue(arg, "--timeout")) {
+      options.timeout = number("--timeout", *value);
+
+    } else if (auto value = flagValue(arg, "--snapshot")) {
+      options.snapshot = *value;
+
+    } else if (auto value = flagValue(arg, "--snapshot-at")) {
+      options.snapshotAt = number("--snapshot-at", *value);
+
+    } else if (auto value = flagValue(arg, "--restore")) {
+      options.restore = *value;
+
+    } else if (auto value = flagValue(arg, "--engine")) {
+      auto it = interpreterNames.find(*value);
+      if (it == interpreterNames.end()) {
+        throw std::invalid_argument(std::format("ERROR! Unknown engine {}\n", *value));
+      }
+      options.interpreter = it->second;
+
+    } else if (auto value = flagValue(arg, "--checks")) {
+      auto it = checkNames.find(*value);
+      if (it == checkNames.end()) {
+        throw std::invalid_argument(std::format("ERROR! Unknown memory checks {}\n", *value));
+      }
+      options.checks = it->second;
+
+    } else if (auto value = flagValue(arg, "--trace")) {
+      options.trace = *value;
+
+    } else if (auto value = flagValue(arg, "--decode-trace")) {
+      options.decodeTrace = *value;
+
+    } else if (arg == "--timing") {
+      options.timing = true;
+
+    } else if (auto value = flagValue(arg, "--timing")) {
+      options.timing = true;
+      options.pipeline = Pipeline::parse(*value);
+
+    } else if (arg == "--icache") {
+      options.icache = CacheConfig{};
+
+    } else if (auto value = flagValue(arg, "--icache")) {
+      options.icache = CacheConfig::parse(*value);
+
+    } else if (arg == "--dcache") {
+      options.dcache = CacheConfig{};
+
+    } else if (auto value = flagValue(arg, "--dcache")) {
+      options.dcache = CacheConfig::parse(*value);
+
+    } else if (arg == "--branches") {
+      options.branches = true;
+
+    } else if (arg == "--profile") {
+      options.profile = true;
+
+    } else if (auto value = flagValue(arg, "--profile")) {
+      options.profile = true;
+      options.profileOutput = *value;
+
+    } else if (arg == "--dump-registers") {
+      options.dumpRegisters = true;
+
+    } else if (arg == "--cache") {
+      options.cache = true;
+
+    } else if (arg == "--line-buffered") {
+      options.lineBuffered = true;
+
+    } else if (arg == "--stats") {
+      options.stats = true;
+
+    } else if (arg.starts_with("--")) {
+      throw std::invalid_argument(std::format("ERROR! Unknown option {}\n", arg));
+
+    } else if (options.program.empty()) {
+      options.program = arg;
+
+    } else {
+      throw std::invalid_argument(std::format("ERROR! Unexpected argument {}\n", arg));
+    }
+  }
+
+  if (!options.decodeTrace.empty()) {
+    if (argc != 2) {
+      throw std::invalid_argument(std::format("ERROR! --decode-trace doesn't take anything else\n"));
+    }
+    return options;
+  }
+
+  if (!options.batch.empty()) {
+    if (!options.program.empty() || options.profile || options.timing || options.icache || options.dcache ||
+        options.branches || !options.trace.empty() || options.checks != MemoryChecks::FULL ||
+        options.dumpRegisters || options.stats || options.harts != 1 ||
+        !options.snapshot.empty() || !options.restore.empty() || !options.forkServer.empty() || options.timeout) {
+      throw std::invalid_argument(std::format("ERROR! --batch only takes --engine, --cache, --max-instructions, --quantum and -j\n"));
+    }
+    return options;
+  }
+
+  if (!options.forkServer.empty() && (options.profile || options.timing || options.icache || options.dcache ||
+                                      options.branches || !options.trace.empty() ||
+                                      options.checks != MemoryChecks::FULL ||
+                                      options.dumpRegisters || options.stats || options.harts != 1 ||
+                                      !options.snapshot.empty() || !options.restore.empty())) {
+    throw std::invalid_argument(std::format("ERROR! --fork-server only takes --engine, --cache, --max-instructions, --timeout and -j\n"));
+  }
+
+  if (options.timeout && options.forkServer.empty()) {
+    throw std::invalid_argument(std::format("ERROR! --timeout only applies to --fork-server\n"));
+  }
+
+  // The models always run on the decoded core, the other engines check everything
+  bool models = options.profile || options.timing || options.icache || options.dcache || options.branches ||
+                !options.trace.empty();
+  if (options.checks != MemoryChecks::FULL && options.interpreter != Interpreter::DECODED && !models) {
+    throw std::invalid_argument(std::format("ERROR! --checks only applies to --engine=decoded\n"));
+  }
+
+  if (options.snapshot.empty() != (options.snapshotAt == 0)) {
+    throw std::invalid_argument(std::format("ERROR! --snapshot and --snapshot-at go together\n"));
+  }
+
+  // A snapshot only holds the hart the program started on
+  if (!options.snapshot.empty() && options.harts != 1) {
+    throw std::invalid_argument(std::format("ERROR! --snapshot doesn't save spawned harts\n"));
+  }
+
+  if (!options.restore.empty()) {
+    if (!options.program.empty()) {
+      throw std::invalid_argument(std::format("ERROR! --restore runs the saved program, don't give another one\n"));
+    }
+    return options;
+  }
+
+  if (options.program.empty()) {
+    throw std::invalid_argument(std::format("Not enough arguments\n"));
+  }
+
+  // Anything starting with the ELF magic number is taken as a binary
+  if (!options.program.contains(".asm") && !ElfFile::isElf(options.program)) {
+    throw std::invalid_argument(std::format("You must use only .asm files or MIPS ELF executables\n"));
+  }
+
+  return options;
+}
+
+auto Options::printUsage(const char* executable) -> void {
+  std::cout << std::format("Usage : {} [options] <file.asm|executable>\n", executable);
+  std::cout << std::format("        {} [options] --restore=<snapshot>\n", executable);
+  std::cout << std::format("        {} --fork-server=<corpus> [-j children] [--engine=...] [--max-instructions=n] [--timeout=ms] <file.asm|executable>\n", executable);
+  std::cout << std::format("        {} --batch <list.txt> [-j threads] [--quantum=n] [--engine=...] [--max-instructions=n]\n", executable);
+  std::cout << std::format("  --engine=switch|decoded|threaded|block|jit\n");
+  std::cout << std::format("                                     interpreter core (default decoded)\n");
+  std::cout << std::format("  --checks=full|bounds|none          how the decoded core checks loads and stores (default full), bounds doesn't\n");
+  std::cout << std::format("                                     look for self-modifying code and none trusts the program entirely\n");
+  std::cout << std::format("  --dump-registers                   prints every register once the program ends\n");
+  std::cout << std::format("  --stats                            prints timings, memory and block cache statistics\n");
+  std::cout << std::format("  --profile[=file]                   prints where instructions were spent, optionally saving the counters\n");
+  std::cout << std::format("  --timing[=settings]                runs through a 5 stage pipeline model and prints cycles and CPI per label,\n");
+  std::cout << std::format("                                     settings: no-forwarding,branch=n,jump=n,load-use=n,mul=n\n");
+  std::cout << std::format("  --icache[=settings]                simulates an L1 instruction cache and prints its misses per label and pc,\n");
+  std::cout << std::format("                                     settings: size=32k,ways=4,line=64,lru|fifo|random\n");
+  std::cout << std::format("  --dcache[=settings]                same for an L1 data cache, settings also take write-back|write-through\n");
+  std::cout << std::format("  --branches                         runs static, bimodal and gshare predictors plus a return stack side by side\n");
+  std::cout << std::format("                                     and prints their mispredictions per branch\n");
+  std::cout << std::format("  --trace=file                       writes every retired instruction, its result and address to a compressed file\n");
+  std::cout << std::format("  --decode-trace=file                prints a trace written by --trace\n");
+  std::cout << std::format("  --cache                            reuses the program assembled by a previous run (file.mobj)\n");
+  std::cout << std::format("  --max-instructions=n               stops the program after n instructions\n");
+  std::cout << std::format("  --harts=n                          lets the program start up to n harts, each on a host thread (default 1),\n");
+  std::cout << std::format("                                     spawned harts run on the decoded core and aren't seen by the models\n");
+  std::cout << std::format("  --snapshot=file --snapshot-at=n    saves the guest to file after n instructions, then goes on\n");
+  std::cout << std::format("  --restore=file                     resumes a guest saved by --snapshot instead of running a program\n");
+  std::cout << std::format("  --batch <list.txt>                 runs every \"program.asm [input]\" line of the list\n");
+  std::cout << std::format("  --fork-server=<corpus>             runs the program up to its first read once, then forks it for every file of corpus\n");
+  std::cout << std::format("  --timeout=ms                       kills a --fork-server child still running after ms milliseconds (default 10000,\n");
+  std::cout << std::format("                                     0 waits forever) and reports it as a timeout\n");
+  std::cout << std::format("  -j <threads>                       threads used by --batch, children run at once by --fork-server (default one per core)\n");
+  std::cout << std::format("  --quantum=n                        instructions a --batch program runs before yielding (default 1000000)\n");
+  std::cout << std::format("  --line-buffered                    flushes program output at every new line\n");
+}
+
+} // namespace Emulator
@@ -0,0 +1,61 @@
+#pragma once
+
+#include "Engine.hpp"
+
+#include <optional>
+#include <thread>
+
+namespace Emulator {
+
+// Command line settings
+struct Options {
+  std::string program;
+  Interpreter interpreter = Interpreter::DECODED;
+  MemoryChecks checks = MemoryChecks::FULL;
+  bool dumpRegisters = false;
+  bool stats = false;
+  bool lineBuffered = false;
+  bool cache = false;
+  bool profile = false;
+  bool timing = false;
+  PipelineConfig pipeline;
+  std::optional<CacheConfig> icache;
+  std::optional<CacheConfig> dcache;
+  bool branches = false;
+
+  // Writes a trace of every retired instruction to "trace", "decodeTrace"
+  // prints a trace instead of running anything
+  std::string trace;
+  std::string decodeTrace;
+  std::string profileOutput;
+  u64 maxInstructions = std::numeric_limits<u64>::max();
+
+  // Harts the program may start, the one it starts on included
+  u32 harts = 1;
+
+  // Saves the guest to "snapshot" once it has run "snapshotAt" instructions
+  // and lets it go on, "restore" runs a saved guest instead of a program
+  std::string snapshot;
+  u64 snapshotAt = 0;
+  std::string restore;
+
+  // Batch mode, runs every program listed in the file on "jobs" threads,
+  // switching programs every "quantum" instructions
+  std::string batch;
+  unsigned jobs = std::max(std::thread::hardware_concurrency(), 1u);
+  u64 quantum = 1'000'000;
+
+  // Fork server mode, runs the program once up to its first read and then
+  // on every input of the "forkServer" directory, "jobs" at a time, killing
+  // children still running after "timeout" milliseconds
+  std::string forkServer;
+  std::optional<u64> timeout;
+
+  // Parses argv, throws std::invalid_argument on anything unexpected
+  static auto parse(int argc, char* argv[]) -> Options;
+
+  // Prints how to call the emulator
+  static auto printUsage(const char* executable) -> void;
+};
+
+} // namespace Emulator
@@ -0,0 +1,52 @@
+#pragma once
+
+#include "Config.hpp"
+
+#include <algorithm>
+#include <exception>
+#include <thread>
+#include <vector>
+
+namespace Emulator {
+
+// Calls work(begin, end) over [0, count) split in contiguous chunks, one per
+// core, each chunk having at least grain items. Small counts run on the
+// calling thread. If chunks throw, the exception of the earliest one is
+// rethrown once every chunk is done, so errors don't depend on timing
+template <typename Work>
+auto parallelFor(size_t count, size_t grain, Work&& work) -> void {
+  size_t threads = std::max(std::thread::hardware_concurrency(), 1u);
+  size_t chunks = std::min(threads, std::max<size_t>(count / std::max<size_t>(grain, 1), 1));
+
+  if (chunks == 1) {
+    work(size_t{0}, count);
+    return;
+  }
+
+  std::vector<std::exception_ptr> errors(chunks);
+  {
+    std::vector<std::jthread> workers;
+    workers.reserve(chunks - 1);
+
+    auto run = [&](size_t chunk) {
+      try {
+        work(count * chunk / chunks, count * (chunk + 1) / chunks);
+      } catch (...) {
+        errors[chunk] = std::current_exception();
+      }
+    };
+
+    for (size_t chunk = 1; chunk < chunks; chunk++) {
+      workers.emplace_back(run, chunk);
+    }
+    run(0);
+  }
+
+  for (const std::exception_ptr& error : errors) {
+    if (error) {
+      std::rethrow_exception(error);
+    }
+  }
+}
+
+} // namespace Emulator
@@ -0,0 +1,226 @@
+#include "Pipeline.hpp"
+#include "Profiler.hpp"
+
+#include <algorithm>
+#include <charconv>
+
+namespace Emulator {
+
+// IF and ID of the first instruction, MEM and WB of the last one
+static constexpr u64 FILL = 2;
+static constexpr u64 DRAIN = 2;
+
+static constexpr u8 RA = 31;
+
+// Registers an instruction reads and the one it writes (0 for none)
+struct Access {
+  std::array<u8, 3> sources{};
+  u8 destination = 0;
+};
+
+static auto accessOf(const DecodedOp& op) -> Access {
+  switch (op.kind) {
+    case Op::SLL: case Op::SRL: case Op::SRA:
+      return {{op.rt}, op.rd};
+
+    case Op::MUL: case Op::ADD: case Op::SUB: case Op::AND: case Op::OR: case Op::NOR: case Op::SLT:
+    case Op::SLLV: case Op::SRLV: case Op::SRAV: case Op::XOR: case Op::SLTS: case Op::SLTU:
+      return {{op.rs, op.rt}, op.rd};
+
+    case Op::MOVZ: case Op::MOVN: // rd keeps its value when the condition fails
+      return {{op.rs, op.rt, op.rd}, op.rd};
+
+    case Op::MFHI: case Op::MFLO: // hi and lo aren't tracked
+      return {{}, op.rd};
+
+    case Op::JR: case Op::DJR:
+      return {{op.rs}, 0};
+
+    case Op::JALR:
+      return {{op.rs}, op.rd};
+
+    case Op::SYSCALL: // $v0, $a0 and $a1, results come back in $v0
+      return {{2, 4, 5}, 2};
+
+    case Op::BEQ: case Op::BNE: case Op::BLT: case Op::BGE: case Op::SB: case Op::SH: case Op::SW:
+    case Op::DBEQ: case Op::DBNE: case Op::DBLT: case Op::DBGE:
+    case Op::MULT: case Op::MULTU: case Op::DIV: case Op::DIVU: case Op::TEQ:
+      return {{op.rs, op.rt}, 0};
+
+    case Op::MTHI: case Op::MTLO:
+      return {{op.rs}, 0};
+
+    case Op::ADDI: case Op::SLTI: case Op::ANDI: case Op::ORI: case Op::LW: case Op::LBU: case Op::LL:
+    case Op::SLTIS: case Op::SLTIU: case Op::XORI: case Op::LB: case Op::LH: case Op::LHU:
+      return {{op.rs}, op.rt};
+
+    case Op::LUI:
+      return {{}, op.rt};
+
+    case Op::SC: // Stores rt and writes back whether it did
+      return {{op.rs, op.rt}, op.rt};
+
+    case Op::JAL: case Op::DJAL:
+      return {{}, RA};
+
+    default:
+      return {};
+  }
+}
+
+static auto isBranch(Op kind) -> bool {
+  return kind == Op::BEQ || kind == Op::BNE || kind == Op::BLT || kind == Op::BGE ||
+         kind == Op::DBEQ || kind == Op::DBNE || kind == Op::DBLT || kind == Op::DBGE;
+}
+
+// Whatever has its result out of MEM, sc included
+static auto isLoad(Op kind) -> bool {
+  return kind == Op::LW || kind == Op::LBU || kind == Op::LB || kind == Op::LH || kind == Op::LHU ||
+         kind == Op::LL || kind == Op::SC;
+}
+
+auto Pipeline::parse(std::string_view settings) -> PipelineConfig {
+  PipelineConfig config;
+
+  while (!settings.empty()) {
+    std::string_view setting = settings.substr(0, settings.find(','));
+    settings.remove_prefix(std::min(setting.size() + 1, settings.size()));
+
+    if (setting == "no-forwarding") {
+      config.forwarding = false;
+      continue;
+    }
+
+    size_t equals = setting.find('=');
+    std::string_view name = setting.substr(0, equals);
+    std::string_view value = equals == std::string_view::npos ? std::string_view{} : setting.substr(equals + 1);
+
+    u32 number = 0;
+    auto [end, error] = std::from_chars(value.data(), value.data() + value.size(), number);
+    if (value.empty() || error != std::errc{} || end != value.data() + value.size()) {
+      throw std::invalid_argument(std::format("ERROR! Invalid pipeline setting {}\n", setting));
+    }
+
+    if (name == "branch")
+      config.branchPenalty = number;
+    else if (name == "jump")
+      config.jumpPenalty = number;
+    else if (name == "load-use")
+      config.loadUseStall = number;
+    else if (name == "mul" && number > 0)
+      config.mulLatency = number;
+    else
+      throw std::invalid_argument(std::format("ERROR! Invalid pipeline setting {}\n", setting));
+  }
+
+  return config;
+}
+
+auto Pipeline::reset(const CPU& cpu) -> void {
+  this->ready.fill(0);
+  this->producer.fill(DATA);
+  this->issued = FILL;
+  this->nextIssue = FILL + 1;
+  this->nextReason = DATA;
+  this->stalls.fill(0);
+  this->instructions = 0;
+
+  this->textStart = cpu.textStart;
+  this->counts.assign(cpu.decoded.size(), 0);
+  this->charged.assign(cpu.decoded.size(), 0);
+}
+
+auto Pipeline::retire(const Retired& instruction) -> void {
+  const DecodedOp& op = instruction.op;
+  Access operands = accessOf(op);
+
+  // Enters EX once the one before left it and its sources can be read
+  u64 issue = this->nextIssue;
+  Stall reason = this->nextReason;
+  for (u8 source : operands.sources) {
+    if (source != 0 && this->ready[source] > issue) {
+      issue = this->ready[source];
+      reason = this->producer[source];
+    }
+  }
+
+  u64 earliest = this->issued + 1;
+  if (issue > earliest) {
+    this->stalls[reason] += issue - earliest;
+  }
+
+  u64 cost = issue - this->issued;
+  this->issued = issue;
+  this->instructions++;
+  if (instruction.index != Retired::OUTSIDE) {
+    this->counts[instruction.index]++;
+    this->charged[instruction.index] += cost;
+  }
+
+  // Whatever keeps the next instruction out of EX
+  this->nextIssue = issue + 1;
+  this->nextReason = DATA;
+  if (op.kind == Op::MUL) {
+    this->nextIssue = issue + this->config.mulLatency;
+    this->nextReason = MULTIPLY;
+  } else if (isBranch(op.kind) && instruction.taken()) {
+    this->nextIssue += this->config.branchPenalty;
+    this->nextReason = BRANCH;
+  } else if (op.kind == Op::J || op.kind == Op::JAL || op.kind == Op::JR || op.kind == Op::JALR ||
+             op.kind == Op::DJ || op.kind == Op::DJAL || op.kind == Op::DJR) {
+    this->nextIssue += this->config.jumpPenalty;
+    this->nextReason = JUMP;
+  }
+
+  if (operands.destination == 0)
+    return;
+
+  // Cycles after entering EX until a consumer can enter EX. Without
+  // forwarding the value is written back two cycles after EX and read in ID
+  // the cycle after
+  u64 latency = op.kind == Op::MUL ? this->config.mulLatency : 1;
+  if (!this->config.forwarding)
+    latency += 2;
+  else if (isLoad(op.kind))
+    latency += this->config.loadUseStall;
+
+  this->ready[operands.destination] = issue + latency;
+  this->producer[operands.destination] = isLoad(op.kind) ? LOAD_USE : op.kind == Op::MUL ? MULTIPLY : DATA;
+}
+
+auto Pipeline::cycles() const -> u64 {
+  return this->instructions == 0 ? 0 : this->issued + DRAIN;
+}
+
+auto Pipeline::report(const Tokenizer& tokenizer, std::ostream& out) -> void {
+  auto cpi = [](u64 cycles, u64 instructions) {
+    return instructions == 0 ? 0.0 : double(cycles) / double(instructions);
+  };
+
+  out << std::format("cycles: {} for {} instructions, CPI {:.3f}\n", this->cycles(), this->instructions,
+                     cpi(this->cycles(), this->instructions));
+  out << std::format("pipeline: forwarding {}, branch penalty {}, jump penalty {}, load-use stall {}, mul latency {}\n",
+                     this->config.forwarding ? "on" : "off", this->config.branchPenalty, this->config.jumpPenalty,
+                     this->config.loadUseStall, this->config.mulLatency);
+  out << std::format("stall cycles: {} load-use, {} data, {} multiply, {} branch, {} jump\n", this->stalls[LOAD_USE],
+                     this->stalls[DATA], this->stalls[MULTIPLY], this->stalls[BRANCH], this->stalls[JUMP]);
+
+  auto labels = Profiler::textLabels(tokenizer, this->textStart, this->textStart + u64(this->counts.size()) * 4);
+  auto cycles = Profiler::perLabel(labels, this->textStart, this->charged);
+  auto counts = Profiler::perLabel(labels, this->textStart, this->counts);
+
+  // Both skip labels that never ran, so they line up
+  std::vector<std::tuple<std::string, u64, u64>> rows;
+  for (size_t i = 0; i < cycles.size() && i < counts.size(); i++) {
+    rows.emplace_back(cycles[i].first, cycles[i].second, counts[i].second);
+  }
+  std::stable_sort(rows.begin(), rows.end(),
+    [](const auto& a, const auto& b) { return std::get<1>(a) > std::get<1>(b); });
+
+  out << std::format("\n{:>14} {:>14} {:>7}  {}\n", "cycles", "instructions", "CPI", "label");
+  for (const auto& [name, labelCycles, labelCount] : rows) {
+    out << std::format("{:>14} {:>14} {:>7.3f}  {}\n", labelCycles, labelCount, cpi(labelCycles, labelCount), name);
+  }
+}
+
+} // namespace Emulator
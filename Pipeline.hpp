@@ -0,0 +1,77 @@
+#pragma once
+
+#include "Core.hpp"
+#include "Tokenizer.hpp"
+
+namespace Emulator {
+
+// Timing of a classic in-order IF/ID/EX/MEM/WB pipeline, one instruction
+// issued per cycle at best
+struct PipelineConfig {
+  // EX/MEM and MEM/WB bypasses. Without them a value can only be read in ID
+  // once its producer reached WB
+  bool forwarding = true;
+
+  // Bubbles after a taken branch, branches are predicted not taken and
+  // resolved in EX
+  u32 branchPenalty = 2;
+
+  // Bubbles after j, jal and jr, resolved in ID
+  u32 jumpPenalty = 1;
+
+  // Bubbles between a load and an instruction using what it loaded right
+  // after it. Without forwarding loads wait for write back like the rest
+  u32 loadUseStall = 1;
+
+  // Cycles mul spends in EX, the multiplier isn't pipelined
+  u32 mulLatency = 4;
+};
+
+// Cycle-approximate timing model fed with every retired instruction by
+// runCore(). It keeps the cycle each register becomes readable and
+// the first cycle the next instruction can enter EX, an instruction enters
+// EX once both allow it. Every cycle between two instructions is charged to
+// the second one
+class Pipeline {
+public:
+  PipelineConfig config;
+
+  // Clears the counters and sizes them for the text segment of cpu
+  auto reset(const CPU& cpu) -> void;
+
+  // Advances the model by one instruction
+  auto retire(const Retired& instruction) -> void;
+
+  // Cycles since the program started, including filling and draining the pipeline
+  auto cycles() const -> u64;
+
+  // Parses "no-forwarding,branch=n,jump=n,load-use=n,mul=n", any subset in
+  // any order, throws std::invalid_argument on anything else
+  static auto parse(std::string_view settings) -> PipelineConfig;
+
+  // Prints cycles and CPI for the program and for each label
+  auto report(const Tokenizer& tokenizer, std::ostream& out) -> void;
+
+private:
+  // Why an instruction couldn't enter EX as early as it wanted
+  enum Stall { LOAD_USE, DATA, MULTIPLY, BRANCH, JUMP, STALLS };
+
+  // Per register, when its value can be used in EX and what produced it
+  std::array<u64, 32> ready{};
+  std::array<Stall, 32> producer{};
+
+  // Cycle the last instruction entered EX and the first one the next can
+  u64 issued = 0;
+  u64 nextIssue = 0;
+  Stall nextReason = BRANCH;
+
+  std::array<u64, STALLS> stalls{};
+  u64 instructions = 0;
+
+  // Per instruction of the text segment
+  std::vector<u64> counts;
+  std::vector<u64> charged;
+  u32 textStart = 0;
+};
+
+} // namespace Emulator
@@ -0,0 +1,210 @@
+#include "Profiler.hpp"
+
+#include <algorithm>
+#include <numeric>
+
+namespace Emulator {
+
+static constexpr size_t HOT_SPOTS = 20;
+
+static auto isBranch(Op kind) -> bool {
+  return kind == Op::BEQ || kind == Op::BNE || kind == Op::BLT || kind == Op::BGE ||
+         kind == Op::DBEQ || kind == Op::DBNE || kind == Op::DBLT || kind == Op::DBGE;
+}
+
+static auto percent(u64 part, u64 total) -> double {
+  return total == 0 ? 0.0 : 100.0 * double(part) / double(total);
+}
+
+auto Profiler::reset(const CPU& cpu) -> void {
+  this->textStart = cpu.textStart;
+  this->counts.assign(cpu.decoded.size(), 0);
+  this->taken.assign(cpu.decoded.size(), 0);
+  this->kinds.assign(cpu.decoded.size(), Op::UNKNOWN);
+  this->opcodes.fill(0);
+  this->outside = 0;
+}
+
+auto Profiler::run(CPU& cpu, u64 limit) -> void {
+  runCore<FullChecks>(cpu, limit, *this);
+}
+
+auto Profiler::retire(const Retired& instruction) -> void {
+  if (instruction.index == Retired::OUTSIDE) {
+    this->outside++;
+    return;
+  }
+
+  Op kind = instruction.op.kind;
+  this->counts[instruction.index]++;
+  this->kinds[instruction.index] = kind;
+  this->opcodes[size_t(kind)]++;
+  if (isBranch(kind) && instruction.taken()) {
+    this->taken[instruction.index]++;
+  }
+}
+
+auto Profiler::retired() const -> u64 {
+  return std::accumulate(this->counts.begin(), this->counts.end(), this->outside);
+}
+
+auto Profiler::textLabels(const Tokenizer& tokenizer) const -> std::vector<std::pair<u32, std::string>> {
+  return textLabels(tokenizer, this->textStart, this->textStart + u64(this->counts.size()) * 4);
+}
+
+auto Profiler::textLabels(const Tokenizer& tokenizer, u32 textStart, u64 textEnd)
+    -> std::vector<std::pair<u32, std::string>> {
+  std::vector<std::pair<u32, std::string>> labels;
+
+  for (const auto& [name, address] : tokenizer.labelsToAddress) {
+    if (address >= textStart && address < textEnd) {
+      labels.emplace_back(u32(address), name);
+    }
+  }
+
+  // Labels sharing an address are ordered by name so reports are stable
+  std::sort(labels.begin(), labels.end());
+  return labels;
+}
+
+auto Profiler::locate(const std::vector<std::pair<u32, std::string>>& labels, u32 pc) -> std::string {
+  auto it = std::upper_bound(labels.begin(), labels.end(), pc,
+    [](u32 value, const auto& label) { return value < label.first; });
+
+  if (it == labels.begin())
+    return std::format("0x{:08x}", pc);
+
+  // The first name wins among labels at the same address
+  u32 address = std::prev(it)->first;
+  auto first = std::lower_bound(labels.begin(), it, address,
+    [](const auto& label, u32 value) { return label.first < value; });
+
+  return std::format("{}+{}", first->second, pc - address);
+}
+
+auto Profiler::labelCounts(const std::vector<std::pair<u32, std::string>>& labels) const
+    -> std::vector<std::pair<std::string, u64>> {
+  return perLabel(labels, this->textStart, this->counts);
+}
+
+auto Profiler::perLabel(const std::vector<std::pair<u32, std::string>>& labels, u32 textStart,
+                        const std::vector<u64>& counters) -> std::vector<std::pair<std::string, u64>> {
+  std::vector<std::pair<std::string, u64>> sums;
+
+  // Every instruction is charged to the closest label before it
+  for (size_t l = 0; l < labels.size();) {
+    size_t next = l;
+    while (next < labels.size() && labels[next].first == labels[l].first)
+      next++;
+
+    u32 first = (labels[l].first - textStart) >> 2;
+    u32 last = next < labels.size() ? (labels[next].first - textStart) >> 2 : counters.size();
+    u64 count = std::accumulate(counters.begin() + first, counters.begin() + last, u64(0));
+    if (count != 0)
+      sums.emplace_back(labels[l].second, count);
+
+    l = next;
+  }
+
+  return sums;
+}
+
+auto Profiler::report(const Tokenizer& tokenizer, std::ostream& out) -> void {
+  auto labels = this->textLabels(tokenizer);
+  u64 total = this->retired();
+
+  out << std::format("instructions retired: {} ({} outside .text)\n", total, this->outside);
+
+  // Hot spots
+  std::vector<u32> indexes;
+  for (u32 i = 0; i < this->counts.size(); i++) {
+    if (this->counts[i] != 0)
+      indexes.push_back(i);
+  }
+  std::stable_sort(indexes.begin(), indexes.end(),
+    [this](u32 a, u32 b) { return this->counts[a] > this->counts[b]; });
+
+  out << std::format("\n{:>14} {:>7}  {:<10}  {:<24} {}\n", "count", "%", "pc", "location", "instruction");
+  for (size_t i = 0; i < std::min(indexes.size(), HOT_SPOTS); i++) {
+    u32 index = indexes[i];
+    u32 pc = this->textStart + index * 4;
+    out << std::format("{:>14} {:>6.2f}%  0x{:08x}  {:<24} {}\n",
+                       this->counts[index], percent(this->counts[index], total), pc,
+                       locate(labels, pc), Decoder::name(this->kinds[index]));
+  }
+
+  // Labels
+  auto perLabel = this->labelCounts(labels);
+  std::stable_sort(perLabel.begin(), perLabel.end(),
+    [](const auto& a, const auto& b) { return a.second > b.second; });
+
+  out << std::format("\n{:>14} {:>7}  {}\n", "count", "%", "label");
+  for (const auto& [name, count] : perLabel) {
+    out << std::format("{:>14} {:>6.2f}%  {}\n", count, percent(count, total), name);
+  }
+
+  // Opcodes
+  std::vector<Op> kinds;
+  for (size_t k = 0; k < this->opcodes.size(); k++) {
+    if (this->opcodes[k] != 0)
+      kinds.push_back(Op(k));
+  }
+  std::stable_sort(kinds.begin(), kinds.end(),
+    [this](Op a, Op b) { return this->opcodes[size_t(a)] > this->opcodes[size_t(b)]; });
+
+  out << std::format("\n{:>14} {:>7}  {}\n", "count", "%", "opcode");
+  for (Op kind : kinds) {
+    u64 count = this->opcodes[size_t(kind)];
+    out << std::format("{:>14} {:>6.2f}%  {}\n", count, percent(count, total), Decoder::name(kind));
+  }
+
+  // Branches
+  std::erase_if(indexes, [this](u32 index) { return !isBranch(this->kinds[index]); });
+
+  out << std::format("\n{:>14} {:>14} {:>7}  {:<10}  {:<24} {}\n", "taken", "not taken", "taken%", "pc", "location", "instruction");
+  for (size_t i = 0; i < std::min(indexes.size(), HOT_SPOTS); i++) {
+    u32 index = indexes[i];
+    u32 pc = this->textStart + index * 4;
+    u64 taken = this->taken[index];
+    out << std::format("{:>14} {:>14} {:>6.2f}%  0x{:08x}  {:<24} {}\n",
+                       taken, this->counts[index] - taken, percent(taken, this->counts[index]), pc,
+                       locate(labels, pc), Decoder::name(this->kinds[index]));
+  }
+}
+
+auto Profiler::write(const Tokenizer& tokenizer, const std::string& file) -> void {
+  std::ofstream out(file);
+  if (!out) {
+    throw std::runtime_error(std::format("ERROR! Couldn't open {}\n", file));
+  }
+
+  auto labels = this->textLabels(tokenizer);
+
+  // total  <retired>  <outside .text>
+  // pc     <address>  <location>  <instruction>  <count>  <taken>  <not taken>
+  // label  <name>  <count>
+  // op     <instruction>  <count>
+  out << std::format("total\t{}\t{}\n", this->retired(), this->outside);
+
+  for (u32 i = 0; i < this->counts.size(); i++) {
+    if (this->counts[i] == 0)
+      continue;
+
+    u32 pc = this->textStart + i * 4;
+    u64 taken = isBranch(this->kinds[i]) ? this->taken[i] : 0;
+    u64 notTaken = isBranch(this->kinds[i]) ? this->counts[i] - taken : 0;
+    out << std::format("pc\t0x{:08x}\t{}\t{}\t{}\t{}\t{}\n", pc, locate(labels, pc),
+                       Decoder::name(this->kinds[i]), this->counts[i], taken, notTaken);
+  }
+
+  for (const auto& [name, count] : this->labelCounts(labels)) {
+    out << std::format("label\t{}\t{}\n", name, count);
+  }
+
+  for (size_t k = 0; k < this->opcodes.size(); k++) {
+    if (this->opcodes[k] != 0)
+      out << std::format("op\t{}\t{}\n", Decoder::name(Op(k)), this->opcodes[k]);
+  }
+}
+
+} // namespace Emulator
@@ -0,0 +1,64 @@
+#pragma once
+
+#include "CPU.hpp"
+#include "Core.hpp"
+#include "Tokenizer.hpp"
+
+namespace Emulator {
+
+// Counts every retired instruction per pc, per opcode and, for conditional
+// branches, how often they were taken. Counters are flat arrays indexed like
+// the decoded cache, labels are only resolved when the report is printed
+class Profiler {
+public:
+  // Clears the counters and sizes them for the text segment of cpu
+  auto reset(const CPU& cpu) -> void;
+
+  // Runs until the program halts or has retired limit instructions,
+  // stepping through the decoded cache
+  auto run(CPU& cpu, u64 limit) -> void;
+
+  // Counts an instruction, see runCore()
+  auto retire(const Retired& instruction) -> void;
+
+  // Prints the hot spots, labels, opcodes and branches sorted by count
+  auto report(const Tokenizer& tokenizer, std::ostream& out) -> void;
+
+  // Writes every non zero counter as tab separated lines
+  auto write(const Tokenizer& tokenizer, const std::string& file) -> void;
+
+  // Instructions retired so far
+  auto retired() const -> u64;
+
+  // Labels of the text segment [textStart, textEnd), sorted by address
+  static auto textLabels(const Tokenizer& tokenizer, u32 textStart, u64 textEnd)
+      -> std::vector<std::pair<u32, std::string>>;
+
+  // Sums counters indexed like the decoded cache under each label, in address order
+  static auto perLabel(const std::vector<std::pair<u32, std::string>>& labels, u32 textStart,
+                       const std::vector<u64>& counters) -> std::vector<std::pair<std::string, u64>>;
+
+  // "label+offset" for pc
+  static auto locate(const std::vector<std::pair<u32, std::string>>& labels, u32 pc) -> std::string;
+
+private:
+  // Per instruction of the text segment
+  std::vector<u64> counts;
+  std::vector<u64> taken;
+
+  std::array<u64, size_t(Op::COUNT)> opcodes{};
+  std::vector<Op> kinds;
+
+  // Instructions run from outside the text segment
+  u64 outside = 0;
+  u32 textStart = 0;
+
+  // Text labels sorted by address
+  auto textLabels(const Tokenizer& tokenizer) const -> std::vector<std::pair<u32, std::string>>;
+
+  // Instructions retired under each label, in address order
+  auto labelCounts(const std::vector<std::pair<u32, std::string>>& labels) const
+      -> std::vector<std::pair<std::string, u64>>;
+};
+
+} // namespace Emulator
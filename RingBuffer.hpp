@@ -0,0 +1,62 @@
+#pragma once
+
+#include "Config.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <memory>
+
+namespace Emulator {
+
+// Fixed size queue between one producer thread and one consumer thread,
+// neither ever takes a lock. Each side owns one index and only reads the
+// other's when its cached copy says the ring looks full or empty, so the
+// two don't fight over a cache line while the ring is neither
+template <typename T, size_t CAPACITY>
+class RingBuffer {
+  static_assert((CAPACITY & (CAPACITY - 1)) == 0, "CAPACITY must be a power of two");
+
+public:
+  RingBuffer() : slots{std::make_unique<T[]>(CAPACITY)} {}
+
+  // Producer side, returns false when the ring is full
+  auto push(const T& value) -> bool {
+    u64 tail = this->tail.load(std::memory_order_relaxed);
+    if (tail - this->cachedHead == CAPACITY) {
+      this->cachedHead = this->head.load(std::memory_order_acquire);
+      if (tail - this->cachedHead == CAPACITY)
+        return false;
+    }
+
+    this->slots[tail & (CAPACITY - 1)] = value;
+    this->tail.store(tail + 1, std::memory_order_release);
+    return true;
+  }
+
+  // Consumer side, moves up to len(out) values to out and returns how many
+  auto pop(std::span<T> out) -> size_t {
+    u64 head = this->head.load(std::memory_order_relaxed);
+    if (this->cachedTail == head) {
+      this->cachedTail = this->tail.load(std::memory_order_acquire);
+    }
+
+    size_t count = std::min<u64>(this->cachedTail - head, out.size());
+    for (size_t i = 0; i < count; i++) {
+      out[i] = this->slots[(head + i) & (CAPACITY - 1)];
+    }
+
+    this->head.store(head + count, std::memory_order_release);
+    return count;
+  }
+
+private:
+  std::unique_ptr<T[]> slots;
+
+  // Values ever pushed and popped, the producer writes tail and the consumer head
+  alignas(64) std::atomic<u64> tail{0};
+  u64 cachedHead = 0;
+  alignas(64) std::atomic<u64> head{0};
+  u64 cachedTail = 0;
+};
+
+} // namespace Emulator
@@ -0,0 +1,200 @@
+#include "Snapshot.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <fcntl.h>
+#include <filesystem>
+#include <sys/mman.h>
+#include <unistd.h>
+
+namespace Emulator {
+
+struct Header {
+  u32 magic;
+  u32 version;
+  u32 pc;
+  u32 halt;
+  u64 retired;
+  u32 textStart;
+  u32 textEnd;
+  u32 entry;
+  u32 pageCount;
+  u32 symbolCount;
+  u32 symbolsOffset;
+  u32 pagesOffset;
+  std::array<u32, 32> registers;
+  u32 hi;
+  u32 lo;
+  u32 encoding;
+};
+
+static auto alignUp(u64 value) -> u64 {
+  return (value + Memory::PAGE_SIZE - 1) & ~u64(Memory::PAGE_SIZE - 1);
+}
+
+template <typename T>
+static auto append(std::string& out, const T& value) -> void {
+  out.append(reinterpret_cast<const char*>(&value), sizeof(value));
+}
+
+template <typename T>
+static auto extract(std::string_view& in, T& value) -> bool {
+  if (in.size() < sizeof(value))
+    return false;
+
+  std::memcpy(&value, in.data(), sizeof(value));
+  in.remove_prefix(sizeof(value));
+  return true;
+}
+
+auto Snapshot::write(const std::string& path, const CPU& cpu, const Tokenizer& tokenizer) -> void {
+  std::vector<std::pair<u32, const u8*>> pages;
+  cpu.memory.forEachPage([&](u64 address, std::span<const u8> page) {
+    if (std::ranges::any_of(page, [](u8 byte) { return byte != 0; })) {
+      pages.emplace_back(static_cast<u32>(address), page.data());
+    }
+  });
+
+  std::string symbols;
+  for (const auto& [name, address] : tokenizer.labelsToAddress) {
+    append(symbols, static_cast<u32>(address));
+    append(symbols, static_cast<u16>(name.size()));
+    symbols.append(name);
+  }
+
+  Header header;
+  header.magic = MAGIC;
+  header.version = VERSION;
+  header.pc = cpu.pc;
+  header.halt = cpu.halt;
+  header.retired = cpu.retired;
+  header.textStart = cpu.textStart;
+  header.textEnd = cpu.textEnd;
+  header.entry = static_cast<u32>(tokenizer.textStartAddress);
+  header.pageCount = static_cast<u32>(pages.size());
+  header.symbolCount = static_cast<u32>(tokenizer.labelsToAddress.size());
+  header.symbolsOffset = static_cast<u32>(sizeof(Header) + pages.size() * sizeof(u32));
+  header.pagesOffset = static_cast<u32>(alignUp(header.symbolsOffset + symbols.size()));
+  header.registers = cpu.registers;
+  header.hi = cpu.hi;
+  header.lo = cpu.lo;
+  header.encoding = static_cast<u32>(cpu.encoding);
+
+  std::string tables;
+  append(tables, header);
+  for (const auto& [address, page] : pages) {
+    append(tables, address);
+  }
+  tables.append(symbols);
+  tables.resize(header.pagesOffset, '\0');
+
+  // Written aside and renamed, so whoever reads it never sees half a file
+  std::string temporary = std::format("{}.{}.tmp", path, getpid());
+  {
+    std::ofstream file(temporary, std::ios::binary);
+    file.write(tables.data(), tables.size());
+    for (const auto& [address, page] : pages) {
+      file.write(reinterpret_cast<const char*>(page), Memory::PAGE_SIZE);
+    }
+
+    if (!file.flush()) {
+      throw std::runtime_error(std::format("ERROR! Couldn't write {}\n", temporary));
+    }
+  }
+  std::filesystem::rename(temporary, path);
+}
+
+auto Snapshot::open(const std::string& path) -> std::unique_ptr<Snapshot> {
+  std::ifstream file(path, std::ios::binary);
+  if (!file) {
+    throw std::runtime_error(std::format("ERROR! Couldn't open {}\n", path));
+  }
+
+  Header header;
+  if (!file.read(reinterpret_cast<char*>(&header), sizeof(header)) || header.magic != MAGIC ||
+      header.version != VERSION || header.pagesOffset % Memory::PAGE_SIZE != 0 ||
+      header.symbolsOffset < sizeof(header) || header.symbolsOffset > header.pagesOffset ||
+      u64(header.pageCount) * sizeof(u32) > header.symbolsOffset - sizeof(header)) {
+    throw std::runtime_error(std::format("ERROR! {} isn't a snapshot\n", path));
+  }
+
+  // Everything between the header and the pages
+  std::string tables(header.pagesOffset - sizeof(header), '\0');
+  file.read(tables.data(), tables.size());
+  file.seekg(0, std::ios::end);
+  if (!file || u64(file.tellg()) < header.pagesOffset + u64(header.pageCount) * Memory::PAGE_SIZE) {
+    throw std::runtime_error(std::format("ERROR! Snapshot {} is truncated\n", path));
+  }
+
+  auto snapshot = std::make_unique<Snapshot>();
+  snapshot->path = path;
+  snapshot->registers = header.registers;
+  snapshot->hi = header.hi;
+  snapshot->lo = header.lo;
+  snapshot->encoding = header.encoding == static_cast<u32>(Encoding::MIPS32) ? Encoding::MIPS32 : Encoding::ASSEMBLER;
+  snapshot->pc = header.pc;
+  snapshot->halt = header.halt != 0;
+  snapshot->retired = header.retired;
+  snapshot->textStart = header.textStart;
+  snapshot->textEnd = header.textEnd;
+  snapshot->entry = header.entry;
+  snapshot->pagesOffset = header.pagesOffset;
+
+  std::string_view in{tables};
+  snapshot->addresses.resize(header.pageCount);
+  for (u32& address : snapshot->addresses) {
+    extract(in, address);
+    if (address % Memory::PAGE_SIZE != 0) {
+      throw std::runtime_error(std::format("ERROR! Snapshot {} has a misaligned page {:#x}\n", path, address));
+    }
+  }
+
+  in = std::string_view{tables}.substr(header.symbolsOffset - sizeof(header));
+  for (u32 i = 0; i < header.symbolCount; i++) {
+    u32 address;
+    u16 length;
+    if (!extract(in, address) || !extract(in, length) || in.size() < length) {
+      throw std::runtime_error(std::format("ERROR! Snapshot {} has malformed symbols\n", path));
+    }
+
+    snapshot->symbols.emplace(std::string(in.substr(0, length)), address);
+    in.remove_prefix(length);
+  }
+
+  return snapshot;
+}
+
+auto Snapshot::mapPages(Memory& memory) const -> void {
+  if (this->addresses.empty())
+    return;
+
+  size_t size = this->addresses.size() * size_t(Memory::PAGE_SIZE);
+  int fd = ::open(this->path.c_str(), O_RDONLY);
+  if (fd < 0) {
+    throw std::runtime_error(std::format("ERROR! Couldn't open {}\n", this->path));
+  }
+
+  // One private mapping for every page, nothing is read until it's used
+  void* pages = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, this->pagesOffset);
+  ::close(fd);
+  if (pages == MAP_FAILED) {
+    throw std::runtime_error(std::format("ERROR! Couldn't map {}\n", this->path));
+  }
+  std::shared_ptr<void> owner(pages, [size](void* pages) { munmap(pages, size); });
+
+  // Pages were saved in address order, consecutive ones are handed over
+  // as a single region
+  u8* base = static_cast<u8*>(pages);
+  size_t first = 0;
+  for (size_t i = 1; i <= this->addresses.size(); i++) {
+    if (i < this->addresses.size() &&
+        u64(this->addresses[i]) == u64(this->addresses[i - 1]) + Memory::PAGE_SIZE)
+      continue;
+
+    std::span<u8> region{base + first * Memory::PAGE_SIZE, (i - first) * Memory::PAGE_SIZE};
+    memory.map(this->addresses[first], region, owner);
+    first = i;
+  }
+}
+
+} // namespace Emulator
@@ -0,0 +1,58 @@
+#pragma once
+
+#include "CPU.hpp"
+#include "Tokenizer.hpp"
+
+#include <memory>
+
+namespace Emulator {
+
+// State of a running guest saved to disk, restoring it resumes the program
+// where it was saved instead of running it again from the start. Fields are
+// in host byte order:
+//
+//   header    magic "MIPS", version, pc, halt, retired instructions, text
+//             segment, entry point, register file, page and symbol counts,
+//             where the symbols and pages are, hi, lo and the encoding of
+//             the program
+//   addresses guest address of every saved page
+//   symbols   address, name length, name (labelsToAddress)
+//   pages     contents of the pages, each at a page aligned offset so they
+//             can be mapped straight into guest memory
+//
+// Only pages holding something other than zeros are saved, untouched
+// memory reads as zeros anyway. Console input and output aren't part of it
+class Snapshot {
+public:
+  static constexpr u32 MAGIC = 0x5350494D; // "MIPS"
+  static constexpr u32 VERSION = 2;
+
+  std::array<u32, 32> registers{};
+  u32 hi = 0;
+  u32 lo = 0;
+  Encoding encoding = Encoding::ASSEMBLER;
+  u32 pc = 0;
+  bool halt = false;
+  u64 retired = 0;
+  u32 textStart = 0;
+  u32 textEnd = 0;
+  u32 entry = 0;
+  std::vector<u32> addresses;
+  Labels symbols;
+
+  // Saves the registers and memory of cpu along with the labels of the program
+  static auto write(const std::string& path, const CPU& cpu, const Tokenizer& tokenizer) -> void;
+
+  // Reads everything but the pages, throws when it isn't a valid snapshot
+  static auto open(const std::string& path) -> std::unique_ptr<Snapshot>;
+
+  // Maps the saved pages privately into memory, the guest writes to its own
+  // copy of a page the first time it changes it and the file is never touched
+  auto mapPages(Memory& memory) const -> void;
+
+private:
+  std::string path;
+  u32 pagesOffset = 0;
+};
+
+} // namespace Emulator
@@ -0,0 +1,242 @@
+#include "Threaded.hpp"
+
+#include <atomic>
+
+// Labels as values and computed gotos are a GNU extension
+#pragma GCC diagnostic ignored "-Wpedantic"
+
+namespace Emulator {
+
+// Looks up the decoded instruction at pc and jumps to its body. Words
+// outside the text segment are left to the regular fetch path
+#define DISPATCH                                              \
+  do {                                                        \
+    if (retired >= limit)                                     \
+      goto out;                                               \
+    offset = cpu.pc - textStart;                              \
+    index = offset >> 2;                                      \
+    if ((offset & 3) != 0 || index >= size)                   \
+      goto slow;                                              \
+    op = &ops[index];                                         \
+    if (op->handler == nullptr)                               \
+      goto decode;                                            \
+    goto *table[static_cast<u8>(op->kind)];                   \
+  } while (0)
+
+// Retires the instruction that just ran and moves on to the next one
+#define NEXT                                                  \
+  do {                                                        \
+    retired++;                                                \
+    DISPATCH;                                                 \
+  } while (0)
+
+auto ThreadedInterpreter::run(CPU& cpu, u64 limit) -> void {
+  // Same order as Op
+  static const void* const table[] = {
+    &&op_sll, &&op_mul, &&op_srl, &&op_jr, &&op_add, &&op_sub, &&op_and,
+    &&op_or, &&op_nor, &&op_slt, &&op_syscall, &&op_nop,
+    &&op_beq, &&op_bne, &&op_blt, &&op_bge, &&op_addi, &&op_slti,
+    &&op_andi, &&op_ori, &&op_lw, &&op_lbu, &&op_sb, &&op_sw,
+    &&op_j, &&op_jal, &&op_ll, &&op_sc, &&op_sync,
+    &&op_handler, &&op_handler, &&op_handler, &&op_handler, &&op_delayed, &&op_handler, &&op_handler,
+    &&op_handler, &&op_handler, &&op_handler, &&op_handler, &&op_handler, &&op_handler, &&op_handler,
+    &&op_handler, &&op_handler, &&op_handler, &&op_handler, &&op_handler, &&op_handler, &&op_handler,
+    &&op_handler, &&op_handler, &&op_handler, &&op_handler, &&op_handler, &&op_handler, // SRA to SH
+    &&op_delayed, &&op_delayed, &&op_delayed, &&op_delayed, &&op_delayed, &&op_delayed, &&op_delayed,
+    &&op_handler,
+  };
+  static_assert(std::size(table) == static_cast<size_t>(Op::COUNT));
+
+  // $zero is written freely and cleared right after, which is cheaper
+  // than testing the destination of every instruction
+  u32* r = cpu.registers.data();
+  DecodedOp* ops = cpu.decoded.data();
+  const u32 size = static_cast<u32>(cpu.decoded.size());
+  const u32 textStart = cpu.textStart;
+  DecodedOp* op;
+  u32 offset, index;
+
+  // Kept in a local while running, the CPU gets it back however we leave
+  u64 retired = cpu.retired;
+
+  try {
+
+  DISPATCH;
+
+slow:
+  cpu.fetchInstruction();
+  retired++;
+  if (cpu.hasHalted())
+    goto out;
+  DISPATCH;
+
+decode:
+  *op = Decoder::decode(cpu.memory.readWord(cpu.pc), cpu.pc, cpu.encoding);
+  goto *table[static_cast<u8>(op->kind)];
+
+op_sll:
+  r[op->rd] = r[op->rt] << op->shamt; r[0] = 0;
+  cpu.pc += 4;
+  NEXT;
+
+op_mul:
+  r[op->rd] = r[op->rs] * r[op->rt]; r[0] = 0;
+  cpu.pc += 4;
+  NEXT;
+
+op_srl:
+  r[op->rd] = r[op->rt] >> op->shamt; r[0] = 0;
+  cpu.pc += 4;
+  NEXT;
+
+op_jr:
+  cpu.pc = r[op->rs] - 4;
+  NEXT;
+
+op_add:
+  r[op->rd] = r[op->rs] + r[op->rt]; r[0] = 0;
+  cpu.pc += 4;
+  NEXT;
+
+op_sub:
+  r[op->rd] = r[op->rs] - r[op->rt]; r[0] = 0;
+  cpu.pc += 4;
+  NEXT;
+
+op_and:
+  r[op->rd] = r[op->rs] & r[op->rt]; r[0] = 0;
+  cpu.pc += 4;
+  NEXT;
+
+op_or:
+  r[op->rd] = r[op->rs] | r[op->rt]; r[0] = 0;
+  cpu.pc += 4;
+  NEXT;
+
+op_nor:
+  r[op->rd] = ~(r[op->rs] | r[op->rt]); r[0] = 0;
+  cpu.pc += 4;
+  NEXT;
+
+op_slt:
+  r[op->rd] = r[op->rs] < r[op->rt] ? 1 : 0; r[0] = 0;
+  cpu.pc += 4;
+  NEXT;
+
+op_syscall:
+  cpu.executeSyscall();
+  cpu.pc += 4;
+  retired++;
+  if (cpu.hasHalted())
+    goto out;
+  DISPATCH;
+
+op_nop:
+  cpu.pc += 4;
+  NEXT;
+
+op_beq:
+  cpu.pc = r[op->rs] == r[op->rt] ? op->target : cpu.pc + 4;
+  NEXT;
+
+op_bne:
+  cpu.pc = r[op->rs] != r[op->rt] ? op->target : cpu.pc + 4;
+  NEXT;
+
+op_blt:
+  cpu.pc = s32(r[op->rt]) < s32(r[op->rs]) ? op->target : cpu.pc + 4;
+  NEXT;
+
+op_bge:
+  cpu.pc = s32(r[op->rt]) >= s32(r[op->rs]) ? op->target : cpu.pc + 4;
+  NEXT;
+
+op_addi:
+  r[op->rt] = r[op->rs] + op->imm; r[0] = 0;
+  cpu.pc += 4;
+  NEXT;
+
+op_slti:
+  r[op->rt] = r[op->rs] < u32(op->imm) ? 1 : 0; r[0] = 0;
+  cpu.pc += 4;
+  NEXT;
+
+op_andi:
+  r[op->rt] = r[op->rs] & u32(op->imm); r[0] = 0;
+  cpu.pc += 4;
+  NEXT;
+
+op_ori:
+  r[op->rt] = r[op->rs] | u32(op->imm); r[0] = 0;
+  cpu.pc += 4;
+  NEXT;
+
+op_lw:
+  r[op->rt] = cpu.readWord(u32(r[op->rs] + op->imm)); r[0] = 0;
+  cpu.pc += 4;
+  NEXT;
+
+op_lbu:
+  r[op->rt] = cpu.memory.read(u32(r[op->rs] + op->imm)); r[0] = 0;
+  cpu.pc += 4;
+  NEXT;
+
+op_sb:
+  cpu.writeMemory(u32(r[op->rt] + op->imm), static_cast<u8>(r[op->rs]));
+  cpu.pc += 4;
+  NEXT;
+
+op_sw:
+  cpu.writeWord(u32(r[op->rs] + op->imm), r[op->rt]);
+  cpu.pc += 4;
+  NEXT;
+
+op_j:
+  cpu.pc = op->target;
+  NEXT;
+
+op_jal:
+  r[31] = cpu.pc + 8;
+  cpu.pc = op->target;
+  NEXT;
+
+op_ll:
+  r[op->rt] = cpu.loadLinked(u32(r[op->rs] + op->imm)); r[0] = 0;
+  cpu.pc += 4;
+  NEXT;
+
+op_sc:
+  r[op->rt] = cpu.storeConditional(u32(r[op->rs] + op->imm), r[op->rt]); r[0] = 0;
+  cpu.pc += 4;
+  NEXT;
+
+op_sync:
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  cpu.pc += 4;
+  NEXT;
+
+// What only MIPS32 programs use and unknown words
+op_handler:
+  op->handler(cpu, *op);
+  NEXT;
+
+// Branches and jumps with a delay slot, which retire the slot in cpu.retired
+op_delayed:
+  cpu.retired = retired;
+  op->handler(cpu, *op);
+  retired = cpu.retired;
+  NEXT;
+
+  } catch (...) {
+    cpu.retired = retired;
+    throw;
+  }
+
+out:
+  cpu.retired = retired;
+}
+
+#undef NEXT
+#undef DISPATCH
+
+} // namespace Emulator
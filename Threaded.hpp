@@ -0,0 +1,16 @@
+#pragma once
+
+#include "CPU.hpp"
+
+namespace Emulator {
+
+// Interpreter built with GCC's labels as values: every instruction body
+// ends with its own indirect jump straight into the body of the next one,
+// instead of going back through the execute/executeR/executeImm switches
+class ThreadedInterpreter {
+public:
+  // Runs until the program halts or has retired limit instructions
+  static auto run(CPU& cpu, u64 limit) -> void;
+};
+
+} // namespace Emulator
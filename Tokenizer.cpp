@@ -1,6 +1,14 @@
 #include "Tokenizer.hpp"
+#include "Parallel.hpp"
 #include "debugHelper.hpp"
 
+#include <charconv>
+#include <memory>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
 namespace Emulator {
 
 static constexpr u64 WORD_SIZE = 4;
@@ -9,124 +17,125 @@ static constexpr std::string_view ASCIIZ_DIRECTIVE = ".asciiz";
 static constexpr std::string_view SPACE_DIRECTIVE = ".space";
 static constexpr std::string_view TEXT_SECTION = ".text";
 static constexpr std::string_view DATA_SECTION = ".data";
+static constexpr std::string_view WHITESPACE = " \t\n\v\f\r";
+
+
+// Drops leading and trailing whitespace
+static auto trim(std::string_view text) -> std::string_view {
+  size_t first = text.find_first_not_of(WHITESPACE);
+  if (first == std::string_view::npos)
+    return {};
+
+  return text.substr(first, text.find_last_not_of(WHITESPACE) - first + 1);
+}
+
+// Calls each() with every non-empty piece of text between delimiters
+template <typename Each>
+static auto split(std::string_view text, std::string_view delimiters, Each each) -> void {
+  size_t position = 0;
+  while (position < text.size()) {
+    size_t start = text.find_first_not_of(delimiters, position);
+    if (start == std::string_view::npos)
+      return;
+
+    size_t end = std::min(text.find_first_of(delimiters, start), text.size());
+    each(text.substr(start, end - start));
+    position = end;
+  }
+}
 
+// Parses the leading decimal number of text like std::stoi
+static auto parseNumber(std::string_view text) -> s32 {
+  std::string_view digits = trim(text);
+  if (digits.starts_with('+'))
+    digits.remove_prefix(1);
 
-static const std::unordered_map<std::string_view, u8> 
-mnemonicArgsSizeMap = {
-  {"addi", 3},
-  {"andi", 3},
-  {"ori" , 3},
-  {"add" , 3},
-  {"sub" , 3},
-  {"and" , 3},
-  {"or"  , 3},
-  {"nor" , 3},
-  {"sll" , 3},
-  {"srl" , 3},
-  {"slt" , 3},
-  {"jr"  , 1},
-  {"beq" , 3},
-  {"bne" , 3},
-  {"j"   , 1},
-  {"jal" , 1},
-  {"sw"  , 3},
-  {"lw"  , 3},
-  {"slti", 3},
-  {"lbu" , 3},
-  {"sb"  , 3},
-  {"mul" , 3},
-  // Pseudo instructions
-  {"blt" , 3},
-  {"bge" , 3},
-  {"move", 2},
-  {"li"  , 2},
-  {"la"  , 2},
-};
-
-static const std::unordered_map<std::string_view, u64> 
-RegisterNames = {
-    {"$zero",  0},
-    {"$at" ,  1},
-    {"$v0" ,  2},
-    {"$v1" ,  3},
-    {"$a0" ,  4},
-    {"$a1" ,  5},
-    {"$a2" ,  6},
-    {"$a3" ,  7},
-    {"$t0" ,  8},
-    {"$t1" ,  9},
-    {"$t2" , 10},
-    {"$t3" , 11},
-    {"$t4" , 12},
-    {"$t5" , 13},
-    {"$t6" , 14},
-    {"$t7" , 15},
-    {"$s0" , 16},
-    {"$s1" , 17},
-    {"$s2" , 18},
-    {"$s3" , 19},
-    {"$s4" , 20},
-    {"$s5" , 21},
-    {"$s6" , 22},
-    {"$s7" , 23},
-    {"$t8" , 24},
-    {"$t9" , 25},
-    {"$k0" , 26},
-    {"$k1" , 27},
-    {"$gp" , 28},
-    {"$sp" , 29},
-    {"$fp" , 30},
-    {"$ra" , 31},
-};
-
-auto Tokenizer::isSysCall(const std::string& call) -> bool {
+  s32 value = 0;
+  auto [end, error] = std::from_chars(digits.data(), digits.data() + digits.size(), value);
+  if (error == std::errc::result_out_of_range) {
+    throw std::out_of_range(std::format("ERROR! Number {} doesn't fit in 32 bits\n", text));
+  }
+  if (error != std::errc{}) {
+    throw std::invalid_argument(std::format("ERROR! Invalid number {}\n", text));
+  }
+  return value;
+}
+
+auto Tokenizer::isSysCall(std::string_view call) -> bool {
   return call == "syscall";
 }
 
-auto Tokenizer::isLabel(const std::string& label) -> bool {
+auto Tokenizer::isLabel(std::string_view label) -> bool {
   return label.back() == ':';
 }
 
-auto Tokenizer::tokenizeLabel(std::string& symbol, u64 address) -> void {
-  symbol.erase(symbol.begin() + symbol.size() - 1); // remove ':'
-  this->labelsToAddress[symbol] = address;
+auto Tokenizer::tokenizeLabel(std::string_view symbol, u64 address) -> void {
+  symbol.remove_suffix(1); // remove ':'
+  this->labelsToAddress.insert_or_assign(std::string(symbol), address);
 }
 
-auto Tokenizer::tokenizeSysCall(std::string& symbol, u64 address) -> void {
-  Token SysCallToken;
-  SysCallToken.tokenType = Type::SYS_CALL;
-  SysCallToken.value = symbol;
-  SysCallToken.address = address;
-  this->tokens.push_back(SysCallToken);
+auto Tokenizer::tokenizeSysCall(u64 address) -> void {
+  Token& sysCallToken = this->tokens.emplace_back();
+  sysCallToken.tokenType = Type::SYS_CALL;
+  sysCallToken.mnemonic = Mnemonic::SYSCALL;
+  sysCallToken.address = static_cast<u32>(address);
 }
 
-auto Tokenizer::tokenizeInstruction(VecString& symbols, u64 address, std::unordered_map<u64, VecString>& _args) -> void {
-  Token instructionToken;
+auto Tokenizer::tokenizeInstruction(std::string_view line, u64 address) -> void {
+  Token& instructionToken = this->tokens.emplace_back();
   instructionToken.tokenType = Type::INSTRUCTION;
-  instructionToken.value = symbols[0];
-  instructionToken.address = address;
-  
-  std::vector<std::string> args;
-  for (size_t i = 1; i < size(symbols); i++) {
-      args.push_back(symbols[i]);
-  }
+  instructionToken.address = static_cast<u32>(address);
 
-  // boost::split creates an empty token when string ends with a delimiter, in that case, it should be removed 
-  std::erase_if(args, [](const std::string& str) { return str.empty(); });
+  this->pending.push_back({static_cast<u32>(this->tokens.size() - 1), line});
+}
 
-  if (!validateArgumentsSize(symbols[0], args)) {
+auto Tokenizer::parseInstruction(std::string_view line, Token& token) -> void {
+  std::array<std::string_view, 4> symbols;
+  size_t count = 0;
+  split(line, ", ()", [&](std::string_view symbol) {
+    if (count < symbols.size()) {
+      symbols[count] = symbol;
+    }
+    count++;
+  });
+
+  Mnemonic mnemonic = this->parseMnemonic(symbols[0]);
+  size_t arguments = count - 1;
+  if (!validateArgumentsSize(mnemonic, arguments)) {
     throw std::invalid_argument(
-      std::format("ERROR! Not enough arguments in instruction {} size {}\n", instructionToken.value, args.size())
+      std::format("ERROR! Not enough arguments in instruction {} size {}\n", symbols[0], arguments)
     );
   }
 
-  this->tokens.push_back(instructionToken);
-  _args[address] = args;
+  // "lw $rt, $rs, offset" is accepted too, its operands are kept in the
+  // order of "lw $rt, offset($rs)"
+  if (Instructions::info(mnemonic).operands == Operands::RT_OFFSET_RS && symbols[2].starts_with('$')) {
+    std::swap(symbols[2], symbols[3]);
+  }
+
+  token.mnemonic = mnemonic;
+  token.argsSize = static_cast<u8>(arguments);
+
+  for (size_t i = 0; i < arguments; i++) {
+    token.args[i] = this->parseArgument(symbols[i + 1]);
+  }
+}
+
+auto Tokenizer::parseInstructions() -> void {
+  // Below this many instructions a thread costs more than it saves
+  static constexpr size_t GRAIN = 16384;
+
+  parallelFor(this->pending.size(), GRAIN, [this](size_t begin, size_t end) {
+    for (size_t i = begin; i < end; i++) {
+      this->parseInstruction(this->pending[i].line, this->tokens[this->pending[i].token]);
+    }
+  });
+  this->pending.clear();
 }
 
-auto Tokenizer::tokenizeDataSection(std::string& line, u64& address) -> void {
-  VecString symbols;
-  boost::split(symbols, line, boost::is_any_of(": "), boost::token_compress_on);
+auto Tokenizer::tokenizeDataSection(std::string_view line, u64& address) -> void {
+  std::vector<std::string_view> symbols;
+  split(line, ": ", [&](std::string_view symbol) { symbols.push_back(symbol); });
 
   if (symbols.size() < 3) {
     throw std::runtime_error(
@@ -134,102 +143,102 @@ auto Tokenizer::tokenizeDataSection(std::string& line, u64& address) -> void {
     );
   }
 
-  if (symbols.at(1) == WORD_DIRECTIVE) {
-    Token literalToken = {
-      .tokenType = Type::LITERAL,
-      .address = address,
-      .value = symbols.at(0),
-      .directive = Directive::WORD,
-    };
+  Token& literalToken = this->tokens.emplace_back();
+  literalToken.tokenType = Type::LITERAL;
+  literalToken.address = static_cast<u32>(address);
+  literalToken.literal.data = static_cast<u32>(this->literals.size());
 
-    u8 numberOfLiterals = 0;
+  if (symbols[1] == WORD_DIRECTIVE) {
+
+    literalToken.directive = Directive::WORD;
     for (size_t i = 2; i < symbols.size(); i++) {
-      literalToken.args.push_back(std::stoi(symbols[i]));
-      numberOfLiterals++;
+      u32 value = static_cast<u32>(parseNumber(symbols[i]));
+      for (size_t byte = 0; byte < WORD_SIZE; byte++) {
+        this->literals.push_back(static_cast<u8>(value >> byte * 8));
+      }
     }
-    this->tokens.push_back(literalToken);
-    this->labelsToAddress[literalToken.value] = address;
-
-    address += WORD_SIZE * numberOfLiterals;
-
-  } else if (symbols.at(1) == SPACE_DIRECTIVE) {
-
-    Token literalToken = {
-      .tokenType = Type::LITERAL,
-      .address = address,
-      .value = symbols.at(0),
-      .directive = Directive::SPACE,
-    };
+    literalToken.literal.size = static_cast<u32>(this->literals.size() - literalToken.literal.data);
 
-    literalToken.args.push_back(std::stoi(symbols.at(2)));
-    this->tokens.push_back(literalToken);
-    this->labelsToAddress[literalToken.value] = address;
+  } else if (symbols[1] == SPACE_DIRECTIVE) {
 
-    address += literalToken.args.front();
+    literalToken.directive = Directive::SPACE;
+    literalToken.literal.size = static_cast<u32>(parseNumber(symbols[2]));
 
-  } else if (symbols.at(1) == ASCIIZ_DIRECTIVE) {
+  } else if (symbols[1] == ASCIIZ_DIRECTIVE) {
 
-    std::string strValue;
-    for (u32 i = 2; i < symbols.size(); i++) {
-      strValue.append(symbols.at(i));
-      strValue.append(" ");
-    }
-    
-    // Remove '"' from string
-    std::erase_if(strValue, [](char c) { return c == '"'; });
-
-    Token literalToken = {
-      .tokenType = Type::LITERAL,
-      .address = address,
-      .value =  symbols.at(0),
-      .directive = Directive::ASCIIZ,
-    };
-
-    for (char c: strValue) {
-      literalToken.args.push_back(static_cast<u8>(c));
+    // The words of the string are joined back with a space after each one
+    literalToken.directive = Directive::ASCIIZ;
+    for (size_t i = 2; i < symbols.size(); i++) {
+      for (char c : symbols[i]) {
+        if (c != '"') {
+          this->literals.push_back(static_cast<u8>(c));
+        }
+      }
+      this->literals.push_back(' ');
     }
-    literalToken.args.push_back(0); // Null terminate string ('\0')
-
-    this->tokens.push_back(literalToken);
-    this->labelsToAddress[literalToken.value] = address;
-
-    address += literalToken.args.size();
+    this->literals.push_back(0); // Null terminate string ('\0')
+    literalToken.literal.size = static_cast<u32>(this->literals.size() - literalToken.literal.data);
 
   } else {
     throw std::runtime_error{
-                              std::format("ERROR! Directive {} doesn't exist\n", symbols.at(1))
+                              std::format("ERROR! Directive {} doesn't exist\n", symbols[1])
                             };
   }
-}
 
+  address += literalToken.literal.size;
+  this->labelsToAddress.insert_or_assign(std::string(symbols[0]), literalToken.address);
+}
 
 auto Tokenizer::tokenize(const std::string& file) -> void {
-  std::ifstream _file{file};
-
-  if (!_file.is_open()) {
+  int fd = ::open(file.c_str(), O_RDONLY);
+  struct stat status;
+  if (fd < 0 || fstat(fd, &status) != 0) {
+    if (fd >= 0)
+      ::close(fd);
     throw std::runtime_error(
       std::format("Couldn't open file {}", file)
     );
   }
 
-  std::string line;
-  std::string section;
+  // The source is only read through string_views into the mapping
+  size_t size = status.st_size;
+  void* source = size > 0 ? mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0) : nullptr;
+  ::close(fd);
+  if (source == MAP_FAILED) {
+    throw std::runtime_error(std::format("Couldn't map file {}", file));
+  }
+
+  std::shared_ptr<void> owner(source, [size](void* source) {
+    if (source != nullptr)
+      munmap(source, size);
+  });
+
+  this->tokenizeSource({static_cast<const char*>(source), size});
+}
+
+auto Tokenizer::tokenizeSource(std::string_view source) -> void {
+  std::string_view section;
   u64 address = 0;
-  std::unordered_map<u64, VecString> _args;
+  this->pending.clear();
+
+  // Every line is at most one token
+  this->tokens.reserve(this->tokens.size() + std::count(source.begin(), source.end(), '\n') + 1);
+
+  while (!source.empty()) {
+    size_t end = std::min(source.find('\n'), source.size());
+    std::string_view line = trim(source.substr(0, end));
+    source.remove_prefix(std::min(end + 1, source.size()));
 
-  while (std::getline(_file, line)) {
-    VecString symbols;
-    boost::trim(line);
     if (line.empty() || line.starts_with('#')) {
       continue;
     }
-    this->removeInlineComments(line);
+    line = this->removeInlineComments(line);
 
     if (line == DATA_SECTION) {
-      section = ".data";
+      section = DATA_SECTION;
       continue;
     } else if (line == TEXT_SECTION) {
-      section = ".text";
+      section = TEXT_SECTION;
       this->textStartAddress = address;
       continue;
     }
@@ -237,19 +246,21 @@ auto Tokenizer::tokenize(const std::string& file) -> void {
     if (section == DATA_SECTION) {
 
       this->tokenizeDataSection(line, address);
-      
+
     } else if (section == TEXT_SECTION) {
 
-      boost::split(symbols, line, boost::is_any_of(", ()"), boost::token_compress_on);
-      std::string tag = symbols[0];
+      size_t first = line.find_first_not_of(", ()");
+      if (first == std::string_view::npos)
+        continue;
+      std::string_view tag = line.substr(first, line.find_first_of(", ()", first) - first);
 
       if (this->isLabel(tag)) {
         this->tokenizeLabel(tag, address);
       } else if (this->isSysCall(tag)) {
-        this->tokenizeSysCall(tag, address);
+        this->tokenizeSysCall(address);
         address += 4;
       } else {
-        this->tokenizeInstruction(symbols, address, _args);
+        this->tokenizeInstruction(line, address);
         address += 4;
       }
 
@@ -257,62 +268,60 @@ auto Tokenizer::tokenize(const std::string& file) -> void {
       throw std::runtime_error("ERROR! Directive not found\n");
     }
   }
-  _file.close();
 
-  for (auto& token : this->tokens) {  
-    if (token.tokenType == Type::INSTRUCTION) {
-      token.args = this->parseArgs(_args[token.address]);
-    }
-  }
+  this->parseInstructions();
 }
 
-auto Tokenizer::removeInlineComments(std::string& line) -> void {
-  size_t commentPos = line.find('#');
-  if (commentPos != std::string::npos) {
-    line = line.substr(0, commentPos);
-  }
-  line.erase(line.find_last_not_of(" \t") + 1);
+auto Tokenizer::removeInlineComments(std::string_view line) -> std::string_view {
+  line = line.substr(0, line.find('#'));
+  size_t last = line.find_last_not_of(" \t");
+  return last == std::string_view::npos ? std::string_view{} : line.substr(0, last + 1);
 }
 
-auto Tokenizer::parseArgs(const VecString& args) -> VecU64 {
-  VecU64 parsedArgs;
-  for (const auto& arg: args) {
-    if (this->labelsToAddress.contains(arg)) {
-      parsedArgs.push_back(this->labelsToAddress[arg]);
-    } else if (std::isdigit(arg.front()) || arg.front() == '-') {
-      parsedArgs.push_back(static_cast<u64>(std::stoi(arg)));
-    } else {
-      parsedArgs.push_back(this->parseRegister(arg.data()));
-    }
+auto Tokenizer::parseArgument(std::string_view arg) const -> u32 {
+  if (std::isdigit(arg.front()) || arg.front() == '-')
+    return static_cast<u32>(parseNumber(arg));
+
+  if (arg.front() == '$')
+    return static_cast<u32>(this->parseRegister(arg));
+
+  auto it = this->labelsToAddress.find(arg);
+  if (it == this->labelsToAddress.end()) {
+    throw std::runtime_error{std::format("ERROR! Label {} doesn't exist\n", arg)};
   }
+  return static_cast<u32>(it->second);
+}
 
-  return parsedArgs;
+auto Tokenizer::name(Mnemonic mnemonic) -> std::string_view {
+  return Instructions::info(mnemonic).name;
 }
 
-auto Tokenizer::validateArgumentsSize(const std::string& mnemonic, const VecString& args) -> bool {
-  auto it = mnemonicArgsSizeMap.find(mnemonic);
-  if (it == mnemonicArgsSizeMap.end()) {
+auto Tokenizer::parseMnemonic(std::string_view mnemonic) const -> Mnemonic {
+  auto found = Instructions::find(mnemonic);
+  if (!found) {
     throw std::invalid_argument(
       std::format("ERROR! mnemonic not found {}\n", mnemonic)
     );
   }
-  return args.size() == it->second;
+  return *found;
 }
 
-auto Tokenizer::parseRegister(const char *arg) -> u64 {
-  if (RegisterNames.contains(std::string(arg))) {
-    return RegisterNames.at(arg);
-  }
+auto Tokenizer::validateArgumentsSize(Mnemonic mnemonic, size_t size) const -> bool {
+  return size == Instructions::info(mnemonic).argsSize;
+}
 
-  if (arg[0] != '$') {
-    throw std::runtime_error{std::format("ERROR! Register doesn't exist {} \n", arg)};
+auto Tokenizer::parseRegister(std::string_view arg) const -> u64 {
+  if (int index = Instructions::findRegister(arg); index >= 0) {
+    return static_cast<u64>(index);
   }
 
-  if (!std::isdigit(arg[1])) {
+  if (arg.size() < 2 || arg[0] != '$' || !std::isdigit(arg[1])) {
     throw std::runtime_error{std::format("ERROR! Register doesn't exist {} \n", arg)};
   }
 
-  return std::atoi(arg + 1);
+  u64 number = 0;
+  std::from_chars(arg.data() + 1, arg.data() + arg.size(), number);
+  return number;
 }
 
 auto Tokenizer::printTokens() -> void {
@@ -332,9 +341,13 @@ auto Tokenizer::printTokens() -> void {
         type = "LABEL";
       break;
     }
-    std::cout << std::format("token\n address {}, type {}, value ``{}``, args\n", token.address, type, token.value);
-    for (const auto& arg : token.args) {
-      std::cout << std::format("\t arg ``{}``\n", arg);
+    if (token.tokenType == Type::LITERAL) {
+      std::cout << std::format("token\n address {}, type {}, {} bytes\n", token.address, type, token.literal.size);
+    } else {
+      std::cout << std::format("token\n address {}, type {}, value ``{}``, args\n", token.address, type, name(token.mnemonic));
+    }
+    for (size_t i = 0; i < token.argsSize; i++) {
+      std::cout << std::format("\t arg ``{}``\n", token.args[i]);
     }
     std::cout << "----------------------------------------------------\n";
   }
@@ -2,68 +2,129 @@
 #define _TOKENIZER_
 
 #include "Config.hpp"
+#include "Instructions.hpp"
+
+#include <array>
+#include <type_traits>
+#include <unordered_map>
 
 namespace Emulator {
 
-enum class Type { INSTRUCTION, SYS_CALL, LABEL, LITERAL };
+enum class Type : u8 { INSTRUCTION, SYS_CALL, LABEL, LITERAL };
 
-enum class Directive { WORD, SPACE, ASCIIZ };
+enum class Directive : u8 { WORD, SPACE, ASCIIZ };
 
+// Plain data, a program is one contiguous array of these. Instructions keep
+// their operands inline, literals point at their bytes in Tokenizer::literals
 struct Token {
+  static constexpr size_t MAX_ARGS = 3;
+
+  // Where the bytes of a literal are
+  struct Literal {
+    u32 data; // Offset in Tokenizer::literals
+    u32 size; // Bytes it takes in the program
+  };
+
   Type tokenType;
-  u64 address;
-  VecU64 args;
-  std::string value;
   Directive directive;
+  Mnemonic mnemonic;
+  u8 argsSize;
+  u32 address;
+  union {
+    std::array<u32, MAX_ARGS> args; // Registers, immediates and label addresses
+    Literal literal;
+  };
 };
 
+static_assert(std::is_trivially_copyable_v<Token> && sizeof(Token) == 20);
+
+// Lets labels be looked up by std::string_view without building a std::string
+struct LabelHash {
+  using is_transparent = void;
+
+  auto operator()(std::string_view label) const -> size_t {
+    return std::hash<std::string_view>{}(label);
+  }
+};
+
+using Labels = std::unordered_map<std::string, u64, LabelHash, std::equal_to<>>;
+
 class Tokenizer {
 public:
   std::vector<Token> tokens;
-  std::unordered_map<std::string, u64> labelsToAddress;
-  u64 textStartAddress;
+  Labels labelsToAddress;
+  u64 textStartAddress = 0;
+
+  // Bytes of every .word and .asciiz, in program order
+  std::vector<u8> literals;
+
+  // Self-explanatory
+  static auto name(Mnemonic mnemonic) -> std::string_view;
+
+  // Finds the mnemonic of an instruction, throws when there is none
+  auto parseMnemonic(std::string_view mnemonic) const -> Mnemonic;
 
   // Parses the register's number
-  auto parseRegister(const char *arg) -> u64;
+  auto parseRegister(std::string_view arg) const -> u64;
 
-  // Parses the label 
-  auto tokenizeLabel(std::string& symbol, u64 address) -> void;
+  // Parses the label
+  auto tokenizeLabel(std::string_view symbol, u64 address) -> void;
 
   // Parses the syscall
-  auto tokenizeSysCall(std::string& symbol, u64 address) -> void;
+  auto tokenizeSysCall(u64 address) -> void;
+
+  // Adds an instruction whose line is parsed later, by parseInstructions()
+  auto tokenizeInstruction(std::string_view line, u64 address) -> void;
 
-  // Parses an Instruction
-  // Parameter _args stores the address from a label (wether the instruction has any as argument)
-  auto tokenizeInstruction(VecString& symbols, u64 address, std::unordered_map<u64, VecString>& _args) -> void;
+  // Parses the mnemonic and arguments of an instruction into token, every
+  // label has to be known by then
+  auto parseInstruction(std::string_view line, Token& token) -> void;
+
+  // Parses every instruction added by tokenizeInstruction(), in chunks on
+  // as many threads as there are cores
+  auto parseInstructions() -> void;
 
   // Parses the data section
-  auto tokenizeDataSection(std::string& line, u64& address) -> void;
+  auto tokenizeDataSection(std::string_view line, u64& address) -> void;
 
   // Self-explanatory
-  auto removeInlineComments(std::string& line) -> void;
-  
-  // Self-explanatory
-  //auto isNumber(const char& c) -> bool;
+  auto removeInlineComments(std::string_view line) -> std::string_view;
 
   // Self-explanatory
-  auto isSysCall(const std::string& call) -> bool;
+  auto isSysCall(std::string_view call) -> bool;
 
   // Self-explanatory
-  auto isLabel(const std::string& label) -> bool; 
+  auto isLabel(std::string_view label) -> bool;
 
-  // Parses arguments from an instruction
-  auto parseArgs(const VecString& args) -> VecU64;
+  // Parses a register, an immediate or the address of a label
+  auto parseArgument(std::string_view arg) const -> u32;
 
   // Verifies if total of arguments matches the respectively instruction
-  auto validateArgumentsSize(const std::string& mnemonic, const VecString& args) -> bool;
+  auto validateArgumentsSize(Mnemonic mnemonic, size_t size) const -> bool;
 
   // Parses the asm file
   auto tokenize(const std::string& file) -> void;
 
+  // Parses asm source already in memory
+  auto tokenizeSource(std::string_view source) -> void;
+
   // Debug purposes
   auto printTokens() -> void;
+
+private:
+  // An instruction still to be parsed, labels can be defined after they're used.
+  // This replaces the fixup list on purpose: parsing a line as soon as it was
+  // read left forward labels to patch later, but it also tied parsing to the
+  // one thread reading the source. Parsing once every label is known needs no
+  // fixups, and the parsing, not the lookups, is what's worth splitting
+  struct PendingInstruction {
+    u32 token;
+    std::string_view line; // Points into the source
+  };
+
+  std::vector<PendingInstruction> pending;
 };
 
 } // namespace Emulator
 
-#endif // _TOKENIZER_
\ No newline at end of file
+#endif // _TOKENIZER_
@@ -0,0 +1,398 @@
+#include "Trace.hpp"
+
+#include <cstring>
+#include <zlib.h>
+
+namespace Emulator {
+
+// Bits of the flags byte starting every encoded record
+static constexpr u8 JUMP = 1;
+static constexpr u8 WORD = 2;
+static constexpr u8 VALUE = 4;
+static constexpr u8 ADDRESS = 8;
+static constexpr u8 MIPS32 = 16;
+
+// Bytes handed to zlib at once, both ways
+static constexpr size_t CHUNK = 1 << 16;
+
+// Records the writer takes out of the ring at once
+static constexpr size_t BATCH = 4096;
+
+// What both ends of a trace remember of the records before, they must
+// update it the same way
+struct Delta {
+  static constexpr u32 WORD_SLOTS = 1 << 16;
+
+  u32 pc = u32(-4);
+  u32 value = 0;
+  u32 address = 0;
+  std::vector<u32> words = std::vector<u32>(WORD_SLOTS, 0);
+
+  // Last word seen at pc, or at a pc sharing its slot
+  auto word(u32 pc) -> u32& {
+    return this->words[(pc >> 2) & (WORD_SLOTS - 1)];
+  }
+};
+
+// Small deltas either way become small numbers
+static auto zigzag(u32 delta) -> u32 {
+  return (delta << 1) ^ u32(s32(delta) >> 31);
+}
+
+static auto unzigzag(u32 value) -> u32 {
+  return (value >> 1) ^ (0u - (value & 1));
+}
+
+static auto putVarint(std::string& out, u32 value) -> void {
+  while (value >= 0x80) {
+    out.push_back(static_cast<char>(value | 0x80));
+    value >>= 7;
+  }
+  out.push_back(static_cast<char>(value));
+}
+
+static auto encode(Delta& delta, const TraceRecord& record, std::string& out) -> void {
+  u32& word = delta.word(record.pc);
+
+  u8 flags = 0;
+  flags |= record.pc != delta.pc + 4 ? JUMP : 0;
+  flags |= record.word != word ? WORD : 0;
+  flags |= (record.fields & TraceRecord::VALUE) ? VALUE : 0;
+  flags |= (record.fields & TraceRecord::ADDRESS) ? ADDRESS : 0;
+  flags |= (record.fields & TraceRecord::MIPS32) ? MIPS32 : 0;
+  out.push_back(static_cast<char>(flags));
+
+  if (flags & JUMP)
+    putVarint(out, zigzag(record.pc - (delta.pc + 4)));
+  if (flags & WORD)
+    out.append(reinterpret_cast<const char*>(&record.word), sizeof(record.word));
+  if (flags & VALUE)
+    putVarint(out, zigzag(record.value - delta.value));
+  if (flags & ADDRESS)
+    putVarint(out, zigzag(record.address - delta.address));
+
+  delta.pc = record.pc;
+  word = record.word;
+  if (flags & VALUE)
+    delta.value = record.value;
+  if (flags & ADDRESS)
+    delta.address = record.address;
+}
+
+struct Tracer::Writer {
+  RingBuffer<TraceRecord, RING_SIZE> ring;
+  std::string path;
+  std::ofstream file;
+  z_stream stream{};
+  u64 bytes = 0;
+  std::exception_ptr error;
+
+  // Last, so it's stopped and joined before anything it uses goes away
+  std::jthread thread;
+
+  ~Writer() {
+    if (this->thread.joinable()) {
+      this->thread.request_stop();
+      this->thread.join();
+    }
+    deflateEnd(&this->stream);
+  }
+
+  // Deflates input into the file, flush is a zlib flush mode
+  auto compress(std::string_view input, int flush) -> void {
+    std::array<char, CHUNK> output;
+    this->stream.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(input.data()));
+    this->stream.avail_in = static_cast<uInt>(input.size());
+
+    do {
+      this->stream.next_out = reinterpret_cast<Bytef*>(output.data());
+      this->stream.avail_out = CHUNK;
+      deflate(&this->stream, flush);
+
+      size_t produced = CHUNK - this->stream.avail_out;
+      this->file.write(output.data(), produced);
+      this->bytes += produced;
+    } while (this->stream.avail_out == 0);
+
+    if (!this->file) {
+      throw std::runtime_error(std::format("ERROR! Couldn't write trace {}\n", this->path));
+    }
+  }
+
+  // Encodes whatever the core pushed until it's asked to stop and the ring is empty
+  auto run(std::stop_token stop) -> void {
+    std::vector<TraceRecord> batch(BATCH);
+    std::string encoded;
+    Delta delta;
+    bool stopping = false;
+
+    while (true) {
+      size_t count = this->ring.pop(batch);
+      if (count == 0) {
+        // One more pass once stopped, for what was pushed right before
+        if (stopping)
+          break;
+        stopping = stop.stop_requested();
+        if (!stopping)
+          std::this_thread::sleep_for(std::chrono::microseconds(100));
+        continue;
+      }
+
+      // Records are still drained after a failure, the core must never wait on us
+      if (this->error)
+        continue;
+
+      try {
+        for (size_t i = 0; i < count; i++) {
+          encode(delta, batch[i], encoded);
+        }
+        if (encoded.size() >= CHUNK) {
+          this->compress(encoded, Z_NO_FLUSH);
+          encoded.clear();
+        }
+      } catch (...) {
+        this->error = std::current_exception();
+      }
+    }
+
+    if (this->error)
+      return;
+
+    try {
+      this->compress(encoded, Z_FINISH);
+      this->file.close();
+      if (!this->file) {
+        throw std::runtime_error(std::format("ERROR! Couldn't write trace {}\n", this->path));
+      }
+    } catch (...) {
+      this->error = std::current_exception();
+    }
+  }
+};
+
+Tracer::Tracer() = default;
+Tracer::~Tracer() = default;
+
+auto Tracer::open(const std::string& path) -> void {
+  auto writer = std::make_unique<Writer>();
+  writer->path = path;
+  writer->file.open(path, std::ios::binary | std::ios::trunc);
+  if (!writer->file) {
+    throw std::runtime_error(std::format("ERROR! Couldn't create {}\n", path));
+  }
+
+  writer->file.write(reinterpret_cast<const char*>(&MAGIC), sizeof(MAGIC));
+  writer->file.write(reinterpret_cast<const char*>(&VERSION), sizeof(VERSION));
+  writer->bytes = sizeof(MAGIC) + sizeof(VERSION);
+
+  if (deflateInit(&writer->stream, Z_BEST_SPEED) != Z_OK) {
+    throw std::runtime_error(std::format("ERROR! Couldn't compress {}\n", path));
+  }
+
+  writer->thread = std::jthread([writer = writer.get()](std::stop_token stop) { writer->run(stop); });
+  this->ring = &writer->ring;
+  this->writer = std::move(writer);
+  this->recorded = 0;
+  this->written = 0;
+}
+
+auto Tracer::isOpen() const -> bool {
+  return this->writer != nullptr;
+}
+
+auto Tracer::close() -> void {
+  if (this->writer == nullptr)
+    return;
+
+  this->writer->thread.request_stop();
+  this->writer->thread.join();
+
+  std::exception_ptr error = this->writer->error;
+  this->written = this->writer->bytes;
+  this->writer.reset();
+  this->ring = nullptr;
+
+  if (error) {
+    std::rethrow_exception(error);
+  }
+}
+
+auto Tracer::records() const -> u64 {
+  return this->recorded;
+}
+
+auto Tracer::bytes() const -> u64 {
+  return this->written;
+}
+
+struct TraceReader::Inflater {
+  std::string path;
+  std::ifstream file;
+  z_stream stream{};
+  std::array<char, CHUNK> input;
+  std::string output;
+  size_t position = 0;
+  bool ended = false;
+  Delta delta;
+
+  ~Inflater() {
+    inflateEnd(&this->stream);
+  }
+
+  [[noreturn]] auto truncated() const -> void {
+    throw std::runtime_error(std::format("ERROR! Trace {} is truncated or corrupted\n", this->path));
+  }
+
+  // Inflates the next chunk of the stream
+  auto refill() -> void {
+    if (this->stream.avail_in == 0) {
+      this->file.read(this->input.data(), CHUNK);
+      this->stream.next_in = reinterpret_cast<Bytef*>(this->input.data());
+      this->stream.avail_in = static_cast<uInt>(this->file.gcount());
+      if (this->stream.avail_in == 0)
+        this->truncated();
+    }
+
+    this->output.resize(CHUNK);
+    this->position = 0;
+    this->stream.next_out = reinterpret_cast<Bytef*>(this->output.data());
+    this->stream.avail_out = CHUNK;
+
+    int status = inflate(&this->stream, Z_NO_FLUSH);
+    if (status == Z_STREAM_END)
+      this->ended = true;
+    else if (status != Z_OK && status != Z_BUF_ERROR)
+      this->truncated();
+
+    this->output.resize(CHUNK - this->stream.avail_out);
+  }
+
+  // Next byte of the stream, false once it ended
+  auto byte(u8& value) -> bool {
+    while (this->position == this->output.size()) {
+      if (this->ended)
+        return false;
+      this->refill();
+    }
+
+    value = static_cast<u8>(this->output[this->position++]);
+    return true;
+  }
+
+  // Next byte of a record that already started
+  auto need() -> u8 {
+    u8 value;
+    if (!this->byte(value))
+      this->truncated();
+    return value;
+  }
+
+  auto varint() -> u32 {
+    u32 value = 0;
+    for (u32 shift = 0; shift < 35; shift += 7) {
+      u8 part = this->need();
+      value |= u32(part & 0x7F) << shift;
+      if ((part & 0x80) == 0)
+        return value;
+    }
+    this->truncated();
+  }
+};
+
+TraceReader::TraceReader() = default;
+TraceReader::~TraceReader() = default;
+
+auto TraceReader::open(const std::string& path) -> std::unique_ptr<TraceReader> {
+  std::unique_ptr<TraceReader> reader{new TraceReader()};
+  reader->path = path;
+  reader->inflater = std::make_unique<Inflater>();
+
+  Inflater& inflater = *reader->inflater;
+  inflater.path = path;
+  inflater.file.open(path, std::ios::binary);
+  if (!inflater.file) {
+    throw std::runtime_error(std::format("ERROR! Couldn't open {}\n", path));
+  }
+
+  u32 magic = 0;
+  u32 version = 0;
+  inflater.file.read(reinterpret_cast<char*>(&magic), sizeof(magic));
+  inflater.file.read(reinterpret_cast<char*>(&version), sizeof(version));
+  if (!inflater.file || magic != Tracer::MAGIC || version != Tracer::VERSION) {
+    throw std::runtime_error(std::format("ERROR! {} isn't a trace written by this emulator\n", path));
+  }
+
+  if (inflateInit(&inflater.stream) != Z_OK) {
+    throw std::runtime_error(std::format("ERROR! Couldn't decompress {}\n", path));
+  }
+
+  return reader;
+}
+
+auto TraceReader::next(TraceRecord& record) -> bool {
+  Inflater& inflater = *this->inflater;
+  Delta& delta = inflater.delta;
+
+  u8 flags;
+  if (!inflater.byte(flags))
+    return false;
+
+  record.pc = delta.pc + 4;
+  if (flags & JUMP)
+    record.pc += unzigzag(inflater.varint());
+
+  u32& word = delta.word(record.pc);
+  record.word = word;
+  if (flags & WORD) {
+    std::array<u8, sizeof(u32)> bytes;
+    for (u8& byte : bytes) {
+      byte = inflater.need();
+    }
+    std::memcpy(&record.word, bytes.data(), bytes.size());
+  }
+
+  record.fields = 0;
+  record.value = 0;
+  record.address = 0;
+  if (flags & VALUE) {
+    delta.value += unzigzag(inflater.varint());
+    record.value = delta.value;
+    record.fields |= TraceRecord::VALUE;
+  }
+  if (flags & ADDRESS) {
+    delta.address += unzigzag(inflater.varint());
+    record.address = delta.address;
+    record.fields |= TraceRecord::ADDRESS;
+  }
+  if (flags & MIPS32)
+    record.fields |= TraceRecord::MIPS32;
+
+  delta.pc = record.pc;
+  word = record.word;
+  return true;
+}
+
+auto TraceReader::print(const std::string& path, std::ostream& out) -> void {
+  auto reader = open(path);
+
+  TraceRecord record;
+  while (reader->next(record)) {
+    Encoding encoding = (record.fields & TraceRecord::MIPS32) ? Encoding::MIPS32 : Encoding::ASSEMBLER;
+    DecodedOp op = Decoder::decode(record.word, record.pc, encoding);
+    std::string line = std::format("0x{:08x}  {:08x}  {}", record.pc, record.word, Decoder::name(op.kind));
+    line.resize(std::max<size_t>(line.size(), 30), ' ');
+
+    if (record.fields & TraceRecord::VALUE)
+      line += std::format("  ${} = {}", destinationOf(op), static_cast<s32>(record.value));
+    if (record.fields & TraceRecord::ADDRESS)
+      line += std::format("  [0x{:08x}]", record.address);
+
+    // Nothing to show after the mnemonic
+    while (line.ends_with(' '))
+      line.pop_back();
+    line += '\n';
+    out << line;
+  }
+}
+
+} // namespace Emulator
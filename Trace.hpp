@@ -0,0 +1,151 @@
+#pragma once
+
+#include "Core.hpp"
+#include "RingBuffer.hpp"
+
+#include <memory>
+#include <thread>
+
+namespace Emulator {
+
+// One retired instruction of a trace
+struct TraceRecord {
+  static constexpr u8 VALUE = 1;   // value is what it wrote to its destination register
+  static constexpr u8 ADDRESS = 2; // address is where it loaded or stored
+  static constexpr u8 MIPS32 = 4;  // word is in the MIPS32 encoding
+
+  u32 pc;
+  u32 word;
+  u32 value;
+  u32 address;
+  u8 fields;
+};
+
+// Register an instruction writes, 0 for none. A syscall is taken as writing
+// $v0 since that's where read_int and read_char leave what they read
+inline auto destinationOf(const DecodedOp& op) -> u8 {
+  switch (op.kind) {
+    case Op::SLL: case Op::SRL: case Op::MUL: case Op::ADD: case Op::SUB:
+    case Op::AND: case Op::OR: case Op::NOR: case Op::SLT:
+    case Op::SRA: case Op::SLLV: case Op::SRLV: case Op::SRAV: case Op::JALR: case Op::MOVZ: case Op::MOVN:
+    case Op::MFHI: case Op::MFLO: case Op::XOR: case Op::SLTS: case Op::SLTU:
+      return op.rd;
+
+    case Op::ADDI: case Op::SLTI: case Op::ANDI: case Op::ORI: case Op::LW: case Op::LBU:
+    case Op::LL: case Op::SC:
+    case Op::SLTIS: case Op::SLTIU: case Op::XORI: case Op::LUI: case Op::LB: case Op::LH: case Op::LHU:
+      return op.rt;
+
+    case Op::JAL: case Op::DJAL:
+      return 31;
+
+    case Op::SYSCALL:
+      return 2;
+
+    default:
+      return 0;
+  }
+}
+
+// Records every instruction retired by runCore() into a ring buffer that a
+// thread of its own drains into a file, so the core only pays for filling
+// in a record. The file starts with the magic "MTRC" and a version, both
+// u32 in host byte order, followed by a zlib stream of records:
+//
+//   flags    JUMP, WORD, VALUE, ADDRESS and MIPS32 bits
+//   pc       zigzag varint of pc - (previous pc + 4), only with JUMP
+//   word     4 bytes, only with WORD when it isn't the last word seen at that pc
+//   value    zigzag varint of value - previous value, only with VALUE
+//   address  zigzag varint of address - previous address, only with ADDRESS
+//
+// Straight line code mostly takes 1 to 3 bytes per instruction before
+// deflate gets to it
+class Tracer {
+public:
+  static constexpr u32 MAGIC = 0x4352544D; // "MTRC"
+  static constexpr u32 VERSION = 2;
+
+  Tracer();
+  ~Tracer();
+
+  // Creates the file and starts the thread writing it, throws when the file
+  // can't be created
+  auto open(const std::string& path) -> void;
+
+  // Whether open() was called and close() wasn't
+  auto isOpen() const -> bool;
+
+  // Drains the ring buffer, ends the zlib stream and stops the thread.
+  // Throws when writing the file failed
+  auto close() -> void;
+
+  // Instructions recorded and bytes written since open()
+  auto records() const -> u64;
+  auto bytes() const -> u64;
+
+  // Points the tracer at the registers of cpu
+  auto reset(const CPU& cpu) -> void {
+    this->cpu = &cpu;
+    this->encoding = cpu.encoding == Encoding::MIPS32 ? TraceRecord::MIPS32 : 0;
+  }
+
+  // Hands one record to the writer, waiting for room if it fell behind
+  auto retire(const Retired& instruction) -> void {
+    TraceRecord record{instruction.pc, instruction.op.word, 0, 0, this->encoding};
+
+    u8 destination = destinationOf(instruction.op);
+    if (destination != 0) {
+      record.value = this->cpu->registers[destination];
+      record.fields |= TraceRecord::VALUE;
+    }
+
+    Op kind = instruction.op.kind;
+    if (kind == Op::LW || kind == Op::LBU || kind == Op::SW || kind == Op::SB || kind == Op::LL || kind == Op::SC ||
+        kind == Op::LB || kind == Op::LH || kind == Op::LHU || kind == Op::SH) {
+      record.address = instruction.address;
+      record.fields |= TraceRecord::ADDRESS;
+    }
+
+    while (!this->ring->push(record)) {
+      std::this_thread::yield();
+    }
+    this->recorded++;
+  }
+
+private:
+  static constexpr size_t RING_SIZE = 1 << 16;
+
+  // The writer, only there while the tracer is open
+  struct Writer;
+  std::unique_ptr<Writer> writer;
+  RingBuffer<TraceRecord, RING_SIZE>* ring = nullptr;
+  const CPU* cpu = nullptr;
+  u8 encoding = 0; // TraceRecord::MIPS32 or nothing
+  u64 recorded = 0;
+  u64 written = 0;
+};
+
+// Decodes a file written by Tracer
+class TraceReader {
+public:
+  ~TraceReader();
+
+  // Throws when the file can't be read or isn't a trace
+  static auto open(const std::string& path) -> std::unique_ptr<TraceReader>;
+
+  // Reads the next record, returns false at the end of the trace. Throws
+  // when the trace is truncated or corrupted
+  auto next(TraceRecord& record) -> bool;
+
+  // Prints every record of a trace, one instruction per line
+  static auto print(const std::string& path, std::ostream& out) -> void;
+
+private:
+  struct Inflater;
+  std::unique_ptr<Inflater> inflater;
+  std::string path;
+
+  TraceReader();
+};
+
+} // namespace Emulator
@@ -0,0 +1,62 @@
+#!/usr/bin/env bash
+# Generates a long program and prints how long each emulator takes to
+# tokenize and assemble it (median "assembly time" of --stats). Give it
+# an emulator built from another revision to compare the two
+# Usage: benchmarks/assembler.sh [-l lines] [-n runs] [emulator...]
+
+cd "$(dirname "$0")/.." || exit 1
+
+LINES=200000
+RUNS=5
+
+while getopts "l:n:" option; do
+  case $option in
+    l) LINES=$OPTARG ;;
+    n) RUNS=$OPTARG ;;
+    *) echo "Usage: $0 [-l lines] [-n runs] [emulator...]" >&2; exit 1 ;;
+  esac
+done
+shift $((OPTIND - 1))
+
+EMULATORS=("$@")
+if [ ${#EMULATORS[@]} -eq 0 ]; then
+  [ -x ./emulator ] || make || exit 1
+  EMULATORS=(./emulator)
+fi
+
+WORK=$(mktemp -d)
+trap 'rm -rf "$WORK"' EXIT
+SOURCE="$WORK/generated.asm"
+
+# Straight line blocks of arithmetic, each jumping forward to the next
+# one, so most label uses are resolved after the label is seen
+awk -v lines="$LINES" 'BEGIN {
+  print ".data"
+  print "values: .word 1, 2, 3, 4, 5, 6, 7, 8"
+  print "buffer: .space 64"
+  print "message: .asciiz \"generated program\""
+  print ".text"
+  print "main:"
+  print "  la $s0, values"
+  blocks = int(lines / 6)
+  for (i = 0; i < blocks; i++) {
+    printf "block%d:\n", i
+    print "  addi $t0, $t0, 1 # counter"
+    print "  add $t1, $t1, $t0"
+    print "  sll $t2, $t1, 2"
+    print "  lw $t3, 4($s0)"
+    printf "  j block%d\n", i + 1
+  }
+  printf "block%d:\n", blocks
+  print "  li $v0, 10"
+  print "  syscall"
+}' > "$SOURCE"
+
+printf "%s lines, median of %d runs\n" "$(wc -l < "$SOURCE")" "$RUNS"
+for emulator in "${EMULATORS[@]}"; do
+  for _ in $(seq "$RUNS"); do
+    "$emulator" --stats "$SOURCE" 2>&1 < /dev/null | sed -n 's/^assembly time: *\([0-9]*\).*/\1/p'
+  done | sort -n | awk -v name="$emulator" -v lines="$LINES" '
+    { times[NR] = $1 }
+    END { t = times[int((NR + 1) / 2)]; printf "%-40s %10.2f ms %12.0f lines/s\n", name, t / 1e6, (t > 0 ? lines * 1e9 / t : 0) }'
+done
@@ -0,0 +1,104 @@
+#!/usr/bin/env bash
+# Assembles and runs every program from programs/ many times and prints
+# a JSON summary: assembly and execution time (median, p95), retired
+# instructions and guest MIPS
+# Usage: benchmarks/bench.sh [-n runs] [-w warmup] [-e engine] [-o file]
+
+cd "$(dirname "$0")/.." || exit 1
+
+RUNS=20
+WARMUP=3
+ENGINE=decoded
+OUTPUT=/dev/stdout
+
+while getopts "n:w:e:o:" option; do
+  case $option in
+    n) RUNS=$OPTARG ;;
+    w) WARMUP=$OPTARG ;;
+    e) ENGINE=$OPTARG ;;
+    o) OUTPUT=$OPTARG ;;
+    *) echo "Usage: $0 [-n runs] [-w warmup] [-e engine] [-o file]" >&2; exit 1 ;;
+  esac
+done
+
+[ -x ./emulator ] || make || exit 1
+
+INPUTS=$(mktemp -d)
+trap 'rm -rf "$INPUTS"' EXIT
+
+# Writes the stdin fed to a program, scaled up where the program allows it
+input_for() {
+  case $1 in
+    recursiveFibonacci) echo 25 ;;
+    Fibonnaci)          echo 1000000 ;;
+    iterativeFactorial) echo 1000000 ;;
+    OddOrEven)          echo 2000000 ;;
+    recursiveFactorial) echo 50000 ;;
+    binarySearch)       echo 233 ;;
+    mean)               printf "7\n12\n" ;;
+    SumArrayElements)   echo 100000; seq 100000 ;;
+    parallelSumArray)   echo 1000000 ;;
+    *)                  ;;
+  esac
+}
+
+# Prints the value of a "--stats" line
+stat() {
+  sed -n "s/^$1: *\([0-9]*\).*/\1/p" "$2"
+}
+
+# Nearest rank percentile of the numbers on stdin
+percentile() {
+  sort -n | awk -v p="$1" '{ v[NR] = $1 } END { i = int((p * NR + 99) / 100); if (i < 1) i = 1; print v[i] }'
+}
+
+{
+  printf '{\n'
+  printf '  "emulator": "%s",\n' "$(git describe --always --dirty 2>/dev/null || echo unknown)"
+  printf '  "engine": "%s",\n' "$ENGINE"
+  printf '  "runs": %d,\n' "$RUNS"
+  printf '  "warmup": %d,\n' "$WARMUP"
+  printf '  "benchmarks": ['
+
+  separator=""
+  for source in programs/*.asm; do
+    program=$(basename "$source" .asm)
+    input="$INPUTS/$program.in"
+    stats="$INPUTS/$program.stats"
+    input_for "$program" > "$input"
+
+    for _ in $(seq "$WARMUP"); do
+      ./emulator --engine="$ENGINE" "$source" < "$input" > /dev/null 2>&1
+    done
+
+    : > "$INPUTS/assembly" ; : > "$INPUTS/execution"
+    for _ in $(seq "$RUNS"); do
+      ./emulator --engine="$ENGINE" --stats "$source" < "$input" > /dev/null 2> "$stats"
+      stat "assembly time" "$stats" >> "$INPUTS/assembly"
+      stat "execution time" "$stats" >> "$INPUTS/execution"
+    done
+
+    # Retired instructions don't change between runs
+    retired=$(stat retired "$stats")
+
+    assemblyMedian=$(percentile 50 < "$INPUTS/assembly")
+    assemblyP95=$(percentile 95 < "$INPUTS/assembly")
+    executionMedian=$(percentile 50 < "$INPUTS/execution")
+    executionP95=$(percentile 95 < "$INPUTS/execution")
+
+    # Instructions per microsecond are millions of instructions per second
+    mips=$(awk -v i="$retired" -v t="$executionMedian" 'BEGIN { printf "%.2f", (t > 0 ? i * 1000 / t : 0) }')
+
+    printf '%s\n    {\n' "$separator"
+    printf '      "program": "%s",\n' "$program"
+    printf '      "input_lines": %d,\n' "$(wc -l < "$input")"
+    printf '      "retired_instructions": %d,\n' "$retired"
+    printf '      "assembly_ns": {"median": %d, "p95": %d},\n' "$assemblyMedian" "$assemblyP95"
+    printf '      "execution_ns": {"median": %d, "p95": %d},\n' "$executionMedian" "$executionP95"
+    printf '      "guest_mips": %s\n' "$mips"
+    printf '    }'
+    separator=","
+  done
+
+  printf '\n  ]\n}\n'
+} > "$OUTPUT"
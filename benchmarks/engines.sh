@@ -0,0 +1,42 @@
+#!/usr/bin/env bash
+# Runs the longer programs from programs/ on every interpreter core and
+# prints the best wall time out of a few runs
+# Usage: benchmarks/engines.sh [runs]
+
+cd "$(dirname "$0")/.." || exit 1
+
+RUNS=${1:-3}
+ENGINES="switch decoded threaded block jit"
+
+# program:input, inputs are scaled up so each run takes a while
+WORKLOADS="
+recursiveFibonacci:27
+Fibonnaci:3000000
+iterativeFactorial:3000000
+OddOrEven:6000000
+recursiveFactorial:100000
+"
+
+[ -x ./emulator ] || make || exit 1
+
+printf "%-28s" "program"
+for engine in $ENGINES; do printf "%10s" "$engine"; done
+printf "\n"
+
+for workload in $WORKLOADS; do
+  program=${workload%%:*}
+  input=${workload##*:}
+  printf "%-28s" "$program($input)"
+
+  for engine in $ENGINES; do
+    best=""
+    for _ in $(seq "$RUNS"); do
+      start=$(date +%s%N)
+      echo "$input" | ./emulator --engine="$engine" "programs/$program.asm" > /dev/null
+      elapsed=$(( ($(date +%s%N) - start) / 1000000 ))
+      if [ -z "$best" ] || [ "$elapsed" -lt "$best" ]; then best=$elapsed; fi
+    done
+    printf "%8sms" "$best"
+  done
+  printf "\n"
+done
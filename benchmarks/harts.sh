@@ -0,0 +1,35 @@
+#!/usr/bin/env bash
+# Runs programs/parallelSumArray.asm on more and more harts and prints the
+# best wall time out of a few runs and the speedup over a single hart
+# Usage: benchmarks/harts.sh [elements] [runs] [max harts]
+
+cd "$(dirname "$0")/.." || exit 1
+
+ELEMENTS=${1:-4000000}
+RUNS=${2:-3}
+MAX_HARTS=${3:-$(nproc)}
+
+[ -x ./emulator ] || make || exit 1
+
+printf "%-8s%12s%10s\n" "harts" "time" "speedup"
+
+single=""
+harts=1
+while [ "$harts" -le "$MAX_HARTS" ]; do
+  best=""
+  for _ in $(seq "$RUNS"); do
+    start=$(date +%s%N)
+    echo "$ELEMENTS" | ./emulator --harts="$harts" programs/parallelSumArray.asm > /dev/null
+    elapsed=$(( ($(date +%s%N) - start) / 1000000 ))
+    if [ -z "$best" ] || [ "$elapsed" -lt "$best" ]; then best=$elapsed; fi
+  done
+
+  [ -z "$single" ] && single=$best
+  printf "%-8s%10sms%9sx\n" "$harts" "$best" "$(awk -v a="$single" -v b="$best" 'BEGIN { printf "%.2f", b == 0 ? 0 : a / b }')"
+
+  if [ "$harts" -lt "$MAX_HARTS" ] && [ $(( harts * 2 )) -gt "$MAX_HARTS" ]; then
+    harts=$MAX_HARTS
+  else
+    harts=$(( harts * 2 ))
+  fi
+done
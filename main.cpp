@@ -1,29 +1,144 @@
+#include "Batch.hpp"
 #include "Engine.hpp"
+#include "ForkServer.hpp"
+#include "Options.hpp"
 #include "debugHelper.hpp"
 #include <bitset>
 
 auto main(int argc, char *argv[]) -> int {
-  if (argc != 2) {
-    std::cout << std::format("Not enough arguments\n");
-    std::cout << std::format("Usage : {} <file.asm>\n", argv[0]);
+  Emulator::Options options;
+
+  try {
+    options = Emulator::Options::parse(argc, argv);
+  } catch (const std::invalid_argument& e) {
+    std::cout << e.what();
+    Emulator::Options::printUsage(argv[0]);
+    return 0;
+  }
+
+  if (!options.decodeTrace.empty()) {
+    try {
+      Emulator::TraceReader::print(options.decodeTrace, std::cout);
+    } catch (const std::exception& e) {
+      std::cout << e.what();
+    }
     return 0;
   }
 
-  std::string program = std::string(argv[1]);
-  if (!program.contains(".asm")) {
-    std::cout << std::format("You must use only .asm files\n");
+  if (!options.batch.empty()) {
+    try {
+      Emulator::Batch batch;
+      batch.jobs = Emulator::Batch::load(options.batch);
+      batch.interpreter = options.interpreter;
+      batch.maxInstructions = options.maxInstructions;
+      batch.threads = options.jobs;
+      batch.quantum = options.quantum;
+      batch.cache = options.cache;
+      batch.run();
+      batch.report(std::cout);
+    } catch (const std::exception& e) {
+      std::cout << e.what();
+    }
+    return 0;
+  }
+
+  if (!options.forkServer.empty()) {
+    try {
+      Emulator::ForkServer server;
+      server.program = options.program;
+      server.inputs = Emulator::ForkServer::load(options.forkServer);
+      server.interpreter = options.interpreter;
+      server.maxInstructions = options.maxInstructions;
+      server.threads = options.jobs;
+      server.cache = options.cache;
+      if (options.timeout)
+        server.timeout = std::chrono::milliseconds{*options.timeout};
+      server.run(std::cout);
+    } catch (const std::exception& e) {
+      std::cout << e.what();
+    }
     return 0;
   }
 
   Emulator::Tokenizer tokenizer;
   Emulator::CPU cpu;
   Emulator::Engine engine(tokenizer, cpu);
+  engine.interpreter = options.interpreter;
+  engine.checks = options.checks;
+  engine.maxInstructions = options.maxInstructions;
+  engine.harts.limit = options.harts;
+  engine.profile = options.profile;
+  engine.timing = options.timing;
+  engine.pipeline.config = options.pipeline;
+  engine.predictBranches = options.branches;
+  if (options.icache) {
+    engine.caches.instructions = true;
+    engine.caches.icache = Emulator::Cache(*options.icache);
+  }
+  if (options.dcache) {
+    engine.caches.data = true;
+    engine.caches.dcache = Emulator::Cache(*options.dcache);
+  }
+  cpu.io.lineBuffered = options.lineBuffered;
 
   try {
 
-    auto [code, size] = engine.assembler(program);
-    engine.run(std::span<u8>(code, size));
-    delete[] code;
+    if (!options.trace.empty()) {
+      engine.tracer.open(options.trace);
+    }
+
+    if (!options.restore.empty()) {
+      engine.load(*Emulator::Snapshot::open(options.restore));
+    } else {
+      engine.loadFile(options.program, options.cache);
+    }
+
+    if (!options.snapshot.empty()) {
+      if (engine.run(options.snapshotAt) != Emulator::Status::PAUSED) {
+        std::cout << std::format("ERROR! Program stopped before the snapshot at {} instructions\n", options.snapshotAt);
+      } else {
+        Emulator::Snapshot::write(options.snapshot, cpu, tokenizer);
+      }
+    }
+
+    if (engine.run() == Emulator::Status::TIMEOUT) {
+      std::cout << std::format("ERROR! Program didn't finish within {} instructions\n", options.maxInstructions);
+    }
+
+    // Lets the output of different engines be diffed against each other
+    if (options.dumpRegisters) {
+      engine.printContentFromAllRegisters();
+    }
+
+    if (options.stats) {
+      engine.printStats();
+    }
+
+    if (options.timing) {
+      engine.pipeline.report(tokenizer, std::cerr);
+    }
+
+    if (options.icache || options.dcache) {
+      engine.caches.report(tokenizer, std::cerr);
+    }
+
+    if (options.branches) {
+      engine.branches.report(tokenizer, std::cerr);
+    }
+
+    if (!options.trace.empty()) {
+      engine.tracer.close();
+      std::cerr << std::format("trace: {} instructions in {} bytes, {:.2f} bytes per instruction\n",
+                               engine.tracer.records(), engine.tracer.bytes(),
+                               engine.tracer.records() == 0 ? 0.0 : double(engine.tracer.bytes()) / double(engine.tracer.records()));
+    }
+
+    if (options.profile) {
+      engine.profiler.report(tokenizer, std::cerr);
+      if (!options.profileOutput.empty()) {
+        engine.profiler.write(tokenizer, options.profileOutput);
+      }
+    }
 
   } catch (const std::exception& e) {
 
@@ -32,4 +147,4 @@ auto main(int argc, char *argv[]) -> int {
   }
 
   return 0;
-}
\ No newline at end of file
+}
@@ -0,0 +1,123 @@
+# Fills the vector with 1..n and sums it on every hart the emulator allows
+# (--harts=n). Harts take chunks of the vector through a counter updated with
+# ll/sc and add what they summed to the total the same way
+.data
+next:   .word 0                      # First index no hart took yet
+total:  .word 0
+count:  .word 0
+prompt: .asciiz "Digite o número de elementos do vetor: "
+result: .asciiz "O somatório dos elementos é:"
+
+.text
+main:
+        li $v0, 4
+        la $a0, prompt
+        syscall
+
+        # Read the number of elements (n)
+        li $v0, 5
+        syscall
+        la $t0, count
+        sw $v0, 0($t0)
+
+        # Spawn workers until there are no harts left, $s0 counts them
+        li $s0, 0
+spawn:
+        li $v0, 18
+        la $a0, worker
+        li $a1, 0
+        li $a2, 0                   # A stack of its own
+        syscall
+        li $t0, -1
+        beq $v0, $t0, work
+        addi $s0, $s0, 1
+        j spawn
+
+work:
+        jal sum_chunks
+
+        # Wait for the workers, their ids go from 1 to $s0
+        li $s1, 1
+join:
+        blt $s0, $s1, print
+        li $v0, 19
+        move $a0, $s1
+        syscall
+        addi $s1, $s1, 1
+        j join
+
+print:
+        li $v0, 4
+        la $a0, result
+        syscall
+
+        la $t0, total
+        lw $a0, 0($t0)
+        li $v0, 1
+        syscall
+
+        li $v0, 10
+        syscall
+
+worker:
+        jal sum_chunks
+        li $v0, 10
+        syscall
+
+# Fills and sums chunks of the vector until none is left, then adds the
+# partial sum to total
+sum_chunks:
+        li $t9, 0                   # Partial sum
+        la $t8, count
+        lw $t8, 0($t8)              # n
+        la $t7, next
+
+        # The vector lives at 0x10000000
+        li $t6, 4096
+        sll $t6, $t6, 16
+
+claim:
+        ll $t0, 0($t7)              # First index of the chunk
+        addi $t1, $t0, 1024
+        sc $t1, 0($t7)
+        beq $t1, $zero, claim       # Another hart took it first
+        bge $t0, $t8, add_total     # Nothing left
+
+        # end = min(first + 1024, n)
+        addi $t2, $t0, 1024
+        blt $t2, $t8, fill
+        move $t2, $t8
+
+fill:
+        move $t3, $t0
+fill_loop:
+        bge $t3, $t2, sum
+        sll $t4, $t3, 2
+        add $t4, $t4, $t6
+        addi $t5, $t3, 1
+        sw $t5, 0($t4)              # vector[i] = i + 1
+        addi $t3, $t3, 1
+        j fill_loop
+
+sum:
+        move $t3, $t0
+sum_loop:
+        bge $t3, $t2, claim
+        sll $t4, $t3, 2
+        add $t4, $t4, $t6
+        lw $t5, 0($t4)
+        add $t9, $t9, $t5
+        addi $t3, $t3, 1
+        j sum_loop
+
+add_total:
+        la $t7, total
+add_loop:
+        ll $t0, 0($t7)
+        add $t1, $t0, $t9
+        sc $t1, 0($t7)
+        beq $t1, $zero, add_loop
+
+        # The sum is visible to the hart joining this one
+        sync
+        jr $ra